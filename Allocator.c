@@ -0,0 +1,261 @@
+/*
+ * 3dObjLib: Pluggable memory allocation
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this source file.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "Internal/3dObjMisc.h"
+#include "Allocator.h"
+
+enum {
+  ARENA_BLOCK_SIZE = 64 * 1024
+};
+
+/* Allocations are made in units of this type so that they are suitably
+   aligned for any object. Each is preceded by a unit holding its size. */
+typedef union {
+  size_t size;
+  long double ld;
+  long long ll;
+  void *p;
+  void (*fn)(void);
+} ArenaUnit;
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t nunits;
+  size_t used; /* number of units allocated */
+  ArenaUnit units[];
+};
+
+void allocator_init(Allocator * const alloc, AllocatorFn * const fn,
+                    void * const context)
+{
+  assert(alloc != NULL);
+  assert(fn != NULL);
+  *alloc = (Allocator){
+    .fn = fn,
+    .context = context,
+  };
+}
+
+void *allocator_alloc(const Allocator * const alloc, const size_t size)
+{
+  assert(size > 0);
+  return alloc ? alloc->fn(alloc->context, NULL, size) : malloc(size);
+}
+
+void *allocator_realloc(const Allocator * const alloc, void * const ptr,
+                        const size_t size)
+{
+  assert(size > 0);
+  return alloc ? alloc->fn(alloc->context, ptr, size) : realloc(ptr, size);
+}
+
+void allocator_free(const Allocator * const alloc, void * const ptr)
+{
+  if (alloc == NULL) {
+    free(ptr);
+  } else if (ptr != NULL) {
+    void * const result = alloc->fn(alloc->context, ptr, 0);
+    assert(result == NULL);
+    NOT_USED(result);
+  }
+}
+
+static size_t arena_units(const size_t size)
+{
+  /* Include a unit for the size of the allocation */
+  if (size > SIZE_MAX - sizeof(ArenaUnit) * 2) {
+    return 0;
+  }
+  return 1 + (size + sizeof(ArenaUnit) - 1) / sizeof(ArenaUnit);
+}
+
+static ArenaBlock *arena_new_block(const size_t nunits)
+{
+  if (nunits > (SIZE_MAX - sizeof(ArenaBlock)) / sizeof(ArenaUnit)) {
+    return NULL;
+  }
+  const size_t nbytes = sizeof(ArenaBlock) + sizeof(ArenaUnit) * nunits;
+  ArenaBlock * const block = malloc(nbytes);
+  if (block == NULL) {
+    DEBUGF("Failed to allocate %zu bytes for arena\n", nbytes);
+    return NULL;
+  }
+  *block = (ArenaBlock){
+    .next = NULL,
+    .nunits = nunits,
+    .used = 0,
+  };
+  return block;
+}
+
+static void *arena_alloc(Arena * const arena, const size_t size)
+{
+  assert(arena != NULL);
+  const size_t nunits = arena_units(size);
+  if (nunits == 0) {
+    return NULL;
+  }
+
+  const size_t block_units = arena->block_size / sizeof(ArenaUnit);
+  ArenaBlock *block = arena->blocks;
+  if ((block == NULL) || (nunits > block->nunits - block->used)) {
+    if (nunits > block_units) {
+      /* Give big allocations a block of their own so that the rest of
+         the current block isn't wasted */
+      ArenaBlock * const big = arena_new_block(nunits);
+      if (big == NULL) {
+        return NULL;
+      }
+      big->used = nunits;
+      big->units[0].size = size;
+      if (block == NULL) {
+        arena->blocks = big;
+      } else {
+        big->next = block->next;
+        block->next = big;
+      }
+      return big->units + 1;
+    }
+
+    block = arena_new_block(block_units);
+    if (block == NULL) {
+      return NULL;
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+
+  ArenaUnit * const unit = block->units + block->used;
+  block->used += nunits;
+  unit->size = size;
+  arena->last = unit + 1;
+  return arena->last;
+}
+
+static void *arena_fn(void * const context, void * const ptr,
+                      const size_t size)
+{
+  Arena * const arena = context;
+  assert(arena != NULL);
+
+  if (ptr == NULL) {
+    return size > 0 ? arena_alloc(arena, size) : NULL;
+  }
+
+  ArenaUnit * const unit = (ArenaUnit *)ptr - 1;
+  const size_t old_size = unit->size;
+  ArenaBlock * const block = arena->blocks;
+
+  if (ptr == arena->last) {
+    /* The most recent allocation can be resized or freed in place */
+    assert(block != NULL);
+    const size_t old_units = arena_units(old_size);
+    assert(block->used >= old_units);
+    const size_t base = block->used - old_units;
+
+    if (size == 0) {
+      block->used = base;
+      arena->last = NULL;
+      return NULL;
+    }
+
+    const size_t nunits = arena_units(size);
+    if ((nunits > 0) && (nunits <= block->nunits - base)) {
+      block->used = base + nunits;
+      unit->size = size;
+      return ptr;
+    }
+  }
+
+  if (size == 0) {
+    return NULL;
+  }
+
+  if (size <= old_size) {
+    return ptr;
+  }
+
+  void * const new_ptr = arena_alloc(arena, size);
+  if (new_ptr != NULL) {
+    memcpy(new_ptr, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+void arena_init(Arena * const arena, const size_t block_size)
+{
+  assert(arena != NULL);
+  *arena = (Arena){
+    .blocks = NULL,
+    .block_size = block_size > 0 ? block_size : ARENA_BLOCK_SIZE,
+    .last = NULL,
+  };
+  allocator_init(&arena->allocator, arena_fn, arena);
+}
+
+const Allocator *arena_get_allocator(Arena * const arena)
+{
+  assert(arena != NULL);
+  return &arena->allocator;
+}
+
+void arena_reset(Arena * const arena)
+{
+  assert(arena != NULL);
+
+  /* Keep the first block unless it was made for a big allocation */
+  ArenaBlock *keep = arena->blocks, *block = NULL;
+  if (keep != NULL) {
+    block = keep->next;
+    if (keep->nunits != arena->block_size / sizeof(ArenaUnit)) {
+      block = keep;
+      keep = NULL;
+    }
+  }
+
+  while (block != NULL) {
+    ArenaBlock * const next = block->next;
+    free(block);
+    block = next;
+  }
+
+  if (keep != NULL) {
+    keep->next = NULL;
+    keep->used = 0;
+  }
+  arena->blocks = keep;
+  arena->last = NULL;
+}
+
+void arena_free(Arena * const arena)
+{
+  arena_reset(arena);
+  free(arena->blocks);
+  arena->blocks = NULL;
+}
@@ -0,0 +1,74 @@
+/*
+ * 3dObjLib: Pluggable memory allocation
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this header file.
+ */
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+/* Type of function called to allocate (if ptr is NULL), resize or free
+   (if size is 0) a block of memory. It has the same semantics as realloc
+   except that it must return NULL when freeing. */
+typedef void *AllocatorFn(void *context, void *ptr, size_t size);
+
+typedef struct {
+  AllocatorFn *fn;
+  void *context;
+} Allocator;
+
+void allocator_init(Allocator *alloc, AllocatorFn *fn, void *context);
+
+/* These functions call malloc, realloc and free if alloc is NULL.
+   The size must not be 0. */
+void *allocator_alloc(const Allocator *alloc, size_t size);
+
+void *allocator_realloc(const Allocator *alloc, void *ptr, size_t size);
+
+void allocator_free(const Allocator *alloc, void *ptr);
+
+/* A bump allocator which carves allocations out of large blocks of memory.
+   Freeing or resizing an allocation only reclaims space if it is the most
+   recent one; otherwise space is only reclaimed by arena_reset or
+   arena_free. An arena must not be used by more than one thread at a time. */
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+  Allocator allocator;
+  ArenaBlock *blocks; /* the block currently in use comes first */
+  size_t block_size;
+  void *last; /* most recent allocation in the current block, or NULL */
+} Arena;
+
+/* Memory is requested in blocks of block_size bytes (or a default size if
+   0), except that bigger allocations get a block of their own. */
+void arena_init(Arena *arena, size_t block_size);
+
+const Allocator *arena_get_allocator(Arena *arena);
+
+/* Frees all allocations at once but keeps one block for reuse. */
+void arena_reset(Arena *arena);
+
+/* Frees all allocations and blocks. */
+void arena_free(Arena *arena);
+
+#endif /* ALLOCATOR_H */
@@ -0,0 +1,717 @@
+/*
+ * 3dObjLib: Benchmarks using synthetic models
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this source file.
+                  Vertex counts are now of type VertexIndex.
+                  Added options to write the output to a file and to
+                  compare the faces, lines and points of the output with
+                  a file written by another build.
+ */
+
+/* This program is not part of the library. It generates models of a few
+   kinds and times each stage of converting them to OBJ format, writing one
+   line of comma-separated values for each model and stage:
+
+     model,scale,vertices,primitives,stage,runs,min_seconds,mean_seconds,status
+
+   where vertices and primitives are the numbers generated and status is
+   "ok" or "failed". The same models are generated on every run.
+
+   A model is scaled up by generating more copies of it. Each copy is in a
+   separate pair of groups and doesn't overlap any other copy, so the
+   limit on the number of splits per group isn't reached.
+
+   Options:
+     -r <runs>   number of times to run each model (default 5)
+     -s <scale>  number of copies of each model (default 1)
+     -m <model>  only run the named model (decals, soup or terrain)
+     -t <offset> add an offset to every coordinate (default 0), e.g. to
+                 test the precision of coordinates far from the origin
+     -w <file>   write the output of the first run of each model to a file
+     -c <file>   compare the output of one run of each model with a file
+                 written using -w (e.g. by a build with different
+                 coordinate precision) instead of timing it
+
+   A comparison writes one line of comma-separated values for each model
+   and kind of statement (faces, lines or points):
+
+     model,scale,statement,reference,count,differences
+
+   where reference and count are the number of statements in the file and
+   in the output and differences is the number of statements that aren't
+   the same at the same position. The exit status is failure if there are
+   any differences. */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+/* Local header files */
+#include "Internal/3dObjMisc.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+#include "Clip.h"
+#include "ObjFile.h"
+
+enum {
+  NGROUPS = 2, /* back and front groups of each copy */
+  COPY_SPACING = 128,
+  COPIES_PER_ROW = 16,
+  DEFAULT_RUNS = 5,
+  /* Enough for a face with the maximum number of sides */
+  MAX_LINE_LEN = 32 + (PRIMITIVE_MAX_SIDES * 24)
+};
+
+typedef enum {
+  STAGE_DUPLICATES,
+  STAGE_CLIP,
+  STAGE_VERTICES,
+  STAGE_PRIMITIVES,
+  STAGE_COUNT
+} Stage;
+
+static const char *const stage_names[STAGE_COUNT] = {
+  [STAGE_DUPLICATES] = "find_duplicates",
+  [STAGE_CLIP] = "clip_polygons",
+  [STAGE_VERTICES] = "output_vertices",
+  [STAGE_PRIMITIVES] = "output_primitives",
+};
+
+typedef struct {
+  VertexArray varray;
+  Group *groups;
+  int ngroups;
+  int copy; /* copy being generated */
+  unsigned long long seed;
+  double offset; /* added to every coordinate */
+} Model;
+
+/* Type of function to add the vertices and primitives of one copy of a
+   model of the given size. It must return false if they could not be
+   added. */
+typedef bool GenerateFn(Model *model, int size);
+
+typedef struct {
+  const char *name;
+  GenerateFn *generate;
+  int size;
+} ModelType;
+
+/* Returns a pseudo-random number in the range 0 <= n < limit. */
+static int model_rand(Model * const model, const int limit)
+{
+  assert(model != NULL);
+  assert(limit > 0);
+  model->seed = model->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (int)((model->seed >> 33) % (unsigned)limit);
+}
+
+/* Adds a polygon with the given coordinates, which must be coplanar, to
+   the back (0) or front (1) group of the current copy. */
+static bool model_add_polygon(Model * const model, const int group,
+                              const int nsides, Coord (* const coords)[3])
+{
+  assert(model != NULL);
+  assert(group >= 0);
+  assert(group < NGROUPS);
+  assert(coords != NULL);
+
+  Group * const gp = &model->groups[(model->copy * NGROUPS) + group];
+  assert(gp < model->groups + model->ngroups);
+
+  Primitive * const pp = group_add_primitive(gp);
+  if (pp == NULL) {
+    return false;
+  }
+  primitive_init(pp);
+  primitive_set_colour(pp, model_rand(model, 8));
+  primitive_set_id(pp, group_get_num_primitives(gp));
+
+  const double xoffset = (model->copy % COPIES_PER_ROW) * COPY_SPACING,
+               yoffset = (model->copy / COPIES_PER_ROW) * COPY_SPACING;
+
+  for (int s = 0; s < nsides; ++s) {
+    Coord translated[3] = {
+      (Coord)(coords[s][0] + xoffset + model->offset),
+      (Coord)(coords[s][1] + yoffset + model->offset),
+      (Coord)(coords[s][2] + model->offset)};
+    const VertexIndex v = vertex_array_add_vertex(&model->varray,
+                                                  &translated);
+    if ((v < 0) || (primitive_add_side(pp, v) < 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Adds a rectangle parallel to two of the axes. */
+static bool model_add_rect(Model * const model, const int group,
+                           const Plane plane, const Coord z,
+                           const Coord x0, const Coord y0,
+                           const Coord x1, const Coord y1)
+{
+  const Coord corners[4][2] = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+  Coord coords[4][3];
+
+  for (size_t s = 0; s < ARRAY_SIZE(corners); ++s) {
+    *vector_x(&coords[s], plane) = corners[s][0];
+    *vector_y(&coords[s], plane) = corners[s][1];
+    *vector_z(&coords[s], plane) = z;
+  }
+  return model_add_polygon(model, group, ARRAY_SIZE(coords), coords);
+}
+
+/* A wall of square tiles partly covered by smaller coplanar decals, each
+   of which overlaps several tiles. Every tile has its own vertices, so
+   many are duplicates. */
+static bool make_decals(Model * const model, const int size)
+{
+  static const Plane plane = {0, 1, 2};
+
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      if (!model_add_rect(model, 0, plane, 0, x, y, x + 1, y + 1)) {
+        return false;
+      }
+    }
+  }
+
+  /* Decal coordinates are multiples of 1/8 to keep them well apart */
+  const int ndecals = (size * size) / 4;
+  for (int d = 0; d < ndecals; ++d) {
+    const Coord x = model_rand(model, size * 8) / 8.0,
+                y = model_rand(model, size * 8) / 8.0,
+                w = (2 + model_rand(model, 10)) / 8.0,
+                h = (2 + model_rand(model, 10)) / 8.0;
+
+    if (!model_add_rect(model, 1, plane, 0, x, y, x + w, y + h)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Random rectangles and triangles, most of which are parallel to two of
+   the axes and in a few planes so that some overlap. */
+static bool make_soup(Model * const model, const int size)
+{
+  static const Plane planes[] = {{0, 1, 2}, {0, 2, 1}, {1, 2, 0}};
+
+  for (int n = 0; n < size; ++n) {
+    const int group = model_rand(model, NGROUPS);
+
+    if (model_rand(model, 4) == 0) {
+      /* Triangle in an arbitrary plane */
+      Coord coords[3][3];
+      for (size_t s = 0; s < ARRAY_SIZE(coords); ++s) {
+        for (size_t dim = 0; dim < ARRAY_SIZE(coords[s]); ++dim) {
+          coords[s][dim] = model_rand(model, 256) / 8.0;
+        }
+      }
+      if (!model_add_polygon(model, group, ARRAY_SIZE(coords), coords)) {
+        return false;
+      }
+      continue;
+    }
+
+    const Plane plane = planes[model_rand(model, ARRAY_SIZE(planes))];
+    const Coord z = model_rand(model, 16) * 2,
+                x = model_rand(model, 32), y = model_rand(model, 32),
+                w = 1 + model_rand(model, 6), h = 1 + model_rand(model, 6);
+
+    if (!model_add_rect(model, group, plane, z, x, y, x + w, y + h)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* A height field made of pairs of triangles, with heights quantised so
+   that there are large flat areas, and flat patches on some of them. */
+static bool make_terrain(Model * const model, const int size)
+{
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      Coord corners[4][3];
+      static const int offsets[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+      for (size_t c = 0; c < ARRAY_SIZE(corners); ++c) {
+        const int cx = x + offsets[c][0], cy = y + offsets[c][1];
+        corners[c][0] = cx;
+        corners[c][1] = cy;
+        corners[c][2] = floor(2.0 * sin(cx / 7.0) * cos(cy / 5.0) + 0.5);
+      }
+
+      Coord first[3][3], second[3][3];
+      for (size_t dim = 0; dim < ARRAY_SIZE(corners[0]); ++dim) {
+        first[0][dim] = corners[0][dim];
+        first[1][dim] = corners[1][dim];
+        first[2][dim] = corners[2][dim];
+        second[0][dim] = corners[0][dim];
+        second[1][dim] = corners[2][dim];
+        second[2][dim] = corners[3][dim];
+      }
+
+      if (!model_add_polygon(model, 0, ARRAY_SIZE(first), first) ||
+          !model_add_polygon(model, 0, ARRAY_SIZE(second), second)) {
+        return false;
+      }
+
+      /* Mark occasional flat cells with a patch */
+      if ((corners[0][2] == corners[1][2]) &&
+          (corners[0][2] == corners[2][2]) &&
+          (corners[0][2] == corners[3][2]) &&
+          (model_rand(model, 64) == 0)) {
+        static const Plane plane = {0, 1, 2};
+        if (!model_add_rect(model, 1, plane, corners[0][2],
+                            x + 0.25, y + 0.25, x + 1.5, y + 0.75)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static const ModelType model_types[] = {
+  {"decals", make_decals, 24},
+  {"soup", make_soup, 1000},
+  {"terrain", make_terrain, 96},
+};
+
+static bool model_init(Model * const model, const int ncopies,
+                       const double offset)
+{
+  assert(model != NULL);
+  assert(ncopies > 0);
+
+  *model = (Model){
+    .groups = malloc(sizeof(*model->groups) * ncopies * NGROUPS),
+    .ngroups = 0,
+    .copy = 0,
+    .seed = 1,
+    .offset = offset,
+  };
+  vertex_array_init(&model->varray);
+  if (model->groups == NULL) {
+    return false;
+  }
+
+  model->ngroups = ncopies * NGROUPS;
+  for (int g = 0; g < model->ngroups; ++g) {
+    group_init(&model->groups[g]);
+  }
+  return true;
+}
+
+static void model_free(Model * const model)
+{
+  assert(model != NULL);
+  for (int g = 0; g < model->ngroups; ++g) {
+    group_free(&model->groups[g]);
+  }
+  free(model->groups);
+  vertex_array_free(&model->varray);
+}
+
+static bool model_generate(Model * const model, const ModelType * const type)
+{
+  assert(model != NULL);
+  assert(type != NULL);
+
+  for (model->copy = 0; model->copy * NGROUPS < model->ngroups;
+       ++model->copy) {
+    if (!type->generate(model, type->size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static double seconds_since(const clock_t start)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Converts a model to OBJ format, recording the time taken by each stage.
+   The output is written at the current position in out. Returns false if
+   any stage failed. */
+static bool run_model(Model * const model, const int * const group_order,
+                      FILE * const out, double (* const times)[STAGE_COUNT])
+{
+  assert(model != NULL);
+  assert(group_order != NULL);
+  assert(out != NULL);
+  assert(times != NULL);
+
+  clock_t start = clock();
+  const bool found = vertex_array_find_duplicates(&model->varray, false) >= 0;
+  (*times)[STAGE_DUPLICATES] = seconds_since(start);
+
+  start = clock();
+  const bool clipped = clip_polygons(&model->varray, model->groups,
+                                     group_order, model->ngroups, false);
+  (*times)[STAGE_CLIP] = seconds_since(start);
+
+  for (int g = 0; g < model->ngroups; ++g) {
+    group_set_used(&model->groups[g], &model->varray);
+  }
+  const VertexIndex nvertices = vertex_array_renumber(&model->varray,
+                                                      false);
+
+  start = clock();
+  const bool wrote_vertices = output_vertices(out, nvertices, &model->varray,
+                                              -1);
+  (*times)[STAGE_VERTICES] = seconds_since(start);
+
+  start = clock();
+  const bool wrote_primitives = output_primitives(out, "bench", 0, nvertices,
+                                                  &model->varray,
+                                                  model->groups,
+                                                  model->ngroups, NULL, NULL,
+                                                  NULL, VertexStyle_Positive,
+                                                  MeshStyle_NoChange);
+  (*times)[STAGE_PRIMITIVES] = seconds_since(start);
+
+  return found && clipped && (nvertices >= 0) && wrote_vertices &&
+         wrote_primitives;
+}
+
+/* Reads lines from f until one is an OBJ statement of the given kind
+   (e.g. 'f' for a face), which is stored in line. Returns false at the end
+   of the file or of the current model (an 'o' statement). */
+static bool read_statement(FILE * const f, const char kind,
+                           char * const line, const int size)
+{
+  assert(f != NULL);
+  assert(line != NULL);
+  assert(size > 0);
+
+  while (fgets(line, size, f) != NULL) {
+    if ((line[0] == 'o') && (line[1] == ' ')) {
+      break;
+    }
+    if ((line[0] == kind) && (line[1] == ' ')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Finds the output of the named model in a file written using -w and
+   returns the position of the first line after its 'o' statement, or -1
+   if it isn't found. */
+static long find_model(FILE * const ref, const char * const name)
+{
+  assert(ref != NULL);
+  assert(name != NULL);
+
+  rewind(ref);
+  char line[MAX_LINE_LEN];
+  while (fgets(line, sizeof(line), ref) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    if ((line[0] == 'o') && (line[1] == ' ') && !strcmp(line + 2, name)) {
+      return ftell(ref);
+    }
+  }
+  return -1;
+}
+
+/* Compares the faces, lines and points output for a model with those in
+   a file written using -w, writing one line of results for each kind of
+   statement. Adds the number of differences to *ndiffs. */
+static bool compare_model(const ModelType * const type, const int scale,
+                          FILE * const out, FILE * const ref,
+                          long * const ndiffs)
+{
+  assert(type != NULL);
+  assert(out != NULL);
+  assert(ref != NULL);
+  assert(ndiffs != NULL);
+
+  static const struct {
+    char kind;
+    const char *name;
+  } statements[] = {{'f', "faces"}, {'l', "lines"}, {'p', "points"}};
+
+  const long start = find_model(ref, type->name);
+  if (start < 0) {
+    fprintf(stderr, "No %s model in reference file\n", type->name);
+    return false;
+  }
+
+  for (size_t k = 0; k < ARRAY_SIZE(statements); ++k) {
+    if (fseek(ref, start, SEEK_SET)) {
+      fprintf(stderr, "Failed to seek in reference file\n");
+      return false;
+    }
+    rewind(out);
+
+    char line[MAX_LINE_LEN], ref_line[MAX_LINE_LEN];
+    long count = 0, ref_count = 0, diffs = 0;
+    bool more = true, ref_more = true;
+    for (;;) {
+      more = more && read_statement(out, statements[k].kind, line,
+                                    (int)sizeof(line));
+      ref_more = ref_more && read_statement(ref, statements[k].kind,
+                                            ref_line, (int)sizeof(ref_line));
+      if (!more && !ref_more) {
+        break;
+      }
+      if (more) {
+        ++count;
+      }
+      if (ref_more) {
+        ++ref_count;
+      }
+      if (!more || !ref_more || strcmp(line, ref_line)) {
+        ++diffs;
+      }
+    }
+
+    printf("%s,%d,%s,%ld,%ld,%ld\n", type->name, scale, statements[k].name,
+           ref_count, count, diffs);
+    *ndiffs += diffs;
+  }
+  return true;
+}
+
+/* Runs a model the given number of times and writes the time taken by each
+   stage. If save is not null, the output of the first run is appended to
+   it. If ref is not null, the output of the first run is instead compared
+   with that file (and the number of differences added to *ndiffs). */
+static bool benchmark(const ModelType * const type, const int scale,
+                      const double offset, const int runs, FILE * const out,
+                      FILE * const save, FILE * const ref,
+                      long * const ndiffs)
+{
+  assert(type != NULL);
+  assert(scale > 0);
+  assert(runs > 0);
+  assert(out != NULL);
+  assert((ref == NULL) || (ndiffs != NULL));
+
+  /* Groups are plotted in the order in which they were generated */
+  int * const group_order = malloc(sizeof(*group_order) * scale * NGROUPS);
+  if (group_order == NULL) {
+    fprintf(stderr, "Failed to allocate group order\n");
+    return false;
+  }
+  for (int g = 0; g < scale * NGROUPS; ++g) {
+    group_order[g] = g;
+  }
+
+  double min[STAGE_COUNT], total[STAGE_COUNT] = {0};
+  VertexIndex nvertices = 0;
+  int nprimitives = 0;
+  bool ok = true, compared = true;
+
+  for (int r = 0; r < runs; ++r) {
+    Model model;
+    if (!model_init(&model, scale, offset) ||
+        !model_generate(&model, type)) {
+      fprintf(stderr, "Failed to generate %s model\n", type->name);
+      model_free(&model);
+      free(group_order);
+      return false;
+    }
+
+    nvertices = vertex_array_get_num_vertices(&model.varray);
+    nprimitives = 0;
+    for (int g = 0; g < model.ngroups; ++g) {
+      nprimitives += group_get_num_primitives(&model.groups[g]);
+    }
+
+    /* The output of other runs overwrites that of earlier runs, so a
+       comparison needs a file of its own */
+    FILE *run_out = out;
+    if ((r == 0) && (save != NULL)) {
+      fprintf(save, "o %s\n", type->name);
+      run_out = save;
+    } else if ((r == 0) && (ref != NULL)) {
+      run_out = tmpfile();
+      if (run_out == NULL) {
+        fprintf(stderr, "Failed to create temporary file\n");
+        model_free(&model);
+        free(group_order);
+        return false;
+      }
+    } else {
+      rewind(out);
+    }
+
+    double times[STAGE_COUNT];
+    if (!run_model(&model, group_order, run_out, &times)) {
+      ok = false;
+    }
+    model_free(&model);
+
+    if ((r == 0) && (ref != NULL)) {
+      compared = compare_model(type, scale, run_out, ref, ndiffs);
+      fclose(run_out);
+    }
+
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+      if ((r == 0) || (times[s] < min[s])) {
+        min[s] = times[s];
+      }
+      total[s] += times[s];
+    }
+  }
+
+  for (int s = 0; (ref == NULL) && (s < STAGE_COUNT); ++s) {
+    printf("%s,%d,%" PVERTEXINDEX ",%d,%s,%d,%.6f,%.6f,%s\n", type->name,
+           scale, nvertices, nprimitives, stage_names[s], runs, min[s],
+           total[s] / runs, ok ? "ok" : "failed");
+  }
+  free(group_order);
+  return compared && ((ref == NULL) || ok);
+}
+
+static bool parse_count(const char * const str, int * const n)
+{
+  char *end;
+  const long value = strtol(str, &end, 10);
+  if ((*end != '\0') || (value < 1) || (value > 1000000)) {
+    return false;
+  }
+  *n = (int)value;
+  return true;
+}
+
+static bool parse_offset(const char * const str, double * const offset)
+{
+  char *end;
+  const double value = strtod(str, &end);
+  if ((end == str) || (*end != '\0') || !isfinite(value)) {
+    return false;
+  }
+  *offset = value;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  int runs = DEFAULT_RUNS, scale = 1;
+  double offset = 0;
+  const char *only = NULL, *save_name = NULL, *ref_name = NULL;
+
+  for (int a = 1; a < argc; ++a) {
+    if ((a + 1 < argc) && !strcmp(argv[a], "-r") &&
+        parse_count(argv[a + 1], &runs)) {
+      ++a;
+    } else if ((a + 1 < argc) && !strcmp(argv[a], "-s") &&
+               parse_count(argv[a + 1], &scale)) {
+      ++a;
+    } else if ((a + 1 < argc) && !strcmp(argv[a], "-m")) {
+      only = argv[++a];
+    } else if ((a + 1 < argc) && !strcmp(argv[a], "-t") &&
+               parse_offset(argv[a + 1], &offset)) {
+      ++a;
+    } else if ((a + 1 < argc) && !strcmp(argv[a], "-w")) {
+      save_name = argv[++a];
+    } else if ((a + 1 < argc) && !strcmp(argv[a], "-c")) {
+      ref_name = argv[++a];
+    } else {
+      fprintf(stderr, "Usage: %s [-r runs] [-s scale] [-m model] "
+              "[-t offset] [-w file | -c file]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ((save_name != NULL) && (ref_name != NULL)) {
+    fprintf(stderr, "Can't both write and compare output\n");
+    return EXIT_FAILURE;
+  }
+
+  /* Only one run is needed to compare output */
+  if (ref_name != NULL) {
+    runs = 1;
+  }
+
+  const ModelType *type = NULL;
+  if (only != NULL) {
+    for (size_t t = 0; t < ARRAY_SIZE(model_types); ++t) {
+      if (!strcmp(only, model_types[t].name)) {
+        type = &model_types[t];
+      }
+    }
+    if (type == NULL) {
+      fprintf(stderr, "Unknown model %s\n", only);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* The output is discarded but it must be written somewhere real */
+  FILE * const out = tmpfile();
+  if (out == NULL) {
+    fprintf(stderr, "Failed to create temporary file\n");
+    return EXIT_FAILURE;
+  }
+
+  FILE *save = NULL, *ref = NULL;
+  if (save_name != NULL) {
+    save = fopen(save_name, "w");
+    if (save == NULL) {
+      fprintf(stderr, "Failed to open %s for writing\n", save_name);
+      fclose(out);
+      return EXIT_FAILURE;
+    }
+  }
+  if (ref_name != NULL) {
+    ref = fopen(ref_name, "r");
+    if (ref == NULL) {
+      fprintf(stderr, "Failed to open %s for reading\n", ref_name);
+      fclose(out);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (ref == NULL) {
+    printf("model,scale,vertices,primitives,stage,runs,min_seconds,"
+           "mean_seconds,status\n");
+  } else {
+    printf("model,scale,statement,reference,count,differences\n");
+  }
+
+  bool ok = true;
+  long ndiffs = 0;
+  for (size_t t = 0; ok && (t < ARRAY_SIZE(model_types)); ++t) {
+    if ((type == NULL) || (type == &model_types[t])) {
+      ok = benchmark(&model_types[t], scale, offset, runs, out, save, ref,
+                     &ndiffs);
+    }
+  }
+
+  if ((save != NULL) && fclose(save)) {
+    fprintf(stderr, "Failed to write %s\n", save_name);
+    ok = false;
+  }
+  if (ref != NULL) {
+    fclose(ref);
+  }
+  fclose(out);
+  return (ok && (ndiffs == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -23,11 +23,34 @@
                   delegated to primitive_contains (which checks a stronger
                   constraint) and primitive_clip.
                   Failure of primitive_clip is now reported in verbose mode.
+  CJB: 14-Oct-26: Enable the vertex array's spatial index whilst clipping
+                  because primitive_split searches for every intersection.
+  CJB: 14-Oct-26: Primitives are now partitioned into sets that might be
+                  coplanar before clipping, to avoid testing every pair.
+                  Added a bounding volume hierarchy for each subgroup to
+                  find primitives whose bounding boxes might overlap.
+  CJB: 14-Oct-26: Added clip_polygons_incremental, which reuses fragments
+                  of polygons in plane sets unaffected by changes.
+                  Merged groups keep the allocator of the group they replace.
+                  Use coord_abs instead of fabs for single-precision builds.
+                  Added clip_polygons_stats.
+                  Added clip_polygons_budget, which allows the limit on the
+                  number of splits to be changed, other limits to be set and
+                  clipping to be stopped instead of failing.
+                  Normals and bounding boxes are computed for each group in
+                  one pass before partitioning.
+                  Vertex numbers and counts are now of type VertexIndex.
+                  Fragments without a normal vector are compared with
+                  primitives in every plane set, as before partitioning.
  */
 
 /* ISO library header files */
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
 
 /* Local header files */
 #include "Internal/3dObjMisc.h"
@@ -38,214 +61,2773 @@
 #include "Group.h"
 #include "Clip.h"
 
-enum { MAX_SPLITS = 1024 };
+enum {
+  MAX_SPLITS = 1024,
+  LEAF_SIZE = 4, /* maximum number of slots in a leaf of a hierarchy */
+  MAX_DEPTH = 64 /* more than the depth of any hierarchy */
+};
 
+/* Special values of ClipSlot.plane */
+enum {
+  PLANE_NONE = -1, /* points and lines, which are never clipped */
+  PLANE_ANY = -2 /* polygons which have no normal vector */
+};
+
+/* Primitives are partitioned into 'plane sets' such that any two primitives
+   which primitive_coplanar might consider coplanar are in the same set.
+   Each plane set has a 'subgroup' for each group in which it has members.
+   A subgroup holds copies of those members (called 'slots') plus any polygons
+   which can't be assigned to a plane set because they have no normal vector
+   (because primitive_coplanar still compares them with other polygons).
+   Fragments of a polygon are inserted after it, therefore the fragments of
+   each slot form a contiguous run in the subgroup. */
+
+/* A node of a bounding volume hierarchy of the slots in a subgroup. The
+   bounding box of a slot includes all fragments of its primitive. */
+typedef struct {
+  Coord low[3];
+  Coord high[3];
+  int parent; /* index of the parent node, or -1 for the root */
+  int first; /* index in 'order' of the first slot, or of the second child */
+  int count; /* number of slots in a leaf, or 0 for an internal node */
+} ClipNode;
+
+typedef struct {
+  Group group;
+  int g; /* index of the real group in the array of distinct groups */
+  int nslots;
+  int *slot; /* index of each slot's primitive in the real group */
+  int *run_len; /* number of primitives descended from each slot */
+  int *run_sum; /* binary indexed tree of run lengths (nslots + 1 entries) */
+  int *order; /* slots in the order of the leaves of the hierarchy */
+  int *leaf; /* index of the leaf node containing each slot */
+  int plane; /* index of the plane set */
+  ClipNode *nodes; /* first node is the root */
+} ClipSubgroup;
+
+typedef struct {
+  int nentries;
+  int *order_pos; /* ascending positions in the group order */
+  ClipSubgroup **subgroup; /* subgroup for each position in the group order */
+} ClipPlaneSet;
+
+typedef struct {
+  int plane; /* plane set, PLANE_NONE or PLANE_ANY */
+  int subgroup; /* index of the subgroup holding this primitive, or -1 */
+  int k; /* index of this primitive's slot in the subgroup */
+} ClipSlot;
+
+/* A polygon which has a normal vector */
+typedef struct {
+  int g; /* index into the array of distinct groups */
+  int s; /* index of the primitive in its group */
+  int cell; /* index of the quantised normal vector, then its cluster */
+  int plane;
+  long long ncell[3];
+  Coord normal[3];
+  Coord dist;
+} ClipCandidate;
+
+typedef struct {
+  int ngroups; /* number of distinct groups in the group order */
+  int *group; /* group number of each distinct group */
+  int *dindex; /* index of each group number in the array of distinct groups */
+  int *first_slot; /* index in 'slots' of the first slot of each group */
+  ClipSlot *slots;
+  int nplanes;
+  ClipPlaneSet *planes;
+  int nsubgroups;
+  ClipSubgroup *subgroups;
+  int *pool; /* storage for arrays belonging to subgroups and plane sets */
+  ClipSubgroup **subgroup_pool;
+  int nlost; /* number of distinct groups with fragments without a normal */
+  bool *lost; /* whether each distinct group has fragments without a normal */
+} ClipPartition;
+
+/* Which limit of a ClipBudget was reached */
+typedef enum {
+  ClipLimit_None,
+  ClipLimit_Splits,
+  ClipLimit_Vertices,
+  ClipLimit_Time
+} ClipLimit;
+
+/* Slots found by the last search of a hierarchy and other state belonging
+   to one thread */
+typedef struct {
+  int nfound_alloc;
+  int *found;
+  ClipStats *stats; /* counts to update, or NULL */
+  const ClipBudget *budget;
+  VertexIndex nvertices; /* number of vertices before clipping */
+  long long deadline; /* clock reading at which the time limit is reached */
+  ClipLimit limit; /* limit reached, if any */
+  bool concurrent; /* whether other plane sets are clipped by other threads */
+  int nlost; /* number of fragments created without a normal vector */
+} ClipSearch;
+
+static const ClipBudget clip_default_budget = {
+  .max_splits = MAX_SPLITS,
+  .max_vertices = 0,
+  .clock = NULL,
+  .clock_context = NULL,
+  .max_time = 0,
+  .degrade = false,
+};
+
+/* Plane sets whose fragments were copied from a ClipHistory instead of
+   being clipped again */
+typedef struct {
+  int *reuse_from; /* plane set in the history for each plane set, or -1 */
+  int *reused_nsplit; /* splits copied at each position in the group order */
+  int **plane_nsplit; /* splits at each entry of each plane set */
+} ClipReuse;
+
+static int clip_find_root(int *const parent, int n)
+{
+  while (parent[n] != n) {
+    parent[n] = parent[parent[n]];
+    n = parent[n];
+  }
+  return n;
+}
+
+static int clip_compare_order(const ClipCandidate *const ca,
+                              const ClipCandidate *const cb)
+{
+  /* Keep the order of sorted candidates deterministic */
+  if (ca->g != cb->g) {
+    return ca->g < cb->g ? -1 : 1;
+  }
+  return (ca->s > cb->s) - (ca->s < cb->s);
+}
+
+static int clip_compare_ncells(long long (*const a)[3],
+                               long long (*const b)[3])
+{
+  for (size_t dim = 0; dim < ARRAY_SIZE(*a); ++dim) {
+    if ((*a)[dim] != (*b)[dim]) {
+      return (*a)[dim] < (*b)[dim] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+static int clip_compare_cells(const void *a, const void *b)
+{
+  ClipCandidate *const ca = (ClipCandidate *)a, *const cb = (ClipCandidate *)b;
+  const int cmp = clip_compare_ncells(&ca->ncell, &cb->ncell);
+  return cmp ? cmp : clip_compare_order(ca, cb);
+}
+
+static int clip_compare_dists(const void *a, const void *b)
+{
+  const ClipCandidate *const ca = a, *const cb = b;
+  if (ca->cell != cb->cell) {
+    return ca->cell < cb->cell ? -1 : 1;
+  }
+  if (ca->dist != cb->dist) {
+    return ca->dist < cb->dist ? -1 : 1;
+  }
+  return clip_compare_order(ca, cb);
+}
+
+static int clip_compare_slots(const void *a, const void *b)
+{
+  const ClipCandidate *const ca = a, *const cb = b;
+  if (ca->plane != cb->plane) {
+    return ca->plane < cb->plane ? -1 : 1;
+  }
+  return clip_compare_order(ca, cb);
+}
+
+static int clip_find_cell(ClipCandidate *const cells, const int ncells,
+                          long long (*const ncell)[3])
+{
+  /* Binary search of the distinct quantised normal vectors */
+  int low = 0, high = ncells - 1;
+  while (low <= high) {
+    const int mid = low + ((high - low) / 2);
+    const int cmp = clip_compare_ncells(&cells[mid].ncell, ncell);
+    if (cmp == 0) {
+      return mid;
+    }
+    if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  return -1;
+}
+
+static Coord (*clip_get_first_coords(const ClipCandidate *const cand,
+                                     const VertexArray *const varray,
+                                     const Group *const groups,
+                                     const int *const group))[3]
+{
+  const Primitive *const pp = group_get_primitive(&groups[group[cand->g]],
+                                                  cand->s);
+  return vertex_array_get_coords(varray, primitive_get_side(pp, 0));
+}
+
+/* Assign each candidate polygon to a plane set. Two polygons can only be
+   coplanar if their normal vectors are equal (within MAX_FLT_ERR per
+   component) and the distance between the first vertex of one and the plane
+   of the other is less than MAX_FLT_ERR. Any such pair of polygons is
+   guaranteed to be assigned to the same plane set. */
+static int clip_assign_planes(ClipCandidate *const cand, const int ncand,
+                              const VertexArray *const varray,
+                              const Group *const groups,
+                              const int *const group)
+{
+  assert(cand != NULL);
+  assert(ncand > 0);
+
+  /* Quantise the normal vectors. Equal normal vectors are always in the
+     same or adjacent cells. */
+  for (int c = 0; c < ncand; ++c) {
+    for (size_t dim = 0; dim < ARRAY_SIZE(cand[c].normal); ++dim) {
+      cand[c].ncell[dim] = (long long)floor(cand[c].normal[dim] /
+                                            (MAX_FLT_ERR * 2));
+    }
+  }
+
+  qsort(cand, ncand, sizeof(*cand), clip_compare_cells);
+
+  ClipCandidate *const cells = malloc(sizeof(*cells) * ncand);
+  int *const parent = malloc(sizeof(*parent) * ncand);
+  Coord (*const spread)[2] = malloc(sizeof(*spread) * ncand);
+  int *const ref = malloc(sizeof(*ref) * ncand);
+  if ((cells == NULL) || (parent == NULL) || (spread == NULL) ||
+      (ref == NULL)) {
+    free(ref);
+    free(spread);
+    free(parent);
+    free(cells);
+    return -1;
+  }
+
+  /* Make a list of distinct cells */
+  int ncells = 0;
+  for (int c = 0; c < ncand; ++c) {
+    if ((ncells == 0) ||
+        clip_compare_ncells(&cells[ncells - 1].ncell, &cand[c].ncell)) {
+      cells[ncells] = cand[c];
+      parent[ncells] = ncells;
+      ++ncells;
+    }
+    cand[c].cell = ncells - 1;
+  }
+
+  /* Merge adjacent cells into clusters */
+  for (int n = 0; n < ncells; ++n) {
+    long long ncell[3];
+    for (int dx = -1; dx <= 1; ++dx) {
+      ncell[0] = cells[n].ncell[0] + dx;
+      for (int dy = -1; dy <= 1; ++dy) {
+        ncell[1] = cells[n].ncell[1] + dy;
+        for (int dz = -1; dz <= 1; ++dz) {
+          ncell[2] = cells[n].ncell[2] + dz;
+          const int m = clip_find_cell(cells, ncells, &ncell);
+          if (m > n) {
+            parent[clip_find_root(parent, m)] = clip_find_root(parent, n);
+          }
+        }
+      }
+    }
+  }
+
+  for (int c = 0; c < ncand; ++c) {
+    cand[c].cell = clip_find_root(parent, cand[c].cell);
+  }
+
+  /* Measure distances from the centre of the first vertices' bounding box
+     to minimise the magnitude of the vectors used below. */
+  Coord low[3], high[3], centre[3];
+  for (int c = 0; c < ncand; ++c) {
+    Coord (*const coords)[3] = clip_get_first_coords(&cand[c], varray,
+                                                     groups, group);
+    for (size_t dim = 0; dim < ARRAY_SIZE(*coords); ++dim) {
+      if ((c == 0) || ((*coords)[dim] < low[dim])) {
+        low[dim] = (*coords)[dim];
+      }
+      if ((c == 0) || ((*coords)[dim] > high[dim])) {
+        high[dim] = (*coords)[dim];
+      }
+    }
+  }
+  for (size_t dim = 0; dim < ARRAY_SIZE(centre); ++dim) {
+    centre[dim] = (low[dim] + high[dim]) / 2;
+  }
+
+  /* Find the signed distance of each polygon's plane from the centre and
+     the spread of normal vectors and vertex positions in each cluster
+     (indexed by the root of the cluster). */
+  for (int c = 0; c < ncand; ++c) {
+    ref[c] = -1;
+  }
+
+  for (int c = 0; c < ncand; ++c) {
+    Coord offset[3];
+    vector_sub(clip_get_first_coords(&cand[c], varray, groups, group),
+               &centre, &offset);
+    cand[c].dist = vector_dot(&cand[c].normal, &offset);
+
+    const int root = cand[c].cell;
+    if (ref[root] < 0) {
+      ref[root] = c;
+      spread[root][0] = spread[root][1] = 0;
+    }
+    Coord ndiff[3];
+    vector_sub(&cand[c].normal, &cand[ref[root]].normal, &ndiff);
+    spread[root][0] = HIGHEST(spread[root][0], vector_mag(&ndiff));
+    spread[root][1] = HIGHEST(spread[root][1], vector_mag(&offset));
+  }
+
+  /* If p and q are coplanar then dot(np, vp - vq) < MAX_FLT_ERR. It follows
+     that the difference between their distances from the centre,
+     dot(np, vp - centre) - dot(nq, vq - centre), is less than
+     MAX_FLT_ERR + |np - nq| * |vq - centre|. Neighbouring distances closer
+     than that are chained together. The tolerance is doubled to allow for
+     small changes in the normal vectors of polygons as they are split. */
+  qsort(cand, ncand, sizeof(*cand), clip_compare_dists);
+
+  int nplanes = 0;
+  for (int c = 0; c < ncand; ++c) {
+    const int root = cand[c].cell;
+    const Coord tolerance = (MAX_FLT_ERR +
+                             (2 * spread[root][0] * spread[root][1])) * 2;
+
+    if ((c == 0) || (cand[c - 1].cell != root) ||
+        !((cand[c].dist - cand[c - 1].dist) < tolerance)) {
+      ++nplanes;
+    }
+    cand[c].plane = nplanes - 1;
+  }
+
+  free(ref);
+  free(spread);
+  free(parent);
+  free(cells);
+
+  return nplanes;
+}
+
+static void clip_free_partition(ClipPartition *const part)
+{
+  assert(part != NULL);
+  for (int n = 0; n < part->nsubgroups; ++n) {
+    group_free(&part->subgroups[n].group);
+    free(part->subgroups[n].nodes);
+  }
+  free(part->subgroups);
+  free(part->subgroup_pool);
+  free(part->pool);
+  free(part->planes);
+  free(part->slots);
+  free(part->first_slot);
+  free(part->dindex);
+  free(part->group);
+  free(part->lost);
+}
+
+static ClipSlot *clip_get_slot(const ClipPartition *const part,
+                               const int g, const int s)
+{
+  assert(part != NULL);
+  assert(g >= 0);
+  assert(g < part->ngroups);
+  assert(s >= 0);
+  assert(s < part->first_slot[g + 1] - part->first_slot[g]);
+  return &part->slots[part->first_slot[g] + s];
+}
+
+static int clip_get_num_slots(const ClipPartition *const part, const int g)
+{
+  assert(part != NULL);
+  assert(g >= 0);
+  assert(g < part->ngroups);
+  return part->first_slot[g + 1] - part->first_slot[g];
+}
+
+static void clip_add_run_len(ClipSubgroup *const sg, const int k,
+                             const int delta)
+{
+  assert(sg != NULL);
+  assert(k >= 0);
+  assert(k < sg->nslots);
+
+  sg->run_len[k] += delta;
+  assert(sg->run_len[k] >= 0);
+
+  for (int i = k + 1; i <= sg->nslots; i += i & -i) {
+    sg->run_sum[i] += delta;
+  }
+}
+
+/* Get the index of the first primitive descended from slot k. */
+static int clip_get_run_pos(const ClipSubgroup *const sg, const int k)
+{
+  assert(sg != NULL);
+  assert(k >= 0);
+  assert(k < sg->nslots);
+
+  int pos = 0;
+  for (int i = k; i > 0; i -= i & -i) {
+    pos += sg->run_sum[i];
+  }
+  return pos;
+}
+
+static Coord clip_get_centre(Coord (*const box)[2][3], const int k,
+                             const int dim)
+{
+  return box[k][0][dim] + box[k][1][dim];
+}
+
+static int clip_build_node(ClipSubgroup *const sg, Coord (*const box)[2][3],
+                           int *const nnodes, const int parent,
+                           const int first, const int count)
+{
+  assert(sg != NULL);
+  assert(count > 0);
+
+  const int n = (*nnodes)++;
+  ClipNode *const node = &sg->nodes[n];
+  node->parent = parent;
+
+  for (int i = first; i < first + count; ++i) {
+    const int k = sg->order[i];
+    for (size_t dim = 0; dim < ARRAY_SIZE(node->low); ++dim) {
+      if ((i == first) || (box[k][0][dim] < node->low[dim])) {
+        node->low[dim] = box[k][0][dim];
+      }
+      if ((i == first) || (box[k][1][dim] > node->high[dim])) {
+        node->high[dim] = box[k][1][dim];
+      }
+    }
+  }
+
+  if (count <= LEAF_SIZE) {
+    node->first = first;
+    node->count = count;
+    for (int i = first; i < first + count; ++i) {
+      sg->leaf[sg->order[i]] = n;
+    }
+    return n;
+  }
+
+  /* Split the slots at the median of their centres in the dimension in
+     which the node is largest. */
+  size_t axis = 0;
+  for (size_t dim = 1; dim < ARRAY_SIZE(node->low); ++dim) {
+    if (node->high[dim] - node->low[dim] >
+        node->high[axis] - node->low[axis]) {
+      axis = dim;
+    }
+  }
+
+  const int mid = first + (count / 2);
+  for (int low = first, high = first + count - 1; low < high; ) {
+    const int pivot_k = sg->order[low + ((high - low) / 2)];
+    const Coord pivot = clip_get_centre(box, pivot_k, axis);
+    int i = low, j = high;
+    while (i <= j) {
+      while (clip_get_centre(box, sg->order[i], axis) < pivot) {
+        ++i;
+      }
+      while (clip_get_centre(box, sg->order[j], axis) > pivot) {
+        --j;
+      }
+      if (i <= j) {
+        const int tmp = sg->order[i];
+        sg->order[i++] = sg->order[j];
+        sg->order[j--] = tmp;
+      }
+    }
+    if (mid <= j) {
+      high = j;
+    } else if (mid >= i) {
+      low = i;
+    } else {
+      break;
+    }
+  }
+
+  node->count = 0;
+  clip_build_node(sg, box, nnodes, n, first, mid - first);
+  /* 'node' may not be used here because it was only a shorthand */
+  sg->nodes[n].first = clip_build_node(sg, box, nnodes, n, mid,
+                                       first + count - mid);
+  return n;
+}
+
+static bool clip_make_tree(ClipSubgroup *const sg,
+                           const VertexArray *const varray)
+{
+  assert(sg != NULL);
+  assert(sg->nslots > 0);
+
+  Coord (*const box)[2][3] = malloc(sizeof(*box) * sg->nslots);
+  sg->nodes = malloc(sizeof(*sg->nodes) * sg->nslots * 2);
+  if ((box == NULL) || (sg->nodes == NULL)) {
+    free(box);
+    return false;
+  }
+
+  for (int k = 0; k < sg->nslots; ++k) {
+    Primitive *const pp = group_get_primitive(&sg->group, k);
+    if (!primitive_get_bbox(pp, varray, &box[k][0], &box[k][1])) {
+      assert("Polygon has no bounding box" == NULL);
+    }
+    sg->order[k] = k;
+    sg->run_sum[k + 1] = (k + 1) & -(k + 1);
+  }
+  sg->run_sum[0] = 0;
+
+  int nnodes = 0;
+  clip_build_node(sg, box, &nnodes, -1, 0, sg->nslots);
+  assert(nnodes <= sg->nslots * 2);
+
+  free(box);
+  return true;
+}
+
+/* Enlarge the bounding box of slot k to include a primitive. */
+static void clip_grow_slot(ClipSubgroup *const sg, const int k,
+                           Primitive *const pp,
+                           const VertexArray *const varray)
+{
+  assert(sg != NULL);
+  assert(k >= 0);
+  assert(k < sg->nslots);
+
+  Coord low[3], high[3];
+  if (!primitive_get_bbox(pp, varray, &low, &high)) {
+    return;
+  }
+
+  for (int n = sg->leaf[k]; n >= 0; n = sg->nodes[n].parent) {
+    ClipNode *const node = &sg->nodes[n];
+    bool grown = false;
+    for (size_t dim = 0; dim < ARRAY_SIZE(low); ++dim) {
+      if (low[dim] < node->low[dim]) {
+        node->low[dim] = low[dim];
+        grown = true;
+      }
+      if (high[dim] > node->high[dim]) {
+        node->high[dim] = high[dim];
+        grown = true;
+      }
+    }
+    if (!grown) {
+      break;
+    }
+  }
+}
+
+static bool clip_overlaps(const ClipNode *const node,
+                          Coord (*const low)[3], Coord (*const high)[3],
+                          const Plane plane)
+{
+  return (node->low[plane.x] < (*high)[plane.x]) &&
+         (node->high[plane.x] > (*low)[plane.x]) &&
+         (node->low[plane.y] < (*high)[plane.y]) &&
+         (node->high[plane.y] > (*low)[plane.y]);
+}
+
+static int clip_compare_ints(const void *a, const void *b)
+{
+  const int ia = *(const int *)a, ib = *(const int *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+/* Find slots (from slot 'first' onwards) of a subgroup which might contain
+   a primitive whose bounding box overlaps the given box, when projected
+   onto the given plane. Returns the number of slots found (in ascending
+   order), or -1 if memory allocation failed. */
+static int clip_find_slots(ClipSearch *const search,
+                           const ClipSubgroup *const sg, const int first,
+                           Coord (*const low)[3], Coord (*const high)[3],
+                           const Plane plane)
+{
+  assert(search != NULL);
+  assert(sg != NULL);
+  assert(first >= 0);
+
+  int nfound = 0;
+  if (first >= sg->nslots) {
+    return nfound;
+  }
+
+  int stack[MAX_DEPTH], depth = 0;
+  stack[depth++] = 0;
+
+  while (depth > 0) {
+    const ClipNode *const node = &sg->nodes[stack[--depth]];
+    if (!clip_overlaps(node, low, high, plane)) {
+      continue;
+    }
+
+    if (node->count == 0) {
+      assert(depth + 2 <= MAX_DEPTH);
+      stack[depth++] = node->first;
+      stack[depth++] = (int)(node - sg->nodes) + 1;
+      continue;
+    }
+
+    if (nfound + node->count > search->nfound_alloc) {
+      const int new_nalloc = HIGHEST(nfound + node->count,
+                                     search->nfound_alloc * 2);
+      int *const new_found = realloc(search->found,
+                                     sizeof(*new_found) * new_nalloc);
+      if (new_found == NULL) {
+        return -1;
+      }
+      search->found = new_found;
+      search->nfound_alloc = new_nalloc;
+    }
+
+    for (int i = node->first; i < node->first + node->count; ++i) {
+      if (sg->order[i] >= first) {
+        search->found[nfound++] = sg->order[i];
+      }
+    }
+  }
+
+  /* Primitives must be compared in the same order as in the subgroup.
+     search->found may be null if nothing was found. */
+  if (nfound > 1) {
+    qsort(search->found, (size_t)nfound, sizeof(*search->found),
+          clip_compare_ints);
+  }
+  return nfound;
+}
+
+/* Estimate the number of pairs of primitives that must be compared, given
+   the number of primitives at each position in the group order. */
+static long long clip_count_pairs(const int *const group_order,
+                                  const int *const order_pos,
+                                  const int *const count, const int n)
+{
+  long long npairs = 0;
+  for (int b = 0; b < n; ++b) {
+    const int bg = group_order[order_pos ? order_pos[b] : b];
+    npairs += ((long long)count[b] * (count[b] - 1)) / 2;
+    for (int f = b + 1; f < n; ++f) {
+      if (group_order[order_pos ? order_pos[f] : f] != bg) {
+        npairs += (long long)count[b] * count[f];
+      }
+    }
+  }
+  return npairs;
+}
+
+static bool clip_make_subgroups(ClipPartition *const part,
+                                const VertexArray *const varray,
+                                const Group *const groups,
+                                const int *const group_order,
+                                const int group_order_len,
+                                const ClipCandidate *const cand,
+                                const int ncand,
+                                const int *const nany_in,
+                                const bool verbose)
+{
+  assert(part != NULL);
+
+  /* Count the subgroups and the storage they need */
+  long long nsubgroups = 0, npool = 0, nentries = 0;
+  for (int c = 0, p = 0; p < part->nplanes; ++p) {
+    for (int g = 0; g < part->ngroups; ++g) {
+      int nmembers = nany_in[g];
+      for (; (c < ncand) && (cand[c].plane == p) && (cand[c].g == g); ++c) {
+        ++nmembers;
+      }
+      if (nmembers > 0) {
+        ++nsubgroups;
+        npool += (nmembers * 5LL) + 1;
+      }
+    }
+  }
+
+  for (int pos = 0; pos < group_order_len; ++pos) {
+    /* Every plane set has a subgroup for groups with polygons that have
+       no normal vector. */
+    const int g = part->dindex[group_order[pos]];
+    if (nany_in[g] > 0) {
+      nentries += part->nplanes;
+    }
+  }
+
+  for (int c = 0; c < ncand; ++c) {
+    if ((c == 0) || (cand[c - 1].plane != cand[c].plane) ||
+        (cand[c - 1].g != cand[c].g)) {
+      if (nany_in[cand[c].g] == 0) {
+        for (int pos = 0; pos < group_order_len; ++pos) {
+          if (part->dindex[group_order[pos]] == cand[c].g) {
+            ++nentries;
+          }
+        }
+      }
+    }
+  }
+  npool += nentries;
+
+  if ((nsubgroups > INT_MAX) || (npool > INT_MAX) || (nentries > INT_MAX)) {
+    return false;
+  }
+
+  part->subgroups = malloc(sizeof(*part->subgroups) *
+                           (nsubgroups ? nsubgroups : 1));
+  part->pool = malloc(sizeof(*part->pool) * (npool ? npool : 1));
+  part->subgroup_pool = malloc(sizeof(*part->subgroup_pool) *
+                               (nentries ? nentries : 1));
+  int *const count = malloc(sizeof(*count) *
+                            (group_order_len ? group_order_len : 1));
+
+  if ((part->subgroups == NULL) || (part->pool == NULL) ||
+      (part->subgroup_pool == NULL) || (count == NULL)) {
+    free(count);
+    return false;
+  }
+
+  int *pool = part->pool;
+  ClipSubgroup **subgroup_pool = part->subgroup_pool;
+  long long npairs = 0;
+
+  for (int c = 0, p = 0; p < part->nplanes; ++p) {
+    const int first_subgroup = part->nsubgroups;
+
+    for (int g = 0; g < part->ngroups; ++g) {
+      int const first_c = c;
+      for (; (c < ncand) && (cand[c].plane == p) && (cand[c].g == g); ++c) {
+      }
+
+      const int nmembers = (c - first_c) + nany_in[g];
+      if (nmembers == 0) {
+        continue;
+      }
+
+      const int n = part->nsubgroups++;
+      ClipSubgroup *const sg = &part->subgroups[n];
+      *sg = (ClipSubgroup){
+        .g = g,
+        .nslots = nmembers,
+        .slot = pool,
+        .run_len = pool + nmembers,
+        .run_sum = pool + (nmembers * 2),
+        .order = pool + (nmembers * 3) + 1,
+        .leaf = pool + (nmembers * 4) + 1,
+        .plane = p,
+        .nodes = NULL,
+      };
+      pool += (nmembers * 5) + 1;
+      group_init(&sg->group);
+
+      /* Merge the polygons in this plane set with those that have no
+         normal vector, in their original order. */
+      const Group *const group = &groups[part->group[g]];
+      const int nslots = clip_get_num_slots(part, g);
+      for (int s = 0, k = 0, m = first_c; s < nslots; ++s) {
+        ClipSlot *const slot = clip_get_slot(part, g, s);
+        if ((m < c) && (cand[m].s == s)) {
+          ++m;
+          slot->subgroup = n;
+          slot->k = k;
+        } else if (slot->plane != PLANE_ANY) {
+          continue;
+        }
+
+        Primitive *const copy = group_add_primitive(&sg->group);
+        if (copy == NULL) {
+          free(count);
+          return false;
+        }
+        *copy = *group_get_primitive(group, s);
+        sg->slot[k] = s;
+        sg->run_len[k++] = 1;
+      }
+
+      if (!clip_make_tree(sg, varray)) {
+        free(count);
+        return false;
+      }
+    }
+
+    /* List the positions in the group order at which this plane set has
+       members, in ascending order. */
+    ClipPlaneSet *const plane = &part->planes[p];
+    *plane = (ClipPlaneSet){
+      .nentries = 0,
+      .order_pos = pool,
+      .subgroup = subgroup_pool,
+    };
+
+    for (int pos = 0; pos < group_order_len; ++pos) {
+      const int g = part->dindex[group_order[pos]];
+      for (int n = first_subgroup; n < part->nsubgroups; ++n) {
+        if (part->subgroups[n].g == g) {
+          plane->order_pos[plane->nentries] = pos;
+          plane->subgroup[plane->nentries] = &part->subgroups[n];
+          count[plane->nentries++] = part->subgroups[n].nslots;
+          break;
+        }
+      }
+    }
+    pool += plane->nentries;
+    subgroup_pool += plane->nentries;
+
+    if (verbose) {
+      npairs += clip_count_pairs(group_order, plane->order_pos, count,
+                                 plane->nentries);
+    }
+  }
+
+  if (verbose) {
+    for (int pos = 0; pos < group_order_len; ++pos) {
+      count[pos] = group_get_num_primitives(&groups[group_order[pos]]);
+    }
+    const long long nall = clip_count_pairs(group_order, NULL, count,
+                                            group_order_len);
+
+    printf("Partitioned %d polygons into %d planes "
+           "(%lld of %lld pairs of primitives pruned)\n",
+           ncand, part->nplanes, nall - npairs, nall);
+  }
+
+  free(count);
+  return true;
+}
+
+static bool clip_make_partition(ClipPartition *const part,
+                                const VertexArray *const varray,
+                                const Group *const groups,
+                                const int *const group_order,
+                                const int group_order_len,
+                                const bool verbose)
+{
+  assert(part != NULL);
+  assert(group_order_len > 0);
+
+  *part = (ClipPartition){
+    .ngroups = 0,
+    .group = NULL,
+    .dindex = NULL,
+    .first_slot = NULL,
+    .slots = NULL,
+    .nplanes = 0,
+    .planes = NULL,
+    .nsubgroups = 0,
+    .subgroups = NULL,
+    .pool = NULL,
+    .subgroup_pool = NULL,
+    .nlost = 0,
+    .lost = NULL,
+  };
+
+  /* Find the distinct groups in the group order */
+  int max_group = 0;
+  for (int pos = 0; pos < group_order_len; ++pos) {
+    assert(group_order[pos] >= 0);
+    max_group = HIGHEST(max_group, group_order[pos]);
+  }
+
+  part->dindex = malloc(sizeof(*part->dindex) * (max_group + 1));
+  part->group = malloc(sizeof(*part->group) * (max_group + 1));
+  part->first_slot = malloc(sizeof(*part->first_slot) * (max_group + 2));
+  if ((part->dindex == NULL) || (part->group == NULL) ||
+      (part->first_slot == NULL)) {
+    return false;
+  }
+
+  for (int g = 0; g <= max_group; ++g) {
+    part->dindex[g] = -1;
+  }
+
+  long long nslots = 0;
+  for (int pos = 0; pos < group_order_len; ++pos) {
+    const int g = group_order[pos];
+    if (part->dindex[g] < 0) {
+      part->dindex[g] = part->ngroups;
+      part->group[part->ngroups] = g;
+      part->first_slot[part->ngroups++] = nslots;
+      nslots += group_get_num_primitives(&groups[g]);
+    }
+  }
+  part->first_slot[part->ngroups] = nslots;
+
+  if (nslots > INT_MAX) {
+    return false;
+  }
+
+  /* Classify each primitive */
+  part->slots = malloc(sizeof(*part->slots) * (nslots ? nslots : 1));
+  part->lost = calloc(part->ngroups, sizeof(*part->lost));
+  ClipCandidate *const cand = malloc(sizeof(*cand) * (nslots ? nslots : 1));
+  int *const nany_in = calloc(part->ngroups, sizeof(*nany_in));
+  if ((part->slots == NULL) || (part->lost == NULL) || (cand == NULL) ||
+      (nany_in == NULL)) {
+    free(nany_in);
+    free(cand);
+    return false;
+  }
+
+  /* Computing every primitive's normal and bounding box in one pass means
+     the copies in subgroups have them too. */
+  for (int g = 0; g < part->ngroups; ++g) {
+    group_precompute_geometry(&groups[part->group[g]], varray);
+  }
+
+  int ncand = 0;
+  for (int g = 0; g < part->ngroups; ++g) {
+    const Group *const group = &groups[part->group[g]];
+    const int nprimitives = group_get_num_primitives(group);
+    for (int s = 0; s < nprimitives; ++s) {
+      Primitive *const pp = group_get_primitive(group, s);
+      ClipSlot *const slot = clip_get_slot(part, g, s);
+      *slot = (ClipSlot){.plane = PLANE_NONE, .subgroup = -1, .k = -1};
+
+      if (primitive_get_num_sides(pp) >= 3) {
+        if (primitive_get_normal(pp, varray, &cand[ncand].normal)) {
+          cand[ncand].g = g;
+          cand[ncand].s = s;
+          ++ncand;
+        } else {
+          slot->plane = PLANE_ANY;
+          ++nany_in[g];
+        }
+      }
+    }
+  }
+
+  bool success = true;
+  if (ncand > 0) {
+    part->nplanes = clip_assign_planes(cand, ncand, varray, groups,
+                                       part->group);
+    if (part->nplanes < 0) {
+      part->nplanes = 0;
+      success = false;
+    }
+  }
+
+  if (success) {
+    for (int c = 0; c < ncand; ++c) {
+      clip_get_slot(part, cand[c].g, cand[c].s)->plane = cand[c].plane;
+    }
+
+    /* Sort the candidates by plane set, then group, then slot so that
+       each run is the content of one subgroup. */
+    qsort(cand, ncand, sizeof(*cand), clip_compare_slots);
+
+    part->planes = malloc(sizeof(*part->planes) *
+                          (part->nplanes ? part->nplanes : 1));
+    success = (part->planes != NULL) &&
+              clip_make_subgroups(part, varray, groups, group_order,
+                                  group_order_len, cand, ncand, nany_in,
+                                  verbose);
+  }
+
+  free(nany_in);
+  free(cand);
+  return success;
+}
+
+/* Find the first of a plane set's entries for a position in the group order
+   greater than the one given. */
+static int clip_find_entry(const ClipPlaneSet *const plane, const int pos)
+{
+  assert(plane != NULL);
+  int low = 0, high = plane->nentries;
+  while (low < high) {
+    const int mid = low + ((high - low) / 2);
+    if (plane->order_pos[mid] <= pos) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static void clip_search_init(ClipSearch * const search,
+                             ClipStats * const stats,
+                             const ClipBudget * const budget,
+                             const VertexArray * const varray)
+{
+  assert(search != NULL);
+  assert(budget != NULL);
+
+  *search = (ClipSearch){
+    .nfound_alloc = 0,
+    .found = NULL,
+    .stats = stats,
+    .budget = budget,
+    .nvertices = vertex_array_get_num_vertices(varray),
+    .deadline = 0,
+    .limit = ClipLimit_None,
+    .concurrent = false,
+    .nlost = 0,
+  };
+
+  if ((budget->clock != NULL) && (budget->max_time > 0)) {
+    search->deadline = budget->clock(budget->clock_context) +
+                       budget->max_time;
+  }
+}
+
+/* Returns true if clipping must stop because the given number of splits
+   in the current back group, the number of vertices added or the time
+   taken has reached the limit in the budget. */
+static bool clip_over_budget(ClipSearch * const search,
+                             const VertexArray * const varray,
+                             const int nsplit, const bool verbose)
+{
+  assert(search != NULL);
+  const ClipBudget *const budget = search->budget;
+  assert(budget != NULL);
+
+  if ((budget->max_splits > 0) && (nsplit >= budget->max_splits)) {
+    if (verbose) {
+      printf("Aborted polygon clipping after %d splits\n", nsplit);
+    }
+    search->limit = ClipLimit_Splits;
+    return true;
+  }
+
+  const VertexIndex nadded = vertex_array_get_num_vertices(varray) -
+                             search->nvertices;
+  if ((budget->max_vertices > 0) && (nadded >= budget->max_vertices)) {
+    if (verbose) {
+      printf("Aborted polygon clipping after adding %"PVERTEXINDEX
+             " vertices\n", nadded);
+    }
+    search->limit = ClipLimit_Vertices;
+    return true;
+  }
+
+  if ((budget->clock != NULL) && (budget->max_time > 0) &&
+      (budget->clock(budget->clock_context) >= search->deadline)) {
+    if (verbose) {
+      printf("Aborted polygon clipping after time limit\n");
+    }
+    search->limit = ClipLimit_Time;
+    return true;
+  }
+
+  return false;
+}
+
+/* Returns true if a fragment of a polygon no longer has a normal vector,
+   for example because clipping made its first three vertices collinear. */
+static bool clip_lost_normal(const ClipSubgroup * const sg, const int back,
+                             const VertexArray * const varray)
+{
+  assert(sg != NULL);
+  Coord normal[3];
+  return !primitive_get_normal(group_get_primitive(&sg->group, back),
+                               varray, &normal);
+}
+
+static bool clip_primitive_vs_primitive(VertexArray * const varray,
+                                        ClipSearch * const search,
+                                        ClipSubgroup * const back_sg,
+                                        const int bg, const int k,
+                                        int const back, const Plane plane,
+                                        Group * const front_group,
+                                        const int fg, int *const front,
+                                        int *const nsplit, bool *const del,
+                                        const bool verbose)
+{
+  assert(search != NULL);
+  assert(back_sg != NULL);
+  assert(front_group != NULL);
+  assert(fg >= 0);
+  assert(bg >= 0);
+  assert(back >= 0);
+  assert(front != NULL);
+  assert(*front >= 0);
+  assert(nsplit != NULL);
+  assert(del != NULL);
+  assert(!*del);
+
+  ClipStats *const stats = search->stats;
+  Group * const back_group = &back_sg->group;
+  Primitive *backp = group_get_primitive(back_group, back);
+
+  DEBUGF("Front primitive is %d in group %d\n", *front, fg);
+  Primitive *frontp = group_get_primitive(front_group, *front);
+
+  if (stats != NULL) {
+    ++stats->npairs;
+  }
+
+  if (primitive_get_num_sides(frontp) < 3) {
+    DEBUGF("Can't clip against point or line\n");
+    return true;
+  }
+
+  if (!primitive_coplanar(frontp, backp, varray)) {
+    if (stats != NULL) {
+      ++stats->nnot_coplanar;
+    }
+    return true;
+  }
+
+  bool split = false, covered = false;
+  do {
+    assert(!covered);
+    if (primitive_equal(frontp, backp)) {
+      covered = true;
+      break;
+    }
+
+    if (primitive_contains(frontp, backp, varray, plane)) {
+      /* The back polygon is completely covered by the front polygon */
+      if (stats != NULL) {
+        ++stats->ncontained;
+      }
+      covered = true;
+      break;
+    }
+
+    split = false;
+
+    Primitive newbackp;
+    if (!primitive_clip_stats(backp, frontp, varray, plane, &newbackp, &split,
+                              stats != NULL ? &stats->clip : NULL)) {
+      if (verbose) {
+        printf("Clipping failed (too many sides?)\n");
+      }
+      return false;
+    }
+    if (split) {
+      assert(primitive_coplanar(frontp, backp, varray));
+      assert(primitive_coplanar(&newbackp, backp, varray));
+      Primitive * const r = group_insert_primitive(back_group, back + 1);
+      if (r == NULL) {
+        if (verbose) {
+          printf("Clipping failed (out of memory)\n");
+        }
+        return false;
+      }
+      *r = newbackp;
+      clip_add_run_len(back_sg, k, 1);
+      if (stats != NULL) {
+        ++stats->nsplits;
+      }
+      ++*nsplit;
+
+      /* A new polygon will have been inserted after the back polygon.
+         If we are clipping against other primitives in the same group
+         then that means the index of all following primitives (including
+         the front polygon) increased by one. */
+      if (front_group == back_group) {
+        frontp = group_get_primitive(front_group, ++*front);
+      }
+
+      /* In any case, the back group's primitive data may have moved. */
+      backp = group_get_primitive(back_group, back);
+
+      /* Vertices at the points of intersection might not be exactly
+         within the original bounding box of the slot. */
+      clip_grow_slot(back_sg, k, backp, varray);
+      clip_grow_slot(back_sg, k, group_get_primitive(back_group, back + 1),
+                     varray);
+
+      if (verbose) {
+        printf("Split polygon %d in group %d behind %d in group %d:\n",
+               primitive_get_id(backp), bg, primitive_get_id(frontp), fg);
+        primitive_print(backp, varray);
+        puts("\n and");
+        primitive_print(group_get_primitive(back_group, back + 1), varray);
+        puts("");
+      }
+
+      /* Fragments without a normal vector might be in front of polygons
+         in other plane sets later. */
+      if (clip_lost_normal(back_sg, back, varray) ||
+          clip_lost_normal(back_sg, back + 1, varray)) {
+        ++search->nlost;
+      }
+
+      /* Both fragments are valid, so it's safe to stop here. */
+      if (clip_over_budget(search, varray, *nsplit, verbose)) {
+        return false;
+      }
+    } else {
+      DEBUGF("No split\n");
+    }
+  } while (split);
+
+  if (covered) {
+    /* Report deletion of the back polygon here so that we know what
+       caused it */
+    if (verbose) {
+      printf("Deleting polygon %d in group %d behind %d in group %d:\n",
+             primitive_get_id(backp), bg, primitive_get_id(frontp), fg);
+      primitive_print(backp, varray);
+      puts("");
+    }
+    group_delete_primitive(back_group, back);
+    clip_add_run_len(back_sg, k, -1);
+    *del = true;
+    if (stats != NULL) {
+      ++stats->ndeleted;
+    }
+  }
+
+  return true;
+}
+
+/* Find the slot of a subgroup which holds the copy of a polygon without
+   a normal vector, given its index in the real group. */
+static int clip_find_copy(const ClipSubgroup * const sg, const int s)
+{
+  assert(sg != NULL);
+  int low = 0, high = sg->nslots;
+  while (low < high) {
+    const int mid = low + ((high - low) / 2);
+    if (sg->slot[mid] < s) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  assert(low < sg->nslots);
+  assert(sg->slot[low] == s);
+  return low;
+}
+
+/* primitive_coplanar only tests whether the vertices of a polygon without
+   a normal vector are in the plane of the other polygon, so fragments
+   which lose their normal vector can be coplanar with polygons in any plane
+   set (e.g. those facing the opposite way). Clip a polygon against the
+   primitives of a group from slot s onwards, in the same order as if they
+   hadn't been partitioned. Primitives in slot s up to the given front
+   primitive are skipped, unless it is -1. */
+static bool clip_remaining(VertexArray * const varray,
+                           ClipSearch * const search,
+                           ClipPartition * const part,
+                           const int *const group_order, const int bpos,
+                           ClipSubgroup * const back_sg, const int k,
+                           int const back, const Plane plane,
+                           const int fpos, const int s, const int front,
+                           int *const nsplit, bool *const del,
+                           const bool verbose)
+{
+  assert(search != NULL);
+  assert(part != NULL);
+  assert(group_order != NULL);
+  assert(back_sg != NULL);
+  assert(del != NULL);
+
+  /* Other plane sets might be being modified by other threads */
+  if (search->concurrent) {
+    DEBUGF("Can't clip a polygon without a normal concurrently\n");
+    return false;
+  }
+
+  const ClipPlaneSet *const plane_set = &part->planes[back_sg->plane];
+  const int bg = group_order[bpos], fg = group_order[fpos];
+  const int g = part->dindex[fg];
+  const int nslots = clip_get_num_slots(part, g);
+
+  for (int t = s; !*del && (t < nslots); ++t) {
+    const ClipSlot *const slot = clip_get_slot(part, g, t);
+    ClipSubgroup *front_sg;
+    int kf;
+    if (slot->subgroup >= 0) {
+      front_sg = &part->subgroups[slot->subgroup];
+      kf = slot->k;
+    } else if (slot->plane == PLANE_ANY) {
+      /* Every plane set has an unmodified copy of this polygon */
+      const int e = clip_find_entry(plane_set, fpos) - 1;
+      assert(e >= 0);
+      assert(plane_set->order_pos[e] == fpos);
+      front_sg = plane_set->subgroup[e];
+      kf = clip_find_copy(front_sg, t);
+    } else {
+      DEBUGF("Can't clip against point or line\n");
+      continue;
+    }
+
+    /* Insertions before the front slot change the index of its first
+       primitive. */
+    int f = ((t == s) && (front >= 0)) ?
+            front + 1 : clip_get_run_pos(front_sg, kf);
+    for (; !*del &&
+           (f < clip_get_run_pos(front_sg, kf) + front_sg->run_len[kf]);
+         ++f) {
+      if (!clip_primitive_vs_primitive(varray, search, back_sg, bg, k, back,
+                                       plane, &front_sg->group, fg, &f,
+                                       nsplit, del, verbose)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Clip a polygon against the primitives of a front group which are in its
+   plane set (front_sg, which may be NULL if there are none). All of them
+   are examined instead if the back polygon loses its normal vector or the
+   front group has fragments without one. */
 static bool clip_group_vs_group(VertexArray * const varray,
-                                Group * const groups,
-                                const int bg, int const back,
-                                const int fg, int front,
+                                ClipSearch * const search,
+                                ClipPartition * const part,
+                                const int *const group_order, const int bpos,
+                                ClipSubgroup * const back_sg,
+                                const int k, int const back,
+                                const int fpos, ClipSubgroup * const front_sg,
                                 int *const nsplit, bool *const del,
                                 const bool verbose)
 {
-  assert(groups != NULL);
-  assert(fg >= 0);
-  assert(bg >= 0);
-  assert(front >= 0);
-  assert(nsplit != NULL);
+  assert(search != NULL);
+  assert(part != NULL);
+  assert(group_order != NULL);
+  assert(back_sg != NULL);
   assert(del != NULL);
-  assert(!*del);
 
-  Group * const back_group = groups + bg;
-  DEBUGF("Back primitive is %d in group %d\n", back, bg);
-  assert(back >= 0);
-  Primitive *backp = group_get_primitive(back_group, back);
+  const int bg = group_order[bpos], fg = group_order[fpos];
+  DEBUGF("Back primitive is %d in group %d\n", back, bg);
+  assert(back >= 0);
+  Primitive *const backp = group_get_primitive(&back_sg->group, back);
+
+  /* Find the two-dimensional plane in which to clip the two primitives
+     (returns false if the back primitive is a point or line). */
+  Plane plane;
+  if (!primitive_find_plane(backp, varray, &plane)) {
+    return true;
+  }
+
+  if (part->lost[part->dindex[fg]]) {
+    return (fpos == bpos) ?
+           clip_remaining(varray, search, part, group_order, bpos, back_sg,
+                          k, back, plane, fpos, back_sg->slot[k], back,
+                          nsplit, del, verbose) :
+           clip_remaining(varray, search, part, group_order, bpos, back_sg,
+                          k, back, plane, fpos, 0, -1, nsplit, del,
+                          verbose);
+  }
+  assert(front_sg != NULL);
+
+  /* Polygons with bounding boxes that don't overlap (or nearly) when
+     projected onto the same plane can't clip each other. Fragments of the
+     back polygon are within its bounding box, so the search doesn't need
+     to be repeated after splitting it. */
+  Coord low[3], high[3];
+  if (!primitive_get_bbox(backp, varray, &low, &high)) {
+    assert("Polygon has no bounding box" == NULL);
+    return true;
+  }
+  for (size_t dim = 0; dim < ARRAY_SIZE(low); ++dim) {
+    low[dim] -= MAX_FLT_ERR * 2;
+    high[dim] += MAX_FLT_ERR * 2;
+  }
+
+  int first = 0;
+  if (front_sg == back_sg) {
+    /* Start with fragments of the back polygon, then later slots. */
+    const int start = clip_get_run_pos(back_sg, k);
+    for (int front = back + 1;
+         !*del && (front < start + back_sg->run_len[k]);
+         ++front) {
+      if (!clip_primitive_vs_primitive(varray, search, back_sg, bg, k, back,
+                                       plane, &front_sg->group, fg, &front,
+                                       nsplit, del, verbose)) {
+        return false;
+      }
+      if (!*del && clip_lost_normal(back_sg, back, varray)) {
+        return clip_remaining(varray, search, part, group_order, bpos,
+                              back_sg, k, back, plane, fpos,
+                              back_sg->slot[k], front, nsplit, del,
+                              verbose);
+      }
+    }
+    first = k + 1;
+  }
+
+  const int nfound = *del ? 0 : clip_find_slots(search, front_sg, first,
+                                                &low, &high, plane);
+  if (nfound < 0) {
+    if (verbose) {
+      printf("Clipping failed (out of memory)\n");
+    }
+    return false;
+  }
+
+  for (int i = 0; !*del && (i < nfound); ++i) {
+    const int kf = search->found[i];
+    for (int j = 0; !*del && (j < front_sg->run_len[kf]); ++j) {
+      /* Insertions before the front slot change the index of its first
+         primitive. */
+      int front = clip_get_run_pos(front_sg, kf) + j;
+      if (!clip_primitive_vs_primitive(varray, search, back_sg, bg, k, back,
+                                       plane, &front_sg->group, fg, &front,
+                                       nsplit, del, verbose)) {
+        return false;
+      }
+      if (!*del && clip_lost_normal(back_sg, back, varray)) {
+        return clip_remaining(varray, search, part, group_order, bpos,
+                              back_sg, k, back, plane, fpos,
+                              front_sg->slot[kf], front, nsplit, del,
+                              verbose);
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Clip a polygon in a given slot of a subgroup, and any fragments of it
+   created by clipping, against polygons in front of them. */
+static bool clip_slot(VertexArray * const varray,
+                      ClipSearch * const search,
+                      ClipPartition * const part,
+                      const int *const group_order,
+                      const int group_order_len, const int bg,
+                      ClipSubgroup * const sg, const int k,
+                      int *const nsplit, int *const ndel,
+                      const bool verbose)
+{
+  assert(part != NULL);
+  assert(sg != NULL);
+  assert(ndel != NULL);
+
+  const ClipPlaneSet *const plane_set = &part->planes[sg->plane];
+  const int first_entry = clip_find_entry(plane_set, bg);
+  const int first = clip_get_run_pos(sg, k);
+
+  for (int back = first; back < first + sg->run_len[k]; ++back) {
+    bool del = false;
+
+    /* Clipping a polygon can take a long time without splitting it */
+    if (clip_over_budget(search, varray, *nsplit, verbose)) {
+      return false;
+    }
+
+    /* Search for coplanar polygons in the same group as the
+       polygon to be clipped. */
+    if (!clip_group_vs_group(varray, search, part, group_order, bg, sg, k,
+                             back, bg, sg, nsplit, &del, verbose)) {
+      return false;
+    }
+
+    /* Search for coplanar polygons in following groups
+       (examined in the given group plot order). Groups without members
+       of this plane set are skipped unless they have fragments without
+       a normal vector. */
+    int e = first_entry;
+    for (int fg = bg + 1; !del && (fg < group_order_len); ++fg) {
+      if (part->nlost == 0) {
+        if (e == plane_set->nentries) {
+          break;
+        }
+        fg = plane_set->order_pos[e];
+      }
+
+      ClipSubgroup *front_sg = NULL;
+      if ((e < plane_set->nentries) && (plane_set->order_pos[e] == fg)) {
+        front_sg = plane_set->subgroup[e++];
+      } else if (!part->lost[part->dindex[group_order[fg]]]) {
+        continue;
+      }
+
+      if (group_order[fg] == group_order[bg]) {
+        DEBUGF("Cannot clip group %d against itself\n", group_order[fg]);
+      } else {
+        DEBUGF("Front group is %d\n", group_order[fg]);
+
+        if (!clip_group_vs_group(varray, search, part, group_order, bg, sg,
+                                 k, back, fg, front_sg, nsplit, &del,
+                                 verbose)) {
+          return false;
+        }
+      }
+    }
+
+    if (del) {
+      ++*ndel;
+      /* We've deleted the back polygon so we don't need to advance
+         to the next polygon to be clipped on the next iteration. */
+      --back;
+    }
+  }
+
+  return true;
+}
+
+/* Record that a group has fragments without a normal vector after it has
+   been clipped. Until then, none of them are in front of the polygon being
+   clipped. */
+static void clip_mark_lost(ClipPartition * const part, const int g)
+{
+  assert(part != NULL);
+  if (!part->lost[g]) {
+    part->lost[g] = true;
+    ++part->nlost;
+  }
+}
+
+static bool clip_group(VertexArray * const varray,
+                       ClipSearch * const search,
+                       ClipPartition * const part,
+                       const int *const group_order,
+                       const int group_order_len, const int bg,
+                       const ClipReuse *const reuse,
+                       const bool verbose)
+{
+  /* Clip one group of polygons (selected according to the given group
+     plot order) against any polygons in front of them. */
+  assert(varray != NULL);
+  assert(part != NULL);
+  assert(bg >= 0);
+  assert(bg < group_order_len);
+
+  /* Splits made in reused plane sets count towards the limit, as if they
+     had been clipped again. */
+  int nsplit = (reuse != NULL) ? reuse->reused_nsplit[bg] : 0, ndel = 0;
+  if (clip_over_budget(search, varray, nsplit, verbose)) {
+    return false;
+  }
+
+  DEBUGF("Back group is %d\n", group_order[bg]);
+  const int g = part->dindex[group_order[bg]];
+  const int old_nlost = search->nlost;
+
+  /* Clip each polygon in the selected group in turn, together with any
+     fragments of it created by clipping. Only polygons in the same plane
+     set need to be considered. */
+  const int nslots = clip_get_num_slots(part, g);
+  for (int s = 0; s < nslots; ++s) {
+    const ClipSlot *const slot = clip_get_slot(part, g, s);
+    if (slot->subgroup < 0) {
+      continue;
+    }
+
+    ClipSubgroup *const sg = &part->subgroups[slot->subgroup];
+    if ((reuse != NULL) && (reuse->reuse_from[sg->plane] >= 0)) {
+      continue;
+    }
+
+    const int old_nsplit = nsplit;
+    if (!clip_slot(varray, search, part, group_order, group_order_len, bg,
+                   sg, slot->k, &nsplit, &ndel, verbose)) {
+      if (search->nlost > old_nlost) {
+        clip_mark_lost(part, g);
+      }
+      return false;
+    }
+
+    if (reuse != NULL) {
+      const int e = clip_find_entry(&part->planes[sg->plane], bg) - 1;
+      assert(e >= 0);
+      reuse->plane_nsplit[sg->plane][e] += nsplit - old_nsplit;
+    }
+  }
+
+  if (search->nlost > old_nlost) {
+    clip_mark_lost(part, g);
+  }
+
+  if (verbose) {
+    if (nsplit || ndel) {
+      printf("Split %d and deleted %d in group %d\n", nsplit, ndel, bg);
+    }
+  }
+
+  return true;
+}
+
+/* Replace the content of each real group with the clipped primitives.
+   Primitives that were not clipped are copied from src, which may be the
+   same as dst. */
+static bool clip_merge(ClipPartition *const part, const Group *const src,
+                       Group *const dst)
+{
+  assert(part != NULL);
+  assert(src != NULL);
+  assert(dst != NULL);
+
+  for (int g = 0; g < part->ngroups; ++g) {
+    const Group *const group = &src[part->group[g]];
+    const int nslots = clip_get_num_slots(part, g);
+
+    Group merged;
+    group_init_allocator(&merged, dst[part->group[g]].alloc);
+
+    for (int s = 0; s < nslots; ++s) {
+      const ClipSlot *const slot = clip_get_slot(part, g, s);
+      const Group *from = group;
+      int first = s, n = 1;
+
+      if (slot->subgroup >= 0) {
+        ClipSubgroup *const sg = &part->subgroups[slot->subgroup];
+        from = &sg->group;
+        first = clip_get_run_pos(sg, slot->k);
+        n = sg->run_len[slot->k];
+      }
+
+      for (int i = 0; i < n; ++i) {
+        Primitive *const copy = group_add_primitive(&merged);
+        if (copy == NULL) {
+          group_free(&merged);
+          return false;
+        }
+        *copy = *group_get_primitive(from, first + i);
+      }
+    }
+
+    group_free(&dst[part->group[g]]);
+    dst[part->group[g]] = merged;
+  }
+
+  return true;
+}
+
+void clip_stats_init(ClipStats *const stats, ClipClockFn *const clock,
+                     void *const context)
+{
+  assert(stats != NULL);
+  *stats = (ClipStats){
+    .clock = clock,
+    .clock_context = context,
+    .npairs = 0,
+    .nnot_coplanar = 0,
+    .ncontained = 0,
+    .nsplits = 0,
+    .ndeleted = 0,
+    .nstopped = 0,
+    .clip = {.nbbox_rejected = 0, .nvertices_added = 0,
+             .nvertices_found = 0},
+    .time = {0},
+  };
+}
+
+static long long clip_stats_read_clock(const ClipStats *const stats)
+{
+  return ((stats != NULL) && (stats->clock != NULL)) ?
+         stats->clock(stats->clock_context) : 0;
+}
+
+/* Adds the time since *start to the given phase and restarts *start. */
+static void clip_stats_add_time(ClipStats *const stats,
+                                const ClipPhase phase, long long *const start)
+{
+  assert(start != NULL);
+  assert(phase >= 0);
+  assert(phase < ClipPhase_Count);
+
+  if ((stats != NULL) && (stats->clock != NULL)) {
+    const long long now = stats->clock(stats->clock_context);
+    stats->time[phase] += now - *start;
+    *start = now;
+  }
+}
+
+void clip_budget_init(ClipBudget *const budget)
+{
+  assert(budget != NULL);
+  *budget = clip_default_budget;
+}
+
+bool clip_polygons_budget(VertexArray * const varray,
+                          Group * const groups,
+                          const int *const group_order,
+                          const int group_order_len,
+                          const bool verbose,
+                          const ClipBudget *budget,
+                          ClipStats *const stats)
+{
+  assert(varray != NULL);
+  assert(groups != NULL);
+  assert(group_order != NULL);
+  assert(group_order_len >= 0);
+
+  if (group_order_len == 0) {
+    return true;
+  }
+
+  long long start = clip_stats_read_clock(stats);
+
+  ClipPartition part;
+  if (!clip_make_partition(&part, varray, groups, group_order,
+                           group_order_len, verbose)) {
+    if (verbose) {
+      printf("Clipping failed (out of memory)\n");
+    }
+    clip_free_partition(&part);
+    return false;
+  }
+  clip_stats_add_time(stats, ClipPhase_Partition, &start);
+
+  /* Splitting polygons requires frequent searches for existing vertices
+     at the points of intersection. It's still possible to clip (more
+     slowly) if the index can't be created. */
+  const bool was_indexed = vertex_array_is_indexed(varray);
+  if (!was_indexed && !vertex_array_enable_index(varray) && verbose) {
+    printf("Failed to index vertices\n");
+  }
+
+  /* Clip each group of polygons in turn (using the given plot order). */
+  if (budget == NULL) {
+    budget = &clip_default_budget;
+  }
+  ClipSearch search;
+  clip_search_init(&search, stats, budget, varray);
+  bool success = true;
+  for (int bg = 0; success && (bg < group_order_len); ++bg) {
+    search.limit = ClipLimit_None;
+    success = clip_group(varray, &search, &part, group_order,
+                         group_order_len, bg, NULL, verbose);
+
+    if (!success && budget->degrade && (search.limit != ClipLimit_None)) {
+      /* Keep any polygons already clipped. Only the split limit applies
+         to each group separately; other limits stop all clipping. */
+      success = true;
+      const bool stop = (search.limit != ClipLimit_Splits);
+      if (stats != NULL) {
+        stats->nstopped += stop ? group_order_len - bg : 1;
+      }
+      if (stop) {
+        break;
+      }
+    }
+  }
+  free(search.found);
+
+  if (!was_indexed) {
+    vertex_array_disable_index(varray);
+  }
+  clip_stats_add_time(stats, ClipPhase_Clip, &start);
+
+  /* Keep the result of any clipping done before a failure, as before. */
+  if (!clip_merge(&part, groups, groups) && success) {
+    if (verbose) {
+      printf("Clipping failed (out of memory)\n");
+    }
+    success = false;
+  }
+
+  clip_free_partition(&part);
+  clip_stats_add_time(stats, ClipPhase_Merge, &start);
+  return success;
+}
+
+bool clip_polygons_stats(VertexArray * const varray,
+                         Group * const groups,
+                         const int *const group_order,
+                         const int group_order_len,
+                         const bool verbose,
+                         ClipStats *const stats)
+{
+  return clip_polygons_budget(varray, groups, group_order, group_order_len,
+                              verbose, NULL, stats);
+}
+
+bool clip_polygons(VertexArray * const varray,
+                   Group * const groups,
+                   const int *const group_order,
+                   const int group_order_len,
+                   const bool verbose)
+{
+  return clip_polygons_budget(varray, groups, group_order, group_order_len,
+                              verbose, NULL, NULL);
+}
+
+/* Clipping polygons in one plane set doesn't affect any primitives in
+   another, so plane sets can be clipped concurrently. Each plane set has
+   its own overlay of the vertex array, to which vertices at the points of
+   intersection are added. Afterwards, the new vertices are added to the
+   real vertex array in the order in which clip_polygons would have
+   created them. That is only possible if clipping in one plane set
+   couldn't have found a vertex created by another, which is checked. */
+typedef struct {
+  int plane;
+  long long weight; /* estimate of the work required */
+  VertexArray overlay;
+  VertexIndex nkeys;
+  VertexIndex nkeys_alloc;
+  long long *keys; /* position in the serial order of each new vertex */
+  VertexIndex *map; /* new number of each vertex added to the overlay */
+} ClipTask;
+
+typedef struct {
+  ClipPartition *part;
+  const int *group_order;
+  int group_order_len;
+  int ntasks;
+  ClipTask **tasks;
+  int *nsplit; /* number of splits at each position in the group order */
+  ClipSearch search;
+  bool success;
+} ClipThread;
+
+/* A vertex added to one of the overlays */
+typedef struct {
+  long long key;
+  int task;
+  VertexIndex v;
+} ClipNewVertex;
+
+typedef struct {
+  Coord coords[3];
+  int task;
+} ClipNewCoords;
+
+typedef enum {
+  ClipResult_Unchanged, /* nothing was modified */
+  ClipResult_Failed,
+  ClipResult_Done
+} ClipResult;
+
+static int clip_compare_weights(const void *a, const void *b)
+{
+  const ClipTask *const ta = *(ClipTask *const *)a;
+  const ClipTask *const tb = *(ClipTask *const *)b;
+  if (ta->weight != tb->weight) {
+    return ta->weight > tb->weight ? -1 : 1;
+  }
+  return (ta->plane > tb->plane) - (ta->plane < tb->plane);
+}
+
+static int clip_compare_keys(const void *a, const void *b)
+{
+  const ClipNewVertex *const va = a, *const vb = b;
+  if (va->key != vb->key) {
+    return va->key < vb->key ? -1 : 1;
+  }
+  return (va->v > vb->v) - (va->v < vb->v);
+}
+
+static int clip_compare_x(const void *a, const void *b)
+{
+  const ClipNewCoords *const ca = a, *const cb = b;
+  return (ca->coords[0] > cb->coords[0]) - (ca->coords[0] < cb->coords[0]);
+}
+
+/* Record the position in the serial order of vertices added to a task's
+   overlay since this function was last called. */
+static bool clip_record_keys(ClipTask *const task, const long long key)
+{
+  assert(task != NULL);
+
+  const VertexIndex nvertices =
+    vertex_array_get_num_vertices(&task->overlay) - task->overlay.nbase;
+  if (nvertices > task->nkeys_alloc) {
+    const VertexIndex new_nalloc = HIGHEST(nvertices, task->nkeys_alloc * 2);
+    long long *const new_keys = realloc(task->keys,
+                                        sizeof(*new_keys) *
+                                        (size_t)new_nalloc);
+    if (new_keys == NULL) {
+      return false;
+    }
+    task->keys = new_keys;
+    task->nkeys_alloc = new_nalloc;
+  }
+
+  for (; task->nkeys < nvertices; ++task->nkeys) {
+    task->keys[task->nkeys] = key;
+  }
+  return true;
+}
+
+static void clip_run_thread(void *const arg)
+{
+  ClipThread *const thread = arg;
+  assert(thread != NULL);
+  ClipPartition *const part = thread->part;
+  const int nslots = part->first_slot[part->ngroups];
+
+  for (int t = 0; thread->success && (t < thread->ntasks); ++t) {
+    ClipTask *const task = thread->tasks[t];
+    const ClipPlaneSet *const plane_set = &part->planes[task->plane];
+
+    /* Same order as clip_polygons, except for omitting other plane sets */
+    for (int e = 0; thread->success && (e < plane_set->nentries); ++e) {
+      const int bg = plane_set->order_pos[e];
+      ClipSubgroup *const sg = plane_set->subgroup[e];
+      const int n = (int)(sg - part->subgroups);
+      const int old_nlost = thread->search.nlost;
 
-  /* Find the two-dimensional plane in which to clip the two primitives
-     (returns false if the back primitive is a point or line). */
-  Plane plane;
-  if (!primitive_find_plane(backp, varray, &plane)) {
+      for (int k = 0; thread->success && (k < sg->nslots); ++k) {
+        /* Polygons without a normal vector are never clipped */
+        if (clip_get_slot(part, sg->g, sg->slot[k])->subgroup != n) {
+          continue;
+        }
+
+        int ndel = 0;
+        thread->success = clip_slot(&task->overlay, &thread->search, part,
+                                    thread->group_order,
+                                    thread->group_order_len, bg, sg, k,
+                                    &thread->nsplit[bg], &ndel, false) &&
+                          clip_record_keys(task,
+                                           ((long long)bg * nslots) +
+                                           sg->slot[k]);
+      }
+
+      /* Fragments without a normal vector can be in front of polygons in
+         other plane sets if the same group is clipped again later. */
+      for (int pos = bg + 1;
+           thread->success && (thread->search.nlost > old_nlost) &&
+           (pos < thread->group_order_len);
+           ++pos) {
+        if (thread->group_order[pos] == thread->group_order[bg]) {
+          DEBUGF("Can't clip group %d again concurrently\n",
+                 thread->group_order[bg]);
+          thread->success = false;
+        }
+      }
+    }
+  }
+}
+
+/* Find whether a vertex added to one overlay is so close to one added to
+   a different overlay that clip_polygons might have found it instead of
+   adding another. */
+static bool clip_find_conflict(const ClipTask *const tasks,
+                               const ClipNewVertex *const new_vertices,
+                               const VertexIndex nnew)
+{
+  ClipNewCoords *const sorted = malloc(sizeof(*sorted) *
+                                       (size_t)(nnew ? nnew : 1));
+  if (sorted == NULL) {
     return true;
   }
 
-  Group * const front_group = groups + fg;
+  for (VertexIndex i = 0; i < nnew; ++i) {
+    const int t = new_vertices[i].task;
+    Coord (*const coords)[3] = vertex_array_get_coords(&tasks[t].overlay,
+                                                       new_vertices[i].v);
+    for (size_t dim = 0; dim < ARRAY_SIZE(*coords); ++dim) {
+      sorted[i].coords[dim] = (*coords)[dim];
+    }
+    sorted[i].task = t;
+  }
 
-  for (; front < group_get_num_primitives(front_group); ++front) {
-    DEBUGF("Front primitive is %d in group %d\n", front, fg);
-    Primitive *frontp = group_get_primitive(front_group, front);
+  /* Both vertices could be within MAX_FLT_ERR of coordinates passed to
+     vertex_array_find_vertex, so look for others within twice that. */
+  qsort(sorted, (size_t)nnew, sizeof(*sorted), clip_compare_x);
 
-    if (primitive_get_num_sides(frontp) < 3) {
-      DEBUGF("Can't clip against point or line\n");
-      continue;
+  bool conflict = false;
+  for (VertexIndex i = 0; !conflict && (i < nnew); ++i) {
+    for (VertexIndex j = i + 1; !conflict && (j < nnew); ++j) {
+      if (!(sorted[j].coords[0] - sorted[i].coords[0] < MAX_FLT_ERR * 2)) {
+        break;
+      }
+      conflict = (sorted[i].task != sorted[j].task);
+      for (size_t dim = 1; conflict && (dim < ARRAY_SIZE(sorted[i].coords));
+           ++dim) {
+        conflict = (coord_abs(sorted[j].coords[dim] - sorted[i].coords[dim]) <
+                    MAX_FLT_ERR * 2);
+      }
     }
+  }
 
-    if (!primitive_coplanar(frontp, backp, varray)) {
-      continue;
+  free(sorted);
+  if (conflict) {
+    DEBUGF("Vertices added concurrently are too close\n");
+  }
+  return conflict;
+}
+
+/* Copy the vertices added to the overlays into the real array and
+   renumber the vertices of primitives. */
+static ClipResult clip_merge_vertices(VertexArray *const varray,
+                                      ClipPartition *const part,
+                                      ClipTask *const tasks,
+                                      const int ntasks)
+{
+  assert(varray != NULL);
+  assert(part != NULL);
+  assert(tasks != NULL);
+
+  const VertexIndex nbase = vertex_array_get_num_vertices(varray);
+  VertexIndex nnew = 0;
+  for (int t = 0; t < ntasks; ++t) {
+    if (tasks[t].nkeys > VERTEX_INDEX_MAX - nbase - nnew) {
+      return ClipResult_Unchanged;
     }
+    nnew += tasks[t].nkeys;
+  }
 
-    bool split = false, covered = false;
-    do {
-      assert(!covered);
-      if (primitive_equal(frontp, backp)) {
-        covered = true;
-        break;
-      }
+  ClipNewVertex *const new_vertices = malloc(sizeof(*new_vertices) *
+                                             (size_t)(nnew ? nnew : 1));
+  if (new_vertices == NULL) {
+    return ClipResult_Unchanged;
+  }
 
-      if (primitive_contains(frontp, backp, varray, plane)) {
-        /* The back polygon is completely covered by the front polygon */
-        covered = true;
-        break;
-      }
+  VertexIndex i = 0;
+  for (int t = 0; t < ntasks; ++t) {
+    const VertexIndex n = tasks[t].nkeys;
+    tasks[t].map = malloc(sizeof(*tasks[t].map) * (size_t)(n ? n : 1));
+    if (tasks[t].map == NULL) {
+      free(new_vertices);
+      return ClipResult_Unchanged;
+    }
+    for (VertexIndex v = 0; v < n; ++v) {
+      new_vertices[i++] = (ClipNewVertex){
+        .key = tasks[t].keys[v], .task = t, .v = nbase + v};
+    }
+  }
+  assert(i == nnew);
 
-      split = false;
+  /* Each step of the serial order belongs to one plane set, therefore
+     vertices created by different tasks never have the same key. */
+  qsort(new_vertices, (size_t)nnew, sizeof(*new_vertices), clip_compare_keys);
 
-      Primitive newbackp;
-      if (!primitive_clip(backp, frontp, varray, plane, &newbackp, &split)) {
-        if (verbose) {
-          printf("Clipping failed (too many sides?)\n");
+  /* Reserve space before modifying the real array because it isn't
+     possible to undo changes if allocation fails. */
+  if ((vertex_array_alloc_vertices(varray, nbase + nnew) < nbase + nnew) ||
+      clip_find_conflict(tasks, new_vertices, nnew)) {
+    free(new_vertices);
+    return ClipResult_Unchanged;
+  }
+
+  for (i = 0; i < nnew; ++i) {
+    ClipTask *const task = &tasks[new_vertices[i].task];
+    const VertexIndex v = vertex_array_add_vertex(varray,
+      vertex_array_get_coords(&task->overlay, new_vertices[i].v));
+    assert(v == nbase + i);
+    task->map[new_vertices[i].v - nbase] = v;
+  }
+  free(new_vertices);
+
+  /* Task numbers are the same as plane set numbers */
+  for (int n = 0; n < part->nsubgroups; ++n) {
+    ClipSubgroup *const sg = &part->subgroups[n];
+    const ClipTask *const task = &tasks[sg->plane];
+    const int nprimitives = group_get_num_primitives(&sg->group);
+
+    for (int p = 0; p < nprimitives; ++p) {
+      Primitive *const pp = group_get_primitive(&sg->group, p);
+      const int nsides = primitive_get_num_sides(pp);
+      for (int side = 0; side < nsides; ++side) {
+        const VertexIndex v = primitive_get_side(pp, side);
+        if (v >= nbase) {
+          primitive_set_side(pp, side, task->map[v - nbase]);
         }
-        return false;
       }
-      if (split) {
-        assert(primitive_coplanar(frontp, backp, varray));
-        assert(primitive_coplanar(&newbackp, backp, varray));
-        Primitive * const r = group_insert_primitive(back_group, back + 1);
-        if (r == NULL) {
-          if (verbose) {
-            printf("Clipping failed (out of memory)\n");
-          }
-          return false;
-        }
-        *r = newbackp;
+    }
+  }
 
-        if (++(*nsplit) == MAX_SPLITS) {
-          if (verbose) {
-            printf("Aborted polygon clipping after %d splits\n", *nsplit);
-          }
-          return false;
+  return ClipResult_Done;
+}
+
+static ClipResult clip_parallel(VertexArray *const varray,
+                                Group *const groups,
+                                ClipPartition *const part,
+                                const int *const group_order,
+                                const int group_order_len,
+                                const int nthreads, ClipSpawnFn *const spawn,
+                                void *const context)
+{
+  assert(part != NULL);
+  assert(nthreads > 1);
+  assert(spawn != NULL);
+
+  const int ntasks = part->nplanes;
+  ClipTask *const tasks = malloc(sizeof(*tasks) * (ntasks ? ntasks : 1));
+  ClipTask **const sorted = malloc(sizeof(*sorted) * (ntasks ? ntasks : 1));
+  ClipTask **const by_thread = malloc(sizeof(*by_thread) *
+                                      (ntasks ? ntasks : 1));
+  ClipThread *const threads = calloc(nthreads, sizeof(*threads));
+  void **const args = malloc(sizeof(*args) * nthreads);
+  long long *const load = calloc(nthreads, sizeof(*load));
+  int *const thread_of = malloc(sizeof(*thread_of) * (ntasks ? ntasks : 1));
+  int *const nsplit = calloc((size_t)nthreads * group_order_len,
+                             sizeof(*nsplit));
+  ClipResult result = ClipResult_Unchanged;
+
+  if ((tasks == NULL) || (sorted == NULL) || (by_thread == NULL) ||
+      (threads == NULL) || (args == NULL) || (load == NULL) ||
+      (thread_of == NULL) || (nsplit == NULL)) {
+    DEBUGF("Not enough memory to clip concurrently\n");
+  } else {
+    for (int t = 0; t < ntasks; ++t) {
+      ClipTask *const task = &tasks[t];
+      const ClipPlaneSet *const plane_set = &part->planes[t];
+      *task = (ClipTask){.plane = t, .weight = 0, .nkeys = 0,
+                         .nkeys_alloc = 0, .keys = NULL, .map = NULL};
+      vertex_array_init_overlay(&task->overlay, varray);
+
+      /* An index of the overlay doesn't change the result */
+      (void)vertex_array_enable_index(&task->overlay);
+
+      for (int e = 0; e < plane_set->nentries; ++e) {
+        task->weight += plane_set->subgroup[e]->nslots;
+      }
+      sorted[t] = task;
+    }
+
+    /* Give each task (biggest first) to the least loaded thread */
+    qsort(sorted, ntasks, sizeof(*sorted), clip_compare_weights);
+    for (int t = 0; t < ntasks; ++t) {
+      int best = 0;
+      for (int th = 1; th < nthreads; ++th) {
+        if (load[th] < load[best]) {
+          best = th;
         }
+      }
+      load[best] += sorted[t]->weight;
+      thread_of[t] = best;
+    }
 
-        /* A new polygon will have been inserted after the back polygon.
-           If we are clipping against other primitives in the same group
-           then that means the index of all following primitives (including
-           the front polygon) increased by one. */
-        if (front_group == back_group) {
-          frontp = group_get_primitive(front_group, ++front);
+    for (int th = 0, pos = 0; th < nthreads; ++th) {
+      threads[th] = (ClipThread){
+        .part = part,
+        .group_order = group_order,
+        .group_order_len = group_order_len,
+        .ntasks = 0,
+        .tasks = by_thread + pos,
+        .nsplit = nsplit + ((size_t)th * group_order_len),
+        .success = true,
+      };
+      clip_search_init(&threads[th].search, NULL, &clip_default_budget,
+                       varray);
+      threads[th].search.concurrent = true;
+      for (int t = 0; t < ntasks; ++t) {
+        if (thread_of[t] == th) {
+          by_thread[pos++] = sorted[t];
+          ++threads[th].ntasks;
         }
+      }
+      args[th] = &threads[th];
+    }
 
-        /* In any case, the back group's primitive data may have moved. */
-        backp = group_get_primitive(back_group, back);
+    bool success = spawn(context, nthreads, clip_run_thread, args);
 
-        if (verbose) {
-          printf("Split polygon %d in group %d behind %d in group %d:\n",
-                 primitive_get_id(backp), bg, primitive_get_id(frontp), fg);
-          primitive_print(backp, varray);
-          puts("\n and");
-          primitive_print(group_get_primitive(back_group, back + 1), varray);
-          puts("");
-        }
-      } else {
-        DEBUGF("No split\n");
+    for (int th = 0; success && (th < nthreads); ++th) {
+      success = threads[th].success;
+    }
+
+    /* Abandon the result if clip_polygons would have given up */
+    for (int bg = 0; success && (bg < group_order_len); ++bg) {
+      int total = 0;
+      for (int th = 0; th < nthreads; ++th) {
+        total += threads[th].nsplit[bg];
       }
-    } while (split);
+      success = (total < MAX_SPLITS);
+    }
 
-    if (covered) {
-      /* Report deletion of the back polygon here so that we know what
-         caused it */
-      if (verbose) {
-        printf("Deleting polygon %d in group %d behind %d in group %d:\n",
-               primitive_get_id(backp), bg, primitive_get_id(frontp), fg);
-        primitive_print(backp, varray);
-        puts("");
+    if (success) {
+      result = clip_merge_vertices(varray, part, tasks, ntasks);
+      if ((result == ClipResult_Done) && !clip_merge(part, groups, groups)) {
+        result = ClipResult_Failed;
       }
-      group_delete_primitive(back_group, back);
-      *del = true;
-      break; /* finish prematurely */
+    }
+
+    for (int th = 0; th < nthreads; ++th) {
+      free(threads[th].search.found);
+    }
+
+    for (int t = 0; t < ntasks; ++t) {
+      vertex_array_free(&tasks[t].overlay);
+      free(tasks[t].keys);
+      free(tasks[t].map);
     }
   }
 
-  return true;
+  free(nsplit);
+  free(thread_of);
+  free(load);
+  free(args);
+  free(threads);
+  free(by_thread);
+  free(sorted);
+  free(tasks);
+  return result;
 }
 
-static bool clip_group(VertexArray * const varray, Group * const groups,
-                       const int *const group_order,
-                       const int group_order_len, const int bg,
-                       const bool verbose)
+bool clip_polygons_parallel(VertexArray * const varray,
+                            Group * const groups,
+                            const int *const group_order,
+                            const int group_order_len,
+                            const bool verbose,
+                            const int nthreads,
+                            ClipSpawnFn * const spawn,
+                            void * const context)
 {
-  /* Clip one group of polygons (selected according to the given group
-     plot order) against any polygons in front of them. */
   assert(varray != NULL);
   assert(groups != NULL);
-  assert(bg >= 0);
-  assert(bg < group_order_len);
+  assert(group_order != NULL);
+  assert(group_order_len >= 0);
 
-  int nsplit = 0, ndel = 0;
+  /* Messages about individual polygons must be output in order */
+  if (verbose || (nthreads <= 1) || (spawn == NULL) ||
+      (group_order_len == 0)) {
+    return clip_polygons(varray, groups, group_order, group_order_len,
+                         verbose);
+  }
 
-  DEBUGF("Back group is %d\n", group_order[bg]);
-  Group * const back_group = groups + group_order[bg];
+  ClipResult result = ClipResult_Unchanged;
+  ClipPartition part;
+  if (clip_make_partition(&part, varray, groups, group_order,
+                          group_order_len, false) &&
+      (part.nplanes > 1)) {
+    const bool was_indexed = vertex_array_is_indexed(varray);
+    if (!was_indexed) {
+      (void)vertex_array_enable_index(varray);
+    }
 
-  /* Clip each polygon in the selected group in turn. */
-  for (int back = 0; back < group_get_num_primitives(back_group); ++back) {
-    bool del = false;
+    result = clip_parallel(varray, groups, &part, group_order,
+                           group_order_len,
+                           LOWEST(nthreads, part.nplanes),
+                           spawn, context);
 
-    /* Search for coplanar polygons in the same group as the
-       polygon to be clipped. */
-    if (!clip_group_vs_group(varray, groups, group_order[bg], back,
-                             group_order[bg], back+1,
-                             &nsplit, &del, verbose)) {
-      return false;
+    if (!was_indexed) {
+      vertex_array_disable_index(varray);
     }
+  }
+  clip_free_partition(&part);
 
-    /* Search for coplanar polygons in following groups
-       (examined in the given group plot order). */
-    for (int fg = bg + 1; !del && (fg < group_order_len); ++fg) {
-      if (group_order[fg] == group_order[bg]) {
-        DEBUGF("Cannot clip group %d against itself\n", group_order[fg]);
-      } else {
-        DEBUGF("Front group is %d\n", group_order[fg]);
+  /* If the plane sets couldn't be clipped concurrently without changing
+     the result then start again. */
+  if (result == ClipResult_Unchanged) {
+    return clip_polygons(varray, groups, group_order, group_order_len,
+                         false);
+  }
+  return result == ClipResult_Done;
+}
 
-        if (!clip_group_vs_group(varray, groups, group_order[bg], back,
-                                 group_order[fg], 0,
-                                 &nsplit, &del, verbose)) {
-          return false;
+void clip_history_init(ClipHistory *const history)
+{
+  assert(history != NULL);
+  *history = (ClipHistory){
+    .group_order_len = 0,
+    .group_order = NULL,
+    .ndindex = 0,
+    .dindex = NULL,
+    .ngroups = 0,
+    .first_slot = NULL,
+    .slot_plane = NULL,
+    .first_fragment = NULL,
+    .fragments = NULL,
+    .nplanes = 0,
+    .plane_nmembers = NULL,
+    .plane_first_entry = NULL,
+    .entry_nsplit = NULL,
+    .lost_normal = false,
+  };
+}
+
+void clip_history_free(ClipHistory *const history)
+{
+  assert(history != NULL);
+  free(history->group_order);
+  free(history->dindex);
+  free(history->first_slot);
+  free(history->slot_plane);
+  free(history->first_fragment);
+  free(history->fragments);
+  free(history->plane_nmembers);
+  free(history->plane_first_entry);
+  free(history->entry_nsplit);
+  clip_history_init(history);
+}
+
+int clip_history_get_origin(const ClipHistory *const history,
+                            const int group, const int n)
+{
+  assert(history != NULL);
+
+  if ((group < 0) || (group >= history->ndindex) ||
+      (history->dindex[group] < 0) || (n < 0)) {
+    return -1;
+  }
+
+  /* Find the last primitive whose first fragment is not after the nth */
+  const int g = history->dindex[group];
+  const int first = history->first_slot[g];
+  const int pos = history->first_fragment[first] + n;
+  int low = first, high = history->first_slot[g + 1];
+  if (pos >= history->first_fragment[high]) {
+    return -1;
+  }
+  while (low < high) {
+    const int mid = low + ((high - low) / 2);
+    if (history->first_fragment[mid] <= pos) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low - 1 - first;
+}
+
+/* Record the fragments of every primitive and the splits made in each
+   plane set after clipping. */
+static bool clip_record(const ClipPartition *const part,
+                        const Group *const src,
+                        const int *const group_order,
+                        const int group_order_len,
+                        const ClipReuse *const reuse,
+                        const bool lost_normal,
+                        ClipHistory *const history)
+{
+  assert(part != NULL);
+  assert(src != NULL);
+  assert(reuse != NULL);
+  assert(history != NULL);
+
+  clip_history_free(history);
+
+  int ndindex = 0;
+  for (int pos = 0; pos < group_order_len; ++pos) {
+    ndindex = HIGHEST(ndindex, group_order[pos] + 1);
+  }
+
+  const int nslots = part->first_slot[part->ngroups];
+  long long nfragments = 0;
+  for (int g = 0; g < part->ngroups; ++g) {
+    const int n = clip_get_num_slots(part, g);
+    for (int s = 0; s < n; ++s) {
+      const ClipSlot *const slot = clip_get_slot(part, g, s);
+      nfragments += (slot->subgroup >= 0) ?
+                    part->subgroups[slot->subgroup].run_len[slot->k] : 1;
+    }
+  }
+  int nentries = 0;
+  for (int p = 0; p < part->nplanes; ++p) {
+    nentries += part->planes[p].nentries;
+  }
+  if (nfragments > INT_MAX) {
+    return false;
+  }
+
+  history->group_order_len = group_order_len;
+  history->group_order = malloc(sizeof(*history->group_order) *
+                                (group_order_len ? group_order_len : 1));
+  history->ndindex = ndindex;
+  history->dindex = malloc(sizeof(*history->dindex) *
+                           (ndindex ? ndindex : 1));
+  history->ngroups = part->ngroups;
+  history->first_slot = malloc(sizeof(*history->first_slot) *
+                               (part->ngroups + 1));
+  history->slot_plane = malloc(sizeof(*history->slot_plane) *
+                               (nslots ? nslots : 1));
+  history->first_fragment = malloc(sizeof(*history->first_fragment) *
+                                   (nslots + 1));
+  history->fragments = malloc(sizeof(*history->fragments) *
+                              (nfragments ? nfragments : 1));
+  history->nplanes = part->nplanes;
+  history->plane_nmembers = calloc(part->nplanes ? part->nplanes : 1,
+                                   sizeof(*history->plane_nmembers));
+  history->plane_first_entry = malloc(sizeof(*history->plane_first_entry) *
+                                      (part->nplanes + 1));
+  history->entry_nsplit = malloc(sizeof(*history->entry_nsplit) *
+                                 (nentries ? nentries : 1));
+
+  if ((history->group_order == NULL) || (history->dindex == NULL) ||
+      (history->first_slot == NULL) || (history->slot_plane == NULL) ||
+      (history->first_fragment == NULL) || (history->fragments == NULL) ||
+      (history->plane_nmembers == NULL) ||
+      (history->plane_first_entry == NULL) ||
+      (history->entry_nsplit == NULL)) {
+    clip_history_free(history);
+    return false;
+  }
+
+  for (int pos = 0; pos < group_order_len; ++pos) {
+    history->group_order[pos] = group_order[pos];
+  }
+  for (int n = 0; n < ndindex; ++n) {
+    history->dindex[n] = part->dindex[n];
+  }
+
+  int f = 0;
+  for (int g = 0; g < part->ngroups; ++g) {
+    const Group *const group = &src[part->group[g]];
+    const int n = clip_get_num_slots(part, g);
+    history->first_slot[g] = part->first_slot[g];
+
+    for (int s = 0; s < n; ++s) {
+      const ClipSlot *const slot = clip_get_slot(part, g, s);
+      const int i = part->first_slot[g] + s;
+      history->slot_plane[i] = slot->plane;
+      history->first_fragment[i] = f;
+
+      if (slot->subgroup >= 0) {
+        const ClipSubgroup *const sg = &part->subgroups[slot->subgroup];
+        const int first = clip_get_run_pos(sg, slot->k);
+        for (int j = 0; j < sg->run_len[slot->k]; ++j) {
+          history->fragments[f++] = *group_get_primitive(&sg->group,
+                                                         first + j);
         }
+        ++history->plane_nmembers[slot->plane];
+      } else {
+        history->fragments[f++] = *group_get_primitive(group, s);
       }
     }
+  }
+  history->first_slot[part->ngroups] = nslots;
+  history->first_fragment[nslots] = f;
+  assert(f == nfragments);
 
-    if (del) {
-      ++ndel;
-      /* We've deleted the back polygon so we don't need to advance
-         to the next polygon to be clipped on the next iteration. */
-      --back;
+  int e = 0;
+  for (int p = 0; p < part->nplanes; ++p) {
+    history->plane_first_entry[p] = e;
+    for (int i = 0; i < part->planes[p].nentries; ++i) {
+      history->entry_nsplit[e++] = reuse->plane_nsplit[p][i];
     }
   }
+  history->plane_first_entry[part->nplanes] = e;
+  history->lost_normal = lost_normal;
 
-  if (verbose) {
-    if (nsplit || ndel) {
-      printf("Split %d and deleted %d in group %d\n", nsplit, ndel, bg);
+  return true;
+}
+
+/* Find whether a history was recorded for the same primitives as are
+   about to be clipped (but not necessarily the same content). */
+static bool clip_history_matches(const ClipHistory *const history,
+                                 const ClipPartition *const part,
+                                 const int *const group_order,
+                                 const int group_order_len)
+{
+  assert(history != NULL);
+  assert(part != NULL);
+
+  if ((history->group_order_len != group_order_len) ||
+      (history->ngroups != part->ngroups) ||
+      (history->fragments == NULL)) {
+    return false;
+  }
+
+  for (int pos = 0; pos < group_order_len; ++pos) {
+    if (history->group_order[pos] != group_order[pos]) {
+      return false;
     }
   }
 
+  for (int g = 0; g <= part->ngroups; ++g) {
+    if (history->first_slot[g] != part->first_slot[g]) {
+      return false;
+    }
+  }
   return true;
 }
 
-bool clip_polygons(VertexArray * const varray,
-                   Group * const groups,
-                   const int *const group_order,
-                   const int group_order_len,
-                   const bool verbose)
+/* A plane set can be reused if none of its members are dirty and it has
+   exactly the same members as a plane set in the history. Polygons without
+   a normal vector are in every plane set, so no plane set can be reused if
+   any of them are dirty. Returns the number of plane sets reused. */
+static int clip_find_reusable(const ClipPartition *const part,
+                              const ClipHistory *const history,
+                              const ClipPrimitiveRef *const dirty,
+                              const int ndirty, bool *const is_dirty,
+                              int *const reuse_from)
+{
+  assert(part != NULL);
+  assert(history != NULL);
+  assert(dirty != NULL || ndirty == 0);
+  assert(reuse_from != NULL);
+
+  for (int p = 0; p < part->nplanes; ++p) {
+    reuse_from[p] = -1;
+  }
+
+  for (int d = 0; d < ndirty; ++d) {
+    const int group = dirty[d].group;
+    const int g = ((group >= 0) && (group < history->ndindex)) ?
+                  part->dindex[group] : -1;
+    if ((g < 0) || (dirty[d].index < 0) ||
+        (dirty[d].index >= clip_get_num_slots(part, g))) {
+      DEBUGF("Ignoring dirty primitive %d in group %d\n", dirty[d].index,
+             group);
+      continue;
+    }
+
+    const int i = part->first_slot[g] + dirty[d].index;
+    if ((history->slot_plane[i] == PLANE_ANY) ||
+        (clip_get_slot(part, g, dirty[d].index)->plane == PLANE_ANY)) {
+      return 0;
+    }
+    is_dirty[i] = true;
+  }
+
+  /* Count the members of each plane set that came from the same plane set
+     as the first, or mark it as not reusable. */
+  int *const count = calloc(part->nplanes ? part->nplanes : 1,
+                            sizeof(*count));
+  if (count == NULL) {
+    return 0;
+  }
+
+  for (int g = 0; g < part->ngroups; ++g) {
+    const int n = clip_get_num_slots(part, g);
+    for (int s = 0; s < n; ++s) {
+      const int p = clip_get_slot(part, g, s)->plane;
+      if (p < 0) {
+        continue;
+      }
+      const int i = part->first_slot[g] + s;
+      if (is_dirty[i] || (history->slot_plane[i] < 0)) {
+        count[p] = -1;
+      } else if (count[p] == 0) {
+        reuse_from[p] = history->slot_plane[i];
+        count[p] = 1;
+      } else if (count[p] > 0) {
+        count[p] = (reuse_from[p] == history->slot_plane[i]) ?
+                   count[p] + 1 : -1;
+      }
+    }
+  }
+
+  int nreused = 0;
+  for (int p = 0; p < part->nplanes; ++p) {
+    if ((count[p] > 0) &&
+        (count[p] == history->plane_nmembers[reuse_from[p]])) {
+      assert(part->planes[p].nentries ==
+             history->plane_first_entry[reuse_from[p] + 1] -
+             history->plane_first_entry[reuse_from[p]]);
+      ++nreused;
+    } else {
+      reuse_from[p] = -1;
+    }
+  }
+
+  free(count);
+  return nreused;
+}
+
+/* Replace the content of a subgroup in a reused plane set with fragments
+   copied from the history. */
+static bool clip_restore_subgroup(const ClipPartition *const part,
+                                  ClipSubgroup *const sg,
+                                  const ClipHistory *const history)
+{
+  assert(part != NULL);
+  assert(sg != NULL);
+  assert(history != NULL);
+
+  const int n = (int)(sg - part->subgroups);
+  Group restored;
+  group_init(&restored);
+
+  for (int k = 0; k < sg->nslots; ++k) {
+    const int s = sg->slot[k];
+    if (clip_get_slot(part, sg->g, s)->subgroup != n) {
+      /* Polygons without a normal vector are never clipped */
+      Primitive *const copy = group_add_primitive(&restored);
+      if (copy == NULL) {
+        group_free(&restored);
+        return false;
+      }
+      *copy = *group_get_primitive(&sg->group, k);
+      continue;
+    }
+
+    const int i = part->first_slot[sg->g] + s;
+    const int first = history->first_fragment[i];
+    const int count = history->first_fragment[i + 1] - first;
+    if (count > 0) {
+      Primitive *const copies = group_add_primitives(&restored, count);
+      if (copies == NULL) {
+        group_free(&restored);
+        return false;
+      }
+      for (int j = 0; j < count; ++j) {
+        copies[j] = history->fragments[first + j];
+      }
+    }
+    clip_add_run_len(sg, k, count - 1);
+  }
+
+  group_free(&sg->group);
+  sg->group = restored;
+  return true;
+}
+
+static bool clip_incremental(VertexArray *const varray,
+                             const Group *const originals,
+                             Group *const groups,
+                             const int *const group_order,
+                             const int group_order_len,
+                             const ClipPrimitiveRef *const dirty,
+                             const int ndirty,
+                             const ClipHistory *const history,
+                             ClipHistory *const record,
+                             int *const nreused, const bool verbose)
+{
+  assert(nreused != NULL);
+  *nreused = 0;
+
+  ClipPartition part;
+  if (!clip_make_partition(&part, varray, originals, group_order,
+                           group_order_len, verbose)) {
+    if (verbose) {
+      printf("Clipping failed (out of memory)\n");
+    }
+    clip_free_partition(&part);
+    return false;
+  }
+
+  const int nslots = part.first_slot[part.ngroups];
+  int nentries = 0;
+  for (int p = 0; p < part.nplanes; ++p) {
+    nentries += part.planes[p].nentries;
+  }
+
+  ClipReuse reuse = {
+    .reuse_from = malloc(sizeof(*reuse.reuse_from) *
+                         (part.nplanes ? part.nplanes : 1)),
+    .reused_nsplit = calloc(group_order_len, sizeof(*reuse.reused_nsplit)),
+    .plane_nsplit = malloc(sizeof(*reuse.plane_nsplit) *
+                           (part.nplanes ? part.nplanes : 1)),
+  };
+  int *const nsplit = calloc(nentries ? nentries : 1, sizeof(*nsplit));
+  bool *const is_dirty = calloc(nslots ? nslots : 1, sizeof(*is_dirty));
+  bool success = (reuse.reuse_from != NULL) &&
+                 (reuse.reused_nsplit != NULL) &&
+                 (reuse.plane_nsplit != NULL) && (nsplit != NULL) &&
+                 (is_dirty != NULL);
+
+  if (success) {
+    for (int p = 0, e = 0; p < part.nplanes; ++p) {
+      reuse.reuse_from[p] = -1;
+      reuse.plane_nsplit[p] = nsplit + e;
+      e += part.planes[p].nentries;
+    }
+
+    if ((history != NULL) && !history->lost_normal &&
+        clip_history_matches(history, &part, group_order, group_order_len)) {
+      *nreused = clip_find_reusable(&part, history, dirty, ndirty,
+                                    is_dirty, reuse.reuse_from);
+    }
+
+    /* Copy the fragments and number of splits of reused plane sets */
+    for (int n = 0; success && (n < part.nsubgroups); ++n) {
+      ClipSubgroup *const sg = &part.subgroups[n];
+      if (reuse.reuse_from[sg->plane] >= 0) {
+        success = clip_restore_subgroup(&part, sg, history);
+      }
+    }
+
+    for (int p = 0; success && (p < part.nplanes); ++p) {
+      const int old = reuse.reuse_from[p];
+      if (old < 0) {
+        continue;
+      }
+      const ClipPlaneSet *const plane_set = &part.planes[p];
+      for (int e = 0; e < plane_set->nentries; ++e) {
+        const int n = history->entry_nsplit[history->plane_first_entry[old] +
+                                            e];
+        reuse.plane_nsplit[p][e] = n;
+        reuse.reused_nsplit[plane_set->order_pos[e]] += n;
+      }
+    }
+
+    if (verbose && (*nreused > 0)) {
+      printf("Reusing fragments of polygons in %d of %d planes\n",
+             *nreused, part.nplanes);
+    }
+  } else if (verbose) {
+    printf("Clipping failed (out of memory)\n");
+  }
+
+  const bool was_indexed = vertex_array_is_indexed(varray);
+  if (success && !was_indexed && !vertex_array_enable_index(varray) &&
+      verbose) {
+    printf("Failed to index vertices\n");
+  }
+
+  ClipSearch search;
+  clip_search_init(&search, NULL, &clip_default_budget, varray);
+  for (int bg = 0; success && (bg < group_order_len); ++bg) {
+    success = clip_group(varray, &search, &part, group_order,
+                         group_order_len, bg, &reuse, verbose);
+  }
+  free(search.found);
+
+  /* Fragments without a normal vector might be coplanar with polygons in
+     plane sets that were copied, which would need to be clipped again. */
+  if (success && (search.nlost > 0) && (*nreused > 0)) {
+    if (verbose) {
+      printf("Clipping created a polygon without a normal\n");
+    }
+    success = false;
+  }
+
+  if (!was_indexed) {
+    vertex_array_disable_index(varray);
+  }
+
+  if (success && !clip_record(&part, originals, group_order,
+                              group_order_len, &reuse, search.nlost > 0,
+                              record)) {
+    if (verbose) {
+      printf("Failed to record result of clipping\n");
+    }
+    success = false;
+  }
+
+  /* Keep the result of any clipping done before a failure, as before. */
+  if (!clip_merge(&part, originals, groups) && success) {
+    if (verbose) {
+      printf("Clipping failed (out of memory)\n");
+    }
+    success = false;
+  }
+
+  free(is_dirty);
+  free(nsplit);
+  free(reuse.plane_nsplit);
+  free(reuse.reused_nsplit);
+  free(reuse.reuse_from);
+  clip_free_partition(&part);
+  return success;
+}
+
+bool clip_polygons_incremental(VertexArray *const varray,
+                               const Group *const originals,
+                               Group *const groups,
+                               const int *const group_order,
+                               const int group_order_len,
+                               const ClipPrimitiveRef *const dirty,
+                               const int ndirty,
+                               ClipHistory *const history,
+                               const bool verbose)
 {
   assert(varray != NULL);
+  assert(originals != NULL);
   assert(groups != NULL);
+  assert(originals != groups);
   assert(group_order != NULL);
   assert(group_order_len >= 0);
+  assert(dirty != NULL || ndirty == 0);
+  assert(history != NULL);
 
-  /* Clip each group of polygons in turn (using the given plot order). */
-  for (int bg = 0; bg < group_order_len; ++bg) {
-    if (!clip_group(varray, groups, group_order, group_order_len, bg,
-                    verbose)) {
-      return false;
+  ClipHistory record;
+  clip_history_init(&record);
+
+  if (group_order_len == 0) {
+    clip_history_free(history);
+    return true;
+  }
+
+  int nreused;
+  bool success = clip_incremental(varray, originals, groups, group_order,
+                                  group_order_len, dirty, ndirty, history,
+                                  &record, &nreused, verbose);
+
+  /* Start again if clipping failed, because the point at which it failed
+     might have been in one of the plane sets that were copied. */
+  if (!success && (nreused > 0)) {
+    if (verbose) {
+      printf("Clipping all polygons again\n");
     }
+    success = clip_incremental(varray, originals, groups, group_order,
+                               group_order_len, NULL, 0, NULL, &record,
+                               &nreused, verbose);
   }
 
-  return true;
+  clip_history_free(history);
+  if (success) {
+    *history = record;
+  } else {
+    clip_history_free(&record);
+  }
+  return success;
 }
@@ -20,6 +20,13 @@
 /* History:
   CJB: 05-Aug-18: Copied this source file from SF3KtoObj.
   CJB: 11-Dec-20: Removed redundant uses of the 'extern' keyword.
+  CJB: 14-Oct-26: Added clip_polygons_parallel.
+  CJB: 14-Oct-26: Added clip_polygons_incremental.
+  CJB: 14-Oct-26: Added clip_polygons_stats.
+  CJB: 14-Oct-26: Added clip_polygons_budget.
+  CJB: 14-Oct-26: The vertex budget is now of type VertexIndex.
+                  ClipHistory records whether any fragment had no normal.
+                  Moved ClipThreadFn and ClipSpawnFn to Spawn.h.
  */
 
 #ifndef CLIP_H
@@ -30,10 +37,137 @@
 
 /* Local header files */
 #include "Vertex.h"
+#include "Primitive.h"
 #include "Group.h"
+#include "Spawn.h"
 
 bool clip_polygons(VertexArray *varray, Group *groups,
                    const int *group_order, int group_order_len,
                    bool verbose);
 
+/* Type of function supplied by the caller of clip_polygons_stats to read
+   a clock. The units are up to the caller. */
+typedef long long ClipClockFn(void *context);
+
+typedef enum {
+  ClipPhase_Partition, /* finding sets of potentially coplanar polygons */
+  ClipPhase_Clip, /* clipping, including indexing the vertices */
+  ClipPhase_Merge, /* copying the clipped polygons back to their groups */
+  ClipPhase_Count
+} ClipPhase;
+
+typedef struct {
+  ClipClockFn *clock; /* NULL if times aren't required */
+  void *clock_context;
+  long long npairs; /* pairs of primitives considered */
+  long long nnot_coplanar; /* pairs rejected by primitive_coplanar */
+  long long ncontained; /* back polygons found by primitive_contains */
+  long long nsplits;
+  long long ndeleted; /* back polygons covered by front polygons */
+  long long nstopped; /* groups not fully clipped because of the budget */
+  PrimitiveClipStats clip; /* counts from primitive_clip_stats */
+  long long time[ClipPhase_Count]; /* clock ticks spent in each phase */
+} ClipStats;
+
+/* Zeroes the counts and times. The clock is optional. */
+void clip_stats_init(ClipStats *stats, ClipClockFn *clock, void *context);
+
+/* Same as clip_polygons except that counts of events and the time spent
+   in each phase are added to those in stats. That is much cheaper than
+   verbose output. */
+bool clip_polygons_stats(VertexArray *varray, Group *groups,
+                         const int *group_order, int group_order_len,
+                         bool verbose, ClipStats *stats);
+
+/* Limits on the work done by clip_polygons_budget. Any limit which is 0
+   doesn't apply. */
+typedef struct {
+  int max_splits; /* splits of polygons in any one group */
+  VertexIndex max_vertices; /* vertices added at points of intersection */
+  ClipClockFn *clock; /* NULL if the time isn't limited */
+  void *clock_context;
+  long long max_time; /* clock ticks */
+  bool degrade; /* stop clipping instead of failing at a limit */
+} ClipBudget;
+
+/* Sets the limits used by clip_polygons: clipping fails when 1024 polygons
+   in any group have been split, and there are no other limits. */
+void clip_budget_init(ClipBudget *budget);
+
+/* Same as clip_polygons_stats except that clipping is limited by the given
+   budget (or the default, if NULL). If a limit is reached and degrade is
+   true then clipping stops without failing. Polygons in a group that hit
+   the split limit are left partly clipped and the remaining groups are
+   clipped, whereas the other limits stop all clipping. In either case the
+   polygons clipped so far are kept and the stopped groups are counted in
+   stats. */
+bool clip_polygons_budget(VertexArray *varray, Group *groups,
+                          const int *group_order, int group_order_len,
+                          bool verbose, const ClipBudget *budget,
+                          ClipStats *stats);
+
+/* Same as clip_polygons except that polygons in different planes may be
+   clipped concurrently, using up to nthreads threads started by calling
+   spawn (with the given context). The primitives and vertices (including
+   their order) are the same as those produced by clip_polygons. If that
+   can't be guaranteed or verbose output is requested then the polygons are
+   clipped by a single thread instead. */
+bool clip_polygons_parallel(VertexArray *varray, Group *groups,
+                            const int *group_order, int group_order_len,
+                            bool verbose, int nthreads,
+                            ClipSpawnFn *spawn, void *context);
+
+/* Identifies a primitive by its group number and index in the group. */
+typedef struct {
+  int group;
+  int index;
+} ClipPrimitiveRef;
+
+/* A record of the result of clip_polygons_incremental. It holds a copy of
+   the fragments of each original primitive, so that those unaffected by
+   later changes can be reused instead of clipping them again. */
+typedef struct {
+  int group_order_len;
+  int *group_order;
+  int ndindex; /* one more than the highest group number */
+  int *dindex; /* index of each group number in the group order, or -1 */
+  int ngroups; /* number of distinct groups in the group order */
+  int *first_slot; /* index of the first primitive of each distinct group */
+  int *slot_plane; /* plane set of each primitive, or negative if none */
+  int *first_fragment; /* index in 'fragments' for each primitive */
+  Primitive *fragments;
+  int nplanes;
+  int *plane_nmembers; /* number of primitives in each plane set */
+  int *plane_first_entry; /* index in 'entry_nsplit' for each plane set */
+  int *entry_nsplit; /* splits made in a plane set at each group position */
+  bool lost_normal; /* whether any fragment had no normal vector */
+} ClipHistory;
+
+void clip_history_init(ClipHistory *history);
+
+void clip_history_free(ClipHistory *history);
+
+/* Returns the index in the original group of the primitive from which the
+   nth primitive of a clipped group was derived, or -1 if unknown. */
+int clip_history_get_origin(const ClipHistory *history, int group, int n);
+
+/* Same as clip_polygons except that primitives are read from originals
+   (which must not be the same array as groups) and the clipped primitives
+   are written to groups. The result is recorded in history. If history
+   records the result of a previous call for the same group order and
+   numbers of primitives, then only sets of potentially coplanar polygons
+   containing one of the ndirty primitives (before or after it changed)
+   are clipped again. Fragments of other polygons are copied from history.
+   Primitives which use any changed vertex must be included in the dirty
+   list, and no vertices may have been removed from varray since. The
+   result is the same as if all of the polygons had been clipped again.
+   Nothing is reused if clipping created a fragment without a normal
+   vector, because it might be coplanar with polygons in any other set.
+   If clipping fails then history is emptied. */
+bool clip_polygons_incremental(VertexArray *varray,
+                               const Group *originals, Group *groups,
+                               const int *group_order, int group_order_len,
+                               const ClipPrimitiveRef *dirty, int ndirty,
+                               ClipHistory *history, bool verbose);
+
 #endif /* CLIP_H */
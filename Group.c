@@ -21,12 +21,25 @@
   CJB: 05-Aug-18: Copied this source file from SF3KtoObj.
   CJB: 09-Jan-21: Initialize struct using compound literal assignment to
                   guard against leaving members uninitialized.
+  CJB: 14-Oct-26: Unused elements of the array of primitives now form a
+                  gap which moves to wherever primitives are inserted or
+                  deleted, instead of always being at the end.
+                  group_alloc_primitives now allocates at least as many
+                  primitives as requested.
+                  Added group_reserve and group_add_primitives.
+                  Added group_init_allocator.
+                  Added group_precompute_geometry.
+                  The size of the array of primitives is checked for
+                  overflow before it is allocated.
 */
 
 /* ISO library header files */
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 /* Local header files */
 #include "Internal/3dObjMisc.h"
@@ -39,10 +52,18 @@ void group_init(Group * const group)
   *group = (Group){
     .nprimitives = 0,
     .nalloc = 0,
+    .gap = 0,
     .primitives = NULL,
+    .alloc = NULL,
   };
 }
 
+void group_init_allocator(Group * const group, const Allocator * const alloc)
+{
+  group_init(group);
+  group->alloc = alloc;
+}
+
 int group_get_num_primitives(const Group * const group)
 {
   assert(group != NULL);
@@ -57,6 +78,7 @@ void group_delete_all(Group * const group)
   assert(group->nprimitives >= 0);
   assert(group->nprimitives <= group->nalloc);
   group->nprimitives = 0;
+  group->gap = 0;
 }
 
 void group_free(Group * const group)
@@ -64,7 +86,7 @@ void group_free(Group * const group)
   assert(group != NULL);
   assert(group->nprimitives >= 0);
   assert(group->nprimitives <= group->nalloc);
-  free(group->primitives);
+  allocator_free(group->alloc, group->primitives);
 }
 
 Primitive *group_get_primitive(const Group * const group, const int n)
@@ -77,6 +99,9 @@ Primitive *group_get_primitive(const Group * const group, const int n)
 
   if ((n >= 0) && (n < group->nprimitives)) {
     primitive = group->primitives + n;
+    if (n >= group->gap) {
+      primitive += group->nalloc - group->nprimitives;
+    }
   } else {
     DEBUGF("Invalid primitive number %d\n", n);
   }
@@ -89,6 +114,55 @@ Primitive *group_add_primitive(Group * const group)
   return group_insert_primitive(group, group->nprimitives);
 }
 
+static void group_move_gap(Group * const group, const int n)
+{
+  assert(group != NULL);
+  assert(group->gap >= 0);
+  assert(group->gap <= group->nprimitives);
+  assert(n >= 0);
+  assert(n <= group->nprimitives);
+
+  const int gap_len = group->nalloc - group->nprimitives;
+  if (gap_len == 0) {
+    /* An empty gap can be anywhere */
+  } else if (n < group->gap) {
+    memmove(group->primitives + n + gap_len, group->primitives + n,
+            sizeof(Primitive) * (group->gap - n));
+  } else if (n > group->gap) {
+    memmove(group->primitives + group->gap,
+            group->primitives + group->gap + gap_len,
+            sizeof(Primitive) * (n - group->gap));
+  }
+  group->gap = n;
+}
+
+static void alloc_primitives(Group * const group, const int new_nalloc)
+{
+  assert(group != NULL);
+  assert(new_nalloc > group->nalloc);
+
+  /* Make the unused elements contiguous with the new ones */
+  group_move_gap(group, group->nprimitives);
+
+  if ((size_t)new_nalloc > SIZE_MAX / sizeof(Primitive)) {
+    DEBUGF("Too many primitives %d\n", new_nalloc);
+    return;
+  }
+
+  const size_t nbytes = sizeof(Primitive) * (size_t)new_nalloc;
+  Primitive * const new_primitives = allocator_realloc(group->alloc,
+                                                      group->primitives,
+                                                      nbytes);
+  if (new_primitives == NULL) {
+    DEBUGF("Failed to allocate %zu bytes for primitives\n", nbytes);
+  } else {
+    DEBUGF("Moving primitives from %p to %p\n",
+            (void *)group->primitives, (void *)new_primitives);
+    group->primitives = new_primitives;
+    group->nalloc = new_nalloc;
+  }
+}
+
 int group_alloc_primitives(Group * const group, const int n)
 {
   assert(group != NULL);
@@ -97,17 +171,12 @@ int group_alloc_primitives(Group * const group, const int n)
 
   if (n >= 0) {
     if (n > group->nalloc) {
-      const int new_nalloc = group->nalloc ? group->nalloc * 2 : 8;
-      const size_t nbytes = sizeof(Primitive) * new_nalloc;
-      Primitive * const new_primitives = realloc(group->primitives, nbytes);
-      if (new_primitives == NULL) {
-        DEBUGF("Failed to allocate %zu bytes for primitives\n", nbytes);
-      } else {
-        DEBUGF("Moving primitives from %p to %p\n",
-                (void *)group->primitives, (void *)new_primitives);
-        group->primitives = new_primitives;
-        group->nalloc = new_nalloc;
+      int new_nalloc = group->nalloc > INT_MAX / 2 ? INT_MAX :
+                       group->nalloc ? group->nalloc * 2 : 8;
+      if (new_nalloc < n) {
+        new_nalloc = n;
       }
+      alloc_primitives(group, new_nalloc);
     }
   } else {
     DEBUGF("Invalid number of primitives %d\n", n);
@@ -117,6 +186,53 @@ int group_alloc_primitives(Group * const group, const int n)
   return group->nalloc;
 }
 
+bool group_reserve(Group * const group, const int n)
+{
+  assert(group != NULL);
+  assert(group->nprimitives >= 0);
+  assert(group->nprimitives <= group->nalloc);
+
+  if (n < 0) {
+    DEBUGF("Invalid number of primitives %d\n", n);
+    return false;
+  }
+
+  if (n > group->nalloc) {
+    alloc_primitives(group, n);
+  }
+
+  assert(group->nprimitives <= group->nalloc);
+  return n <= group->nalloc;
+}
+
+Primitive *group_add_primitives(Group * const group, const int count)
+{
+  assert(group != NULL);
+  assert(group->nprimitives >= 0);
+
+  if (count <= 0 || count > INT_MAX - group->nprimitives) {
+    DEBUGF("Invalid number of primitives %d\n", count);
+    return NULL;
+  }
+
+  const int new_nprim = group->nprimitives + count;
+  if (group_alloc_primitives(group, new_nprim) < new_nprim) {
+    return NULL;
+  }
+
+  /* Put the gap after the new primitives so that they are contiguous */
+  group_move_gap(group, group->nprimitives);
+  Primitive * const primitives = group->primitives + group->nprimitives;
+  for (int i = 0; i < count; ++i) {
+    primitive_init(primitives + i);
+  }
+  group->nprimitives = new_nprim;
+  group->gap = new_nprim;
+
+  DEBUGF("Added %d primitives to group %p\n", count, (void *)group);
+  return primitives;
+}
+
 Primitive *group_insert_primitive(Group * const group, const int n)
 {
   Primitive * primitive = NULL;
@@ -129,16 +245,14 @@ Primitive *group_insert_primitive(Group * const group, const int n)
   if ((n >= 0) && (n < group->nprimitives+1)) {
     const int new_nprim = group->nprimitives + 1;
     if (group_alloc_primitives(group, new_nprim) >= new_nprim) {
+      /* Use the first element of the gap */
+      group_move_gap(group, n);
+      ++group->gap;
       ++group->nprimitives;
       assert(group->nprimitives <= group->nalloc);
       primitive = group_get_primitive(group, n);
       assert(primitive != NULL);
 
-      if (group->nprimitives > (n+1)) {
-         memmove(primitive + 1, primitive,
-                 sizeof(Primitive) * (group->nprimitives - (n+1)));
-      }
-
       primitive_init(primitive);
 
       DEBUGF("Added primitive %d (%p) in group %p\n", n,
@@ -155,10 +269,9 @@ void group_delete_primitive(Group * const group, const int n)
 {
   Primitive *const primitive = group_get_primitive(group, n);
   if (primitive != NULL) {
-    if (group->nprimitives > (n+1)) {
-      memmove(primitive, primitive + 1,
-              sizeof(Primitive) * (group->nprimitives - (n+1)));
-    }
+    /* Add the deleted primitive to the end of the gap */
+    group_move_gap(group, n + 1);
+    --group->gap;
     --group->nprimitives;
 
     DEBUGF("Deleted primitive %d (%p) in group %p\n", n,
@@ -176,3 +289,16 @@ void group_set_used(const Group * const group, VertexArray * const varray)
     primitive_set_used(pp, varray);
   }
 }
+
+void group_precompute_geometry(const Group * const group,
+                               const VertexArray * const varray)
+{
+  assert(group != NULL);
+  const int nprimitives = group_get_num_primitives(group);
+
+  for (int p = 0; p < nprimitives; ++p) {
+    Primitive * const pp = group_get_primitive(group, p);
+    assert(pp != NULL);
+    (void)primitive_precompute(pp, varray);
+  }
+}
@@ -20,22 +20,42 @@
 /* History:
   CJB: 05-Aug-18: Copied this source file from SF3KtoObj.
   CJB: 11-Dec-20: Removed redundant uses of the 'extern' keyword.
+  CJB: 14-Oct-26: Unused elements of the array of primitives now form a
+                  gap which moves to wherever primitives are inserted or
+                  deleted.
+                  Added group_reserve and group_add_primitives.
+                  Added group_init_allocator.
+                  Added group_precompute_geometry.
  */
 
 #ifndef GROUP_H
 #define GROUP_H
 
+#include <stdbool.h>
+
 #include "Primitive.h"
 #include "Vertex.h"
+#include "Allocator.h"
 
+/* Unused elements of the array of primitives form a gap between 'gap'
+   primitives at the start of the array and the rest at the end. Inserting
+   or deleting a primitive only requires primitives between the old and new
+   position of the gap to be moved, which is fast if successive changes are
+   close together (e.g. when splitting polygons in order). */
 typedef struct {
   int nalloc;
   int nprimitives;
+  int gap; /* number of primitives before the gap */
   Primitive *primitives;
+  const Allocator *alloc; /* NULL to use malloc, realloc and free */
 } Group;
 
 void group_init(Group *group);
 
+/* Like group_init, except that memory for primitives is allocated using
+   alloc (if not NULL), which must remain valid until the group is freed. */
+void group_init_allocator(Group *group, const Allocator *alloc);
+
 void group_delete_all(Group *group);
 
 void group_free(Group *group);
@@ -46,12 +66,26 @@ Primitive *group_get_primitive(const Group *group, int n);
 
 int group_alloc_primitives(Group *group, int n);
 
+/* Unlike group_alloc_primitives, which grows the array geometrically, this
+   allocates space for exactly n primitives if they don't fit already. */
+bool group_reserve(Group *group, int n);
+
 Primitive *group_add_primitive(Group *group);
 
+/* Appends count primitives and returns a pointer to the first. The rest
+   follow it contiguously until the group is next modified. */
+Primitive *group_add_primitives(Group *group, int count);
+
 Primitive *group_insert_primitive(Group *group, int prev);
 
 void group_delete_primitive(Group *group, int n);
 
 void group_set_used(const Group *group, VertexArray *varray);
 
+/* Computes the normal vector, plane and bounding box of every primitive in
+   one pass, instead of when each is first needed. Only data cached in the
+   primitives is changed, so different groups can be processed concurrently
+   as long as the vertex array isn't modified. */
+void group_precompute_geometry(const Group *group, const VertexArray *varray);
+
 #endif /* GROUP_H */
@@ -0,0 +1,534 @@
+/*
+ * 3dObjLib: Binary cache of vertices and primitives
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this source file.
+                  Caches written with a different maximum number of sides
+                  are rejected.
+                  Version 3 records the plane cached in each primitive.
+                  Version 4 records the size of a vertex index.
+                  The flags and plane of each primitive are checked.
+                  Chains of links from duplicate vertices are checked.
+                  Padding bytes are written as zeros.
+                  Vertex IDs and side counts of primitives are checked
+                  without relying on assertions.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Local header files */
+#include "Internal/3dObjMisc.h"
+#include "MeshCache.h"
+#include "Vertex.h"
+#include "Group.h"
+#include "Primitive.h"
+
+enum {
+  CACHE_VERSION = 4,
+  CACHE_BYTE_ORDER = 0x01020304,
+  CACHE_ALIGN = 16 /* alignment of the vertices and primitives */
+};
+
+static const char cache_magic[8] = {'3', 'd', 'O', 'b', 'j', 'C', 'c', 'h'};
+
+/* Source of data for loading a cache: either a file or memory */
+typedef struct {
+  FILE *in;
+  const char *data;
+  size_t size;
+  size_t pos;
+} CacheSource;
+
+static uint64_t align_offset(const uint64_t offset)
+{
+  return (offset + CACHE_ALIGN - 1) & ~(uint64_t)(CACHE_ALIGN - 1);
+}
+
+/* Fills in the layout of a cache other than the magic number.
+   Returns false if it would be too big to address. */
+static bool make_header(MeshCacheHeader * const header,
+                        const VertexIndex nvertices, const int ngroups,
+                        const uint64_t nprimitives)
+{
+  assert(header != NULL);
+  assert(nvertices >= 0);
+  assert(ngroups >= 0);
+
+  memcpy(header->magic, cache_magic, sizeof(header->magic));
+  header->version = CACHE_VERSION;
+  header->byte_order = CACHE_BYTE_ORDER;
+  header->coord_size = sizeof(Coord);
+  header->vertex_size = sizeof(Vertex);
+  header->primitive_size = sizeof(Primitive);
+  header->index_size = sizeof(VertexIndex);
+  header->ngroups = ngroups;
+  header->max_sides = PRIMITIVE_MAX_SIDES;
+  header->nvertices = nvertices;
+
+  header->vertices_offset = align_offset(sizeof(*header) +
+                                         sizeof(int32_t) * (uint64_t)ngroups);
+  if ((uint64_t)nvertices > (SIZE_MAX - header->vertices_offset -
+                             CACHE_ALIGN) / sizeof(Vertex)) {
+    DEBUGF("Too many vertices (%"PVERTEXINDEX") to cache\n", nvertices);
+    return false;
+  }
+  header->primitives_offset = align_offset(header->vertices_offset +
+                                           sizeof(Vertex) *
+                                           (uint64_t)nvertices);
+
+  if (nprimitives > (SIZE_MAX - header->primitives_offset) /
+                    sizeof(Primitive)) {
+    DEBUGF("Too many primitives (%llu) to cache\n",
+           (unsigned long long)nprimitives);
+    return false;
+  }
+  header->size = header->primitives_offset + sizeof(Primitive) * nprimitives;
+  return true;
+}
+
+static bool write_padding(FILE * const out, const uint64_t pos,
+                          const uint64_t offset)
+{
+  static const char zeros[CACHE_ALIGN];
+  assert(offset >= pos);
+  assert(offset - pos <= sizeof(zeros));
+  const size_t n = (size_t)(offset - pos);
+  return fwrite(zeros, 1, n, out) == n;
+}
+
+/* Records are copied member by member into zeroed memory before being
+   written, so that the same mesh always gives the same file. */
+static bool write_vertices(FILE * const out, const Vertex * const vertices,
+                           const VertexIndex nvertices)
+{
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    Vertex copy;
+    memset(&copy, 0, sizeof(copy));
+    memcpy(copy.coords, vertices[v].coords, sizeof(copy.coords));
+    copy.id = vertices[v].id;
+    copy.dup = vertices[v].dup;
+    copy.marked = vertices[v].marked;
+    if (fwrite(&copy, sizeof(copy), 1, out) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool write_primitives(FILE * const out,
+                             const Primitive * const primitives,
+                             const size_t nprimitives)
+{
+  for (size_t p = 0; p < nprimitives; ++p) {
+    const Primitive * const pp = &primitives[p];
+    Primitive copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.colour = pp->colour;
+    copy.id = pp->id;
+    copy.nsides = pp->nsides;
+    copy.has_normal = pp->has_normal;
+    copy.plane_z = pp->plane_z;
+    if (pp->has_normal) {
+      memcpy(copy.normal, pp->normal, sizeof(copy.normal));
+    }
+#if BBOX
+    copy.has_bbox = pp->has_bbox;
+    if (pp->has_bbox) {
+      memcpy(copy.low, pp->low, sizeof(copy.low));
+      memcpy(copy.high, pp->high, sizeof(copy.high));
+    }
+#endif
+    if ((pp->nsides > 0) && ((size_t)pp->nsides <= ARRAY_SIZE(pp->sides))) {
+      memcpy(copy.sides, pp->sides, sizeof(pp->sides[0]) * (size_t)pp->nsides);
+    }
+    if (fwrite(&copy, sizeof(copy), 1, out) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool mesh_cache_write(FILE * const out, const VertexArray * const varray,
+                      Group const * const groups, const int ngroups)
+{
+  assert(out != NULL);
+  assert(!ferror(out));
+  assert(varray != NULL);
+  assert(varray->base == NULL);
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+
+  const VertexIndex nvertices = vertex_array_get_num_vertices(varray);
+  uint64_t nprimitives = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    nprimitives += (uint64_t)group_get_num_primitives(groups + g);
+  }
+
+  MeshCacheHeader header;
+  if (!make_header(&header, nvertices, ngroups, nprimitives)) {
+    return false;
+  }
+
+  DEBUGF("Writing cache of %"PVERTEXINDEX" vertices and %llu primitives "
+         "in %d groups\n",
+         nvertices, (unsigned long long)nprimitives, ngroups);
+
+  if (fwrite(&header, sizeof(header), 1, out) != 1) {
+    return false;
+  }
+
+  for (int g = 0; g < ngroups; ++g) {
+    const int32_t count = group_get_num_primitives(groups + g);
+    if (fwrite(&count, sizeof(count), 1, out) != 1) {
+      return false;
+    }
+  }
+
+  if (!write_padding(out, sizeof(header) + sizeof(int32_t) * (uint64_t)ngroups,
+                     header.vertices_offset)) {
+    return false;
+  }
+
+  if (!write_vertices(out, varray->vertices, nvertices)) {
+    return false;
+  }
+
+  if (!write_padding(out, header.vertices_offset +
+                          sizeof(Vertex) * (uint64_t)nvertices,
+                     header.primitives_offset)) {
+    return false;
+  }
+
+  /* Write the primitives before and after the gap without reordering */
+  for (int g = 0; g < ngroups; ++g) {
+    const Group * const group = groups + g;
+    const size_t nbefore = (size_t)group->gap;
+    const size_t nafter = (size_t)(group->nprimitives - group->gap);
+
+    if (!write_primitives(out, group->primitives, nbefore) ||
+        !write_primitives(out, group->primitives + group->gap +
+                               (group->nalloc - group->nprimitives),
+                          nafter)) {
+      return false;
+    }
+  }
+
+  return !ferror(out);
+}
+
+static bool source_read(CacheSource * const src, void * const dst,
+                        const size_t n)
+{
+  assert(src != NULL);
+  assert(dst != NULL || n == 0);
+
+  if (n == 0) {
+    return true;
+  }
+
+  if (src->in != NULL) {
+    if (fread(dst, 1, n, src->in) != n) {
+      DEBUGF("Failed to read %zu bytes of cache\n", n);
+      return false;
+    }
+  } else {
+    if (n > src->size - src->pos) {
+      DEBUGF("Cache is truncated at %zu bytes\n", src->size);
+      return false;
+    }
+    memcpy(dst, src->data + src->pos, n);
+  }
+  src->pos += n;
+  return true;
+}
+
+static bool source_skip(CacheSource * const src, const uint64_t offset)
+{
+  assert(src != NULL);
+  assert(offset >= src->pos);
+  assert(offset - src->pos <= CACHE_ALIGN);
+
+  char padding[CACHE_ALIGN];
+  return source_read(src, padding, (size_t)(offset - src->pos));
+}
+
+static bool check_header(const MeshCacheHeader * const header,
+                         const int ngroups)
+{
+  assert(header != NULL);
+
+  if (memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0) {
+    DEBUGF("Not a cache\n");
+    return false;
+  }
+
+  if ((header->version != CACHE_VERSION) ||
+      (header->byte_order != CACHE_BYTE_ORDER) ||
+      (header->coord_size != sizeof(Coord)) ||
+      (header->vertex_size != sizeof(Vertex)) ||
+      (header->primitive_size != sizeof(Primitive)) ||
+      (header->index_size != sizeof(VertexIndex)) ||
+      (header->max_sides != PRIMITIVE_MAX_SIDES)) {
+    DEBUGF("Cache version %u was written by an incompatible build\n",
+           (unsigned)header->version);
+    return false;
+  }
+
+  if (header->ngroups != ngroups) {
+    DEBUGF("Cache has %d groups instead of %d\n", (int)header->ngroups,
+           ngroups);
+    return false;
+  }
+
+  if ((header->nvertices < 0) || (header->nvertices > VERTEX_INDEX_MAX)) {
+    DEBUGF("Bad vertex count %lld in cache\n",
+           (long long)header->nvertices);
+    return false;
+  }
+
+  return true;
+}
+
+/* Flags are loaded without conversion, so check that they hold one of the
+   two values of a bool before reading them as a bool. */
+static bool is_bool(const bool * const flag)
+{
+  static const bool values[] = {false, true};
+  for (size_t i = 0; i < ARRAY_SIZE(values); ++i) {
+    if (!memcmp(flag, &values[i], sizeof(*flag))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool check_vertices(const VertexArray * const varray)
+{
+  const VertexIndex nvertices = vertex_array_get_num_vertices(varray);
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    const Vertex * const vertex = vertex_array_get_vertex(varray, v);
+    if ((vertex->dup < -1) || (vertex->dup >= nvertices) ||
+        !is_bool(&vertex->marked)) {
+      DEBUGF("Bad duplicate %"PVERTEXINDEX" or flag of vertex %"PVERTEXINDEX
+             " in cache\n", vertex->dup, v);
+      return false;
+    }
+
+    /* IDs are used as indices when vertices are renumbered */
+    if ((vertex->id < 0) || (vertex->id >= nvertices)) {
+      DEBUGF("Bad ID %"PVERTEXINDEX" of vertex %"PVERTEXINDEX" in cache\n",
+             vertex->id, v);
+      return false;
+    }
+  }
+
+  /* Every chain of links from duplicates must end at an original,
+     otherwise following it would never finish */
+  enum { Unchecked, Checking, Checked };
+  unsigned char * const state = calloc((size_t)HIGHEST(nvertices, 1),
+                                       sizeof(*state));
+  if (state == NULL) {
+    DEBUGF("Failed to allocate memory to check duplicates\n");
+    return false;
+  }
+
+  bool success = true;
+  for (VertexIndex v = 0; success && (v < nvertices); ++v) {
+    VertexIndex w = v;
+    while ((w >= 0) && (state[w] == Unchecked)) {
+      state[w] = Checking;
+      w = vertex_array_get_vertex(varray, w)->dup;
+    }
+    if ((w >= 0) && (state[w] == Checking)) {
+      DEBUGF("Duplicate of vertex %"PVERTEXINDEX" is in a loop in cache\n",
+             w);
+      success = false;
+    }
+    for (w = v; (w >= 0) && (state[w] == Checking);
+         w = vertex_array_get_vertex(varray, w)->dup) {
+      state[w] = Checked;
+    }
+  }
+  free(state);
+  return success;
+}
+
+static bool check_primitives(const Group * const group,
+                             const VertexIndex nvertices)
+{
+  const int nprimitives = group_get_num_primitives(group);
+
+  for (int p = 0; p < nprimitives; ++p) {
+    const Primitive * const pp = group_get_primitive(group, p);
+    /* Don't use primitive_get_num_sides because it asserts that the
+       count is valid. Points and lines are primitives too. */
+    const int nsides = pp->nsides;
+    if ((nsides < 1) || ((size_t)nsides > ARRAY_SIZE(pp->sides))) {
+      DEBUGF("Bad side count %d of primitive %d in cache\n", nsides, p);
+      return false;
+    }
+
+    if (!is_bool(&pp->has_normal) ||
+#if BBOX
+        !is_bool(&pp->has_bbox) ||
+#endif
+        (pp->has_normal && (pp->plane_z > 2))) {
+      DEBUGF("Bad flags or plane of primitive %d in cache\n", p);
+      return false;
+    }
+
+    for (int s = 0; s < nsides; ++s) {
+      const VertexIndex v = primitive_get_side(pp, s);
+      if ((v < 0) || (v >= nvertices)) {
+        DEBUGF("Bad vertex %"PVERTEXINDEX" of primitive %d in cache\n",
+               v, p);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool load_groups(CacheSource * const src,
+                        const MeshCacheHeader * const header,
+                        const int32_t * const counts,
+                        VertexArray * const varray,
+                        Group * const groups, const int ngroups)
+{
+  assert(header != NULL);
+  assert(counts != NULL || ngroups == 0);
+
+  vertex_array_clear(varray);
+  if (!source_skip(src, header->vertices_offset) ||
+      !vertex_array_reserve(varray, (VertexIndex)header->nvertices) ||
+      !source_read(src, varray->vertices,
+                   sizeof(Vertex) * (size_t)header->nvertices)) {
+    return false;
+  }
+  varray->nvertices = (VertexIndex)header->nvertices;
+
+  if (!check_vertices(varray) ||
+      !source_skip(src, header->primitives_offset)) {
+    return false;
+  }
+
+  /* Each group is left with its gap after the last primitive */
+  for (int g = 0; g < ngroups; ++g) {
+    Group * const group = groups + g;
+    group_delete_all(group);
+    if (!group_reserve(group, counts[g]) ||
+        !source_read(src, group->primitives,
+                     sizeof(Primitive) * (size_t)counts[g])) {
+      return false;
+    }
+    group->nprimitives = counts[g];
+    group->gap = counts[g];
+
+    if (!check_primitives(group, (VertexIndex)header->nvertices)) {
+      return false;
+    }
+  }
+
+  /* The spatial index must be rebuilt to match the new vertices */
+  return !vertex_array_is_indexed(varray) || vertex_array_enable_index(varray);
+}
+
+static bool load(CacheSource * const src, VertexArray * const varray,
+                 Group * const groups, const int ngroups)
+{
+  assert(src != NULL);
+  assert(varray != NULL);
+  assert(varray->base == NULL);
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+
+  MeshCacheHeader header;
+  if (!source_read(src, &header, sizeof(header)) ||
+      !check_header(&header, ngroups)) {
+    return false;
+  }
+
+  int32_t * const counts = malloc(sizeof(*counts) * (size_t)(ngroups + 1));
+  if (counts == NULL) {
+    DEBUGF("Failed to allocate memory for %d primitive counts\n", ngroups);
+    return false;
+  }
+
+  bool success = source_read(src, counts, sizeof(*counts) * (size_t)ngroups);
+
+  /* Check the layout before allocating memory for vertices and primitives */
+  uint64_t nprimitives = 0;
+  for (int g = 0; success && (g < ngroups); ++g) {
+    if (counts[g] < 0) {
+      DEBUGF("Bad primitive count %d of group %d in cache\n",
+             (int)counts[g], g);
+      success = false;
+    }
+    nprimitives += (uint64_t)counts[g];
+  }
+
+  if (success) {
+    MeshCacheHeader expected;
+    if (!make_header(&expected, (VertexIndex)header.nvertices, ngroups,
+                     nprimitives) ||
+        (header.vertices_offset != expected.vertices_offset) ||
+        (header.primitives_offset != expected.primitives_offset) ||
+        (header.size != expected.size)) {
+      DEBUGF("Bad layout of cache\n");
+      success = false;
+    }
+  }
+
+  if (success) {
+    DEBUGF("Loading cache of %lld vertices and %llu primitives in %d groups\n",
+           (long long)header.nvertices, (unsigned long long)nprimitives,
+           ngroups);
+
+    success = load_groups(src, &header, counts, varray, groups, ngroups);
+  }
+
+  free(counts);
+  return success;
+}
+
+bool mesh_cache_read(FILE * const in, VertexArray * const varray,
+                     Group * const groups, const int ngroups)
+{
+  assert(in != NULL);
+  assert(!ferror(in));
+
+  CacheSource src = {.in = in, .data = NULL, .size = 0, .pos = 0};
+  return load(&src, varray, groups, ngroups);
+}
+
+bool mesh_cache_load(const void * const data, const size_t size,
+                     VertexArray * const varray, Group * const groups,
+                     const int ngroups)
+{
+  assert(data != NULL || size == 0);
+
+  CacheSource src = {.in = NULL, .data = data, .size = size, .pos = 0};
+  return load(&src, varray, groups, ngroups);
+}
@@ -0,0 +1,84 @@
+/*
+ * 3dObjLib: Binary cache of vertices and primitives
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this header file.
+                  The header now records the maximum number of sides.
+                  The header now records the size of a vertex index and
+                  the number of vertices is 64-bit.
+                  mesh_cache_load no longer requires aligned data.
+ */
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Vertex.h"
+#include "Group.h"
+
+/* A cache stores the vertices and groups of primitives exactly as they are
+   held in memory, including the state computed by functions such as
+   vertex_array_find_duplicates, clip_polygons, group_set_used and
+   vertex_array_renumber, so that they can be restored without repeating
+   that work. The format depends on the compiler and machine: a cache
+   written by a different build is rejected rather than misinterpreted.
+
+   The file begins with a MeshCacheHeader, followed by the number of
+   primitives in each group (as int32_t), all of the vertices (as Vertex)
+   and then the primitives of each group in turn (as Primitive). The
+   vertices and primitives start at the given offsets, which are suitably
+   aligned for those types if the file is loaded at an aligned address. */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t coord_size;
+  uint32_t vertex_size;
+  uint32_t primitive_size;
+  uint32_t index_size; /* sizeof(VertexIndex) */
+  int32_t ngroups;
+  int32_t max_sides; /* PRIMITIVE_MAX_SIDES */
+  int64_t nvertices;
+  uint64_t vertices_offset;
+  uint64_t primitives_offset;
+  uint64_t size; /* of the whole cache */
+} MeshCacheHeader;
+
+bool mesh_cache_write(FILE *out, const VertexArray *varray,
+                      Group const *groups, int ngroups);
+
+/* Replaces the contents of varray and of each of the ngroups groups with
+   those read from a cache, which must contain the same number of groups.
+   Any spatial index is rebuilt. Returns false if the cache is invalid or
+   there is not enough memory, in which case the contents of varray and
+   groups are undefined (but can be freed). */
+bool mesh_cache_read(FILE *in, VertexArray *varray,
+                     Group *groups, int ngroups);
+
+/* Same as mesh_cache_read except that the cache has already been loaded
+   into memory (or mapped) at data. The vertices and primitives are copied
+   from it, so it needn't be aligned. */
+bool mesh_cache_load(const void *data, size_t size, VertexArray *varray,
+                     Group *groups, int ngroups);
+
+#endif /* MESHCACHE_H */
@@ -0,0 +1,652 @@
+/*
+ * 3dObjLib: Ordering of vertices and primitives for rendering
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this source file.
+                  Added mesh_order_by_colour.
+                  Vertex numbers are now of type VertexIndex.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <math.h>
+
+/* Local header files */
+#include "Internal/3dObjMisc.h"
+#include "MeshOrder.h"
+#include "Vertex.h"
+#include "Group.h"
+#include "Primitive.h"
+
+#if MESH_ORDER_CACHE_SIZE <= 3
+#error MESH_ORDER_CACHE_SIZE must be greater than 3
+#endif
+
+/* Scores for vertices in the simulated cache (after Forsyth's "Linear-Speed
+   Vertex Cache Optimisation"). Vertices of the last primitive drawn get a
+   fixed score so that the next primitive doesn't just reuse its newest
+   vertices; older vertices score less the closer they are to being
+   evicted. Vertices used by few remaining primitives get a boost so that
+   no primitive is left isolated. */
+#define LAST_PRIMITIVE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+
+enum {
+  NUM_LAST_VERTICES = 3 /* number given LAST_PRIMITIVE_SCORE */
+};
+
+/* Temporary arrays for reordering one run of primitives at a time, big
+   enough for any run in the groups being reordered. Vertices are numbered
+   locally within a run so that the arrays needn't be as big as the vertex
+   array. */
+typedef struct {
+  const VertexIndex *originals; /* original of every vertex */
+  int *local; /* local number of every vertex, or -1 */
+  VertexIndex *vertex; /* vertex with each local number */
+  int *pstart; /* start of each primitive's local vertices in pverts */
+  int *pverts; /* local vertex numbers of all primitives in the run */
+  int *vstart; /* start of each local vertex's primitives in vprims */
+  int *vlive; /* number of primitives not yet drawn using each vertex */
+  int *vprims; /* primitives using each local vertex */
+  int *cache_pos; /* position of each local vertex in the cache, or -1 */
+  float *vscore;
+  bool *drawn;
+  int *seq;
+  Primitive *tmp;
+} OrderScratch;
+
+static VertexIndex *find_originals(const VertexArray * const varray)
+{
+  const VertexIndex nvertices = vertex_array_get_num_vertices(varray);
+  VertexIndex * const originals = malloc(sizeof(*originals) *
+                                 (size_t)HIGHEST(nvertices, 1));
+  if (originals == NULL) {
+    DEBUGF("Failed to allocate originals of %" PVERTEXINDEX " vertices\n",
+           nvertices);
+    return NULL;
+  }
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    VertexIndex original = v;
+    const Vertex *vertex = vertex_array_get_vertex(varray, v);
+    while ((vertex != NULL) && (vertex->dup >= 0)) {
+      original = vertex->dup;
+      vertex = vertex_array_get_vertex(varray, original);
+    }
+    originals[v] = original;
+  }
+  return originals;
+}
+
+static int get_colour_of(const Primitive * const pp,
+                         int (* const get_colour)(const Primitive *, void *),
+                         void * const arg)
+{
+  return (get_colour != NULL) ? get_colour(pp, arg) :
+                                primitive_get_colour(pp);
+}
+
+static float vertex_score(const int cache_pos, const int live)
+{
+  if (live == 0) {
+    return 0.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_pos >= NUM_LAST_VERTICES) {
+    const float s = 1.0f - (float)(cache_pos - NUM_LAST_VERTICES) /
+                           (MESH_ORDER_CACHE_SIZE - NUM_LAST_VERTICES);
+    score = s * sqrtf(s);
+  } else if (cache_pos >= 0) {
+    score = LAST_PRIMITIVE_SCORE;
+  }
+  return score + VALENCE_BOOST_SCALE / sqrtf((float)live);
+}
+
+static void scratch_free(OrderScratch * const scratch)
+{
+  assert(scratch != NULL);
+  free(scratch->local);
+  free(scratch->vertex);
+  free(scratch->pstart);
+  free(scratch->pverts);
+  free(scratch->vstart);
+  free(scratch->vlive);
+  free(scratch->vprims);
+  free(scratch->cache_pos);
+  free(scratch->vscore);
+  free(scratch->drawn);
+  free(scratch->seq);
+  free(scratch->tmp);
+}
+
+static bool scratch_init(OrderScratch * const scratch,
+                         const VertexIndex * const originals,
+                         const VertexIndex nvertices,
+                         const int max_prims, const int max_sides)
+{
+  assert(scratch != NULL);
+  assert(originals != NULL);
+  const size_t nv = (size_t)HIGHEST(nvertices, 1);
+  const size_t np = (size_t)max_prims + 1;
+  const size_t ns = (size_t)HIGHEST(max_sides, 1);
+
+  *scratch = (OrderScratch){
+    .originals = originals,
+    .local = malloc(sizeof(*scratch->local) * nv),
+    .vertex = malloc(sizeof(*scratch->vertex) * ns),
+    .pstart = malloc(sizeof(*scratch->pstart) * np),
+    .pverts = malloc(sizeof(*scratch->pverts) * ns),
+    .vstart = malloc(sizeof(*scratch->vstart) * (ns + 1)),
+    .vlive = malloc(sizeof(*scratch->vlive) * ns),
+    .vprims = malloc(sizeof(*scratch->vprims) * ns),
+    .cache_pos = malloc(sizeof(*scratch->cache_pos) * ns),
+    .vscore = malloc(sizeof(*scratch->vscore) * ns),
+    .drawn = malloc(sizeof(*scratch->drawn) * np),
+    .seq = malloc(sizeof(*scratch->seq) * np),
+    .tmp = malloc(sizeof(*scratch->tmp) * np),
+  };
+
+  if ((scratch->local == NULL) || (scratch->vertex == NULL) ||
+      (scratch->pstart == NULL) || (scratch->pverts == NULL) ||
+      (scratch->vstart == NULL) || (scratch->vlive == NULL) ||
+      (scratch->vprims == NULL) || (scratch->cache_pos == NULL) ||
+      (scratch->vscore == NULL) || (scratch->drawn == NULL) ||
+      (scratch->seq == NULL) || (scratch->tmp == NULL)) {
+    DEBUGF("Failed to allocate memory to reorder primitives\n");
+    scratch_free(scratch);
+    return false;
+  }
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    scratch->local[v] = -1;
+  }
+  return true;
+}
+
+/* Numbers the vertices used by primitives first..end-1 of a group and
+   builds lists of the vertices of each primitive and the primitives using
+   each vertex. Returns the number of vertices. */
+static int index_run(OrderScratch * const scratch, const Group * const group,
+                     const int first, const int end)
+{
+  assert(scratch != NULL);
+  const int n = end - first;
+  int nverts = 0, nrefs = 0;
+
+  for (int p = 0; p < n; ++p) {
+    const Primitive * const pp = group_get_primitive(group, first + p);
+    assert(pp != NULL);
+    scratch->pstart[p] = nrefs;
+
+    const int nsides = primitive_get_num_sides(pp);
+    for (int s = 0; s < nsides; ++s) {
+      const VertexIndex v = scratch->originals[primitive_get_side(pp, s)];
+      if (scratch->local[v] < 0) {
+        scratch->local[v] = nverts;
+        scratch->vertex[nverts] = v;
+        scratch->vlive[nverts] = 0;
+        ++nverts;
+      }
+      const int i = scratch->local[v];
+      scratch->pverts[nrefs++] = i;
+      ++scratch->vlive[i];
+    }
+  }
+  scratch->pstart[n] = nrefs;
+
+  scratch->vstart[0] = 0;
+  for (int i = 0; i < nverts; ++i) {
+    scratch->vstart[i + 1] = scratch->vstart[i] + scratch->vlive[i];
+    scratch->vlive[i] = 0;
+  }
+
+  for (int p = 0; p < n; ++p) {
+    for (int r = scratch->pstart[p]; r < scratch->pstart[p + 1]; ++r) {
+      const int i = scratch->pverts[r];
+      scratch->vprims[scratch->vstart[i] + scratch->vlive[i]++] = p;
+    }
+  }
+
+  return nverts;
+}
+
+/* Removes primitive p from the list of primitives not yet drawn using each
+   of its vertices. */
+static void remove_drawn(OrderScratch * const scratch, const int p)
+{
+  assert(scratch != NULL);
+  for (int r = scratch->pstart[p]; r < scratch->pstart[p + 1]; ++r) {
+    const int i = scratch->pverts[r];
+    int * const prims = scratch->vprims + scratch->vstart[i];
+    for (int k = 0; k < scratch->vlive[i]; ++k) {
+      if (prims[k] == p) {
+        prims[k] = prims[--scratch->vlive[i]];
+        break;
+      }
+    }
+  }
+}
+
+/* Moves the vertices of primitive p to the front of the simulated cache and
+   updates the scores of all vertices whose positions changed. */
+static void update_cache(OrderScratch * const scratch, const int p,
+                         int (* const cache)[MESH_ORDER_CACHE_SIZE],
+                         int * const ncache)
+{
+  assert(scratch != NULL);
+  assert(cache != NULL);
+  assert(ncache != NULL);
+  int new_cache[MESH_ORDER_CACHE_SIZE + PRIMITIVE_MAX_SIDES];
+  int nnew = 0;
+
+  /* Mark the vertices of p while adding them so that they aren't added
+     again from the old cache */
+  for (int r = scratch->pstart[p]; r < scratch->pstart[p + 1]; ++r) {
+    const int i = scratch->pverts[r];
+    if (scratch->cache_pos[i] != -2) {
+      scratch->cache_pos[i] = -2;
+      new_cache[nnew++] = i;
+    }
+  }
+
+  for (int k = 0; k < *ncache; ++k) {
+    const int i = (*cache)[k];
+    if (scratch->cache_pos[i] != -2) {
+      new_cache[nnew++] = i;
+    }
+  }
+
+  for (int k = 0; k < nnew; ++k) {
+    const int i = new_cache[k];
+    if (k < MESH_ORDER_CACHE_SIZE) {
+      scratch->cache_pos[i] = k;
+      (*cache)[k] = i;
+    } else {
+      scratch->cache_pos[i] = -1;
+    }
+    scratch->vscore[i] = vertex_score(scratch->cache_pos[i],
+                                      scratch->vlive[i]);
+  }
+  *ncache = LOWEST(nnew, MESH_ORDER_CACHE_SIZE);
+}
+
+/* Finds the best primitive to draw next of those using a vertex in the
+   simulated cache, or returns -1 if there is none. */
+static int find_best(const OrderScratch * const scratch,
+                     const int * const cache, const int ncache)
+{
+  assert(scratch != NULL);
+  assert(cache != NULL);
+  int best = -1;
+  float best_score = -1.0f;
+
+  for (int k = 0; k < ncache; ++k) {
+    const int i = cache[k];
+    const int * const prims = scratch->vprims + scratch->vstart[i];
+    for (int j = 0; j < scratch->vlive[i]; ++j) {
+      const int p = prims[j];
+      float score = 0.0f;
+      for (int r = scratch->pstart[p]; r < scratch->pstart[p + 1]; ++r) {
+        score += scratch->vscore[scratch->pverts[r]];
+      }
+      if (score > best_score) {
+        best_score = score;
+        best = p;
+      }
+    }
+  }
+  return best;
+}
+
+static void order_run(OrderScratch * const scratch, Group * const group,
+                      const int first, const int end)
+{
+  assert(scratch != NULL);
+  assert(first <= end);
+  const int n = end - first;
+  if (n < 3) {
+    return;
+  }
+
+  const int nverts = index_run(scratch, group, first, end);
+  for (int i = 0; i < nverts; ++i) {
+    scratch->cache_pos[i] = -1;
+    scratch->vscore[i] = vertex_score(-1, scratch->vlive[i]);
+  }
+  for (int p = 0; p < n; ++p) {
+    scratch->drawn[p] = false;
+  }
+
+  int cache[MESH_ORDER_CACHE_SIZE];
+  int ncache = 0, best = -1, next = 0;
+
+  for (int k = 0; k < n; ++k) {
+    if (best < 0) {
+      /* Start again from the first primitive not yet drawn */
+      while (scratch->drawn[next]) {
+        ++next;
+      }
+      best = next;
+    }
+
+    scratch->seq[k] = best;
+    scratch->drawn[best] = true;
+    remove_drawn(scratch, best);
+    update_cache(scratch, best, &cache, &ncache);
+    best = find_best(scratch, cache, ncache);
+  }
+
+  for (int i = 0; i < nverts; ++i) {
+    scratch->local[scratch->vertex[i]] = -1;
+  }
+
+  for (int k = 0; k < n; ++k) {
+    scratch->tmp[k] = *group_get_primitive(group, first + scratch->seq[k]);
+  }
+  for (int k = 0; k < n; ++k) {
+    *group_get_primitive(group, first + k) = scratch->tmp[k];
+  }
+
+  DEBUGF("Reordered primitives %d..%d of group %p\n", first, end - 1,
+         (void *)group);
+}
+
+typedef struct {
+  int key; /* colour, or the first primitive of the same colour */
+  int p;
+} ColourKey;
+
+static int compare_keys(const void * const a, const void * const b)
+{
+  const ColourKey * const key_a = a, * const key_b = b;
+  if (key_a->key != key_b->key) {
+    return (key_a->key < key_b->key) ? -1 : 1;
+  }
+  /* Positions are unique, which makes the sort stable */
+  return (key_a->p > key_b->p) - (key_a->p < key_b->p);
+}
+
+static void sort_group_by_colour(Group * const group, ColourKey * const keys,
+                                 Primitive * const tmp,
+                                 int (* const get_colour)(const Primitive *,
+                                                          void *),
+                                 void * const arg)
+{
+  assert(keys != NULL);
+  assert(tmp != NULL);
+  const int nprimitives = group_get_num_primitives(group);
+
+  bool sorted = true;
+  for (int p = 0; p < nprimitives; ++p) {
+    keys[p] = (ColourKey){
+      .key = get_colour_of(group_get_primitive(group, p), get_colour, arg),
+      .p = p,
+    };
+    if ((p > 0) && (keys[p].key != keys[p - 1].key)) {
+      sorted = false;
+    }
+  }
+  if (sorted) {
+    return;
+  }
+
+  /* Sort by colour, then replace each colour by the position of the first
+     primitive of that colour and sort again to keep colours in order of
+     first appearance */
+  qsort(keys, (size_t)nprimitives, sizeof(*keys), compare_keys);
+  int colour = 0, first = 0;
+  for (int k = 0; k < nprimitives; ++k) {
+    if ((k == 0) || (keys[k].key != colour)) {
+      colour = keys[k].key;
+      first = keys[k].p;
+    }
+    keys[k].key = first;
+  }
+  qsort(keys, (size_t)nprimitives, sizeof(*keys), compare_keys);
+
+  for (int p = 0; p < nprimitives; ++p) {
+    tmp[p] = *group_get_primitive(group, keys[p].p);
+  }
+  for (int p = 0; p < nprimitives; ++p) {
+    *group_get_primitive(group, p) = tmp[p];
+  }
+
+  DEBUGF("Sorted %d primitives of group %p by colour\n", nprimitives,
+         (void *)group);
+}
+
+bool mesh_order_by_colour(
+        Group * const groups, const int ngroups,
+        int (* const get_colour)(const Primitive *pp, void *arg),
+        void * const arg)
+{
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+
+  int max_prims = 1;
+  for (int g = 0; g < ngroups; ++g) {
+    max_prims = HIGHEST(max_prims, group_get_num_primitives(&groups[g]));
+  }
+
+  ColourKey * const keys = malloc(sizeof(*keys) * (size_t)max_prims);
+  Primitive * const tmp = malloc(sizeof(*tmp) * (size_t)max_prims);
+  if ((keys == NULL) || (tmp == NULL)) {
+    DEBUGF("Failed to allocate memory to sort %d primitives\n", max_prims);
+    free(tmp);
+    free(keys);
+    return false;
+  }
+
+  for (int g = 0; g < ngroups; ++g) {
+    sort_group_by_colour(&groups[g], keys, tmp, get_colour, arg);
+  }
+
+  free(tmp);
+  free(keys);
+  return true;
+}
+
+bool mesh_order_primitives(
+        Group * const groups, const int ngroups,
+        const VertexArray * const varray,
+        int (* const get_colour)(const Primitive *pp, void *arg),
+        void * const arg)
+{
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+  assert(varray != NULL);
+
+  int max_prims = 0, max_sides = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprimitives = group_get_num_primitives(&groups[g]);
+    int nsides = 0;
+    for (int p = 0; p < nprimitives; ++p) {
+      nsides += primitive_get_num_sides(group_get_primitive(&groups[g], p));
+    }
+    max_prims = HIGHEST(max_prims, nprimitives);
+    max_sides = HIGHEST(max_sides, nsides);
+  }
+
+  VertexIndex * const originals = find_originals(varray);
+  if (originals == NULL) {
+    return false;
+  }
+
+  OrderScratch scratch;
+  if (!scratch_init(&scratch, originals, vertex_array_get_num_vertices(varray),
+                    max_prims, max_sides)) {
+    free(originals);
+    return false;
+  }
+
+  for (int g = 0; g < ngroups; ++g) {
+    Group * const group = &groups[g];
+    const int nprimitives = group_get_num_primitives(group);
+
+    /* Find each run of primitives of the same colour */
+    for (int first = 0, end; first < nprimitives; first = end) {
+      const int colour = get_colour_of(group_get_primitive(group, first),
+                                       get_colour, arg);
+      for (end = first + 1; end < nprimitives; ++end) {
+        if (get_colour_of(group_get_primitive(group, end), get_colour,
+                          arg) != colour) {
+          break;
+        }
+      }
+      order_run(&scratch, group, first, end);
+    }
+  }
+
+  scratch_free(&scratch);
+  free(originals);
+  return true;
+}
+
+bool mesh_order_vertices(VertexArray * const varray, Group * const groups,
+                         const int ngroups, const VertexIndex rot)
+{
+  assert(varray != NULL);
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+
+  const VertexIndex nvertices = vertex_array_get_num_vertices(varray);
+  if (nvertices == 0) {
+    return true;
+  }
+
+  VertexIndex * const originals = find_originals(varray);
+  VertexIndex * const where = malloc(sizeof(*where) * (size_t)nvertices);
+  VertexIndex * const order = malloc(sizeof(*order) * (size_t)nvertices);
+  if ((originals == NULL) || (where == NULL) || (order == NULL)) {
+    DEBUGF("Failed to allocate memory to reorder %" PVERTEXINDEX
+           " vertices\n", nvertices);
+    free(order);
+    free(where);
+    free(originals);
+    return false;
+  }
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    where[v] = -1;
+  }
+
+  /* Vertices below rot are numbered from 0 and the rest from rot */
+  const VertexIndex nlow = rot < 0 ? 0 : LOWEST(rot, nvertices);
+  VertexIndex next[2] = {0, nlow};
+
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprimitives = group_get_num_primitives(&groups[g]);
+    for (int p = 0; p < nprimitives; ++p) {
+      const Primitive * const pp = group_get_primitive(&groups[g], p);
+      const int nsides = primitive_get_num_sides(pp);
+      for (int s = 0; s < nsides; ++s) {
+        /* The original is output in place of a duplicate, so it is the
+           original that must be numbered in order of first use */
+        const VertexIndex v = primitive_get_side(pp, s);
+        const VertexIndex used[2] = {originals[v], v};
+        for (size_t u = 0; u < ARRAY_SIZE(used); ++u) {
+          if (where[used[u]] < 0) {
+            where[used[u]] = next[used[u] >= nlow]++;
+          }
+        }
+      }
+    }
+  }
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    if (where[v] < 0) {
+      where[v] = next[v >= nlow]++;
+    }
+    order[where[v]] = v;
+  }
+  assert(next[0] == nlow);
+  assert(next[1] == nvertices);
+
+  const bool success = vertex_array_reorder(varray, order);
+  if (success) {
+    for (int g = 0; g < ngroups; ++g) {
+      const int nprimitives = group_get_num_primitives(&groups[g]);
+      for (int p = 0; p < nprimitives; ++p) {
+        Primitive * const pp = group_get_primitive(&groups[g], p);
+        const int nsides = primitive_get_num_sides(pp);
+        for (int s = 0; s < nsides; ++s) {
+          (void)primitive_set_side(pp, s, where[primitive_get_side(pp, s)]);
+        }
+      }
+    }
+  }
+
+  free(order);
+  free(where);
+  free(originals);
+  return success;
+}
+
+double mesh_order_get_acmr(Group const * const groups, const int ngroups,
+                           const VertexArray * const varray,
+                           const int cache_size)
+{
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+  assert(cache_size > 0);
+
+  const VertexIndex nvertices = vertex_array_get_num_vertices(varray);
+  VertexIndex * const originals = find_originals(varray);
+  /* Number of vertices added to the cache before each vertex, or -1 */
+  long long * const added = malloc(sizeof(*added) *
+                                   (size_t)HIGHEST(nvertices, 1));
+  if ((originals == NULL) || (added == NULL)) {
+    DEBUGF("Failed to allocate memory to simulate a vertex cache\n");
+    free(added);
+    free(originals);
+    return -1.0;
+  }
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    added[v] = -1;
+  }
+
+  long long nadded = 0, ntriangles = 0;
+  for (int g = 0; g < ngroups; ++g) {
+    const int nprimitives = group_get_num_primitives(&groups[g]);
+    for (int p = 0; p < nprimitives; ++p) {
+      const Primitive * const pp = group_get_primitive(&groups[g], p);
+      const int nsides = primitive_get_num_sides(pp);
+
+      /* Triangles are drawn in the same order as MeshStyle_TriangleFan */
+      for (int s = 1; s < nsides - 1; ++s) {
+        const int tri[3] = {0, s, s + 1};
+        for (size_t t = 0; t < ARRAY_SIZE(tri); ++t) {
+          const VertexIndex v = originals[primitive_get_side(pp, tri[t])];
+          if ((added[v] < 0) || (nadded - added[v] > cache_size)) {
+            added[v] = nadded++;
+          }
+        }
+        ++ntriangles;
+      }
+    }
+  }
+
+  free(added);
+  free(originals);
+  return ntriangles > 0 ? (double)nadded / ntriangles : 0.0;
+}
@@ -0,0 +1,91 @@
+/*
+ * 3dObjLib: Ordering of vertices and primitives for rendering
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this header file.
+                  Added mesh_order_by_colour.
+                  Vertex numbers are now of type VertexIndex.
+ */
+
+#ifndef MESHORDER_H
+#define MESHORDER_H
+
+#include <stdbool.h>
+
+#include "Vertex.h"
+#include "Group.h"
+#include "Primitive.h"
+
+/* Number of vertices assumed to be held by the post-transform vertex cache
+   of the renderer that will draw the output. */
+#ifndef MESH_ORDER_CACHE_SIZE
+#define MESH_ORDER_CACHE_SIZE 32
+#endif
+
+/* These functions are an optional stage between clip_polygons and
+   output_primitives which reorders the output to suit renderers with a
+   post-transform vertex cache. Duplicate vertices are treated as the
+   original vertex that will be output in their place, so
+   vertex_array_find_duplicates (if used) should be called first. */
+
+/* Sorts the primitives of each group by colour, so that output_primitives
+   changes material as few times as possible. Colours are sorted in order of
+   first appearance in each group and the order of primitives of the same
+   colour is kept. This must not be done before clip_polygons, which assumes
+   that the primitives of a group are drawn in the order they were added,
+   but it's harmless afterwards because no primitives of a group overlap.
+   get_colour and arg are as for output_primitives. Any ClipHistory of the
+   groups becomes invalid. Returns false if there is not enough memory, in
+   which case some groups may not have been sorted. */
+bool mesh_order_by_colour(
+        Group *groups, int ngroups,
+        int (*get_colour)(const Primitive *pp, void *arg), void *arg);
+
+/* Reorders the primitives of each group so that primitives sharing
+   vertices are close together, using a greedy algorithm which simulates a
+   vertex cache of MESH_ORDER_CACHE_SIZE vertices. Primitives are only
+   moved within a run of consecutive primitives of the same colour, so the
+   groups and the materials selected by output_primitives are output in
+   the same order as before. get_colour and arg are as for
+   output_primitives. Any ClipHistory of the groups becomes invalid.
+   Returns false if there is not enough memory, in which case some groups
+   may not have been reordered. */
+bool mesh_order_primitives(
+        Group *groups, int ngroups, const VertexArray *varray,
+        int (*get_colour)(const Primitive *pp, void *arg), void *arg);
+
+/* Reorders vertices so that they are output in the order in which they are
+   first used by the primitives of the groups (in group order), followed by
+   any vertices which aren't used. The sides of the primitives are updated.
+   Vertices numbered below rot remain below it, so that the same value of
+   rot can be passed to output_vertices. vertex_array_renumber must be
+   called afterwards. Returns false if there is not enough memory, in which
+   case nothing is changed. */
+bool mesh_order_vertices(VertexArray *varray, Group *groups, int ngroups,
+                         VertexIndex rot);
+
+/* Simulates a first-in first-out vertex cache of cache_size vertices as
+   the primitives of the groups are drawn as triangles, and returns the
+   average number of cache misses per triangle (0 if there are no
+   triangles or negative if there is not enough memory). Lower is better:
+   the minimum is about 0.5 for big regular meshes and the maximum is 3. */
+double mesh_order_get_acmr(Group const *groups, int ngroups,
+                           const VertexArray *varray, int cache_size);
+
+#endif /* MESHORDER_H */
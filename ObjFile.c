@@ -20,6 +20,18 @@
 /* History:
   CJB: 05-Aug-18: Copied this source file from SF3KtoObj.
   CJB: 21-Apr-20: Fixed bad output in the form of "# 1 vertice".
+  CJB: 14-Oct-26: Output is now formatted into a buffer without using
+                  printf for numbers, which is much faster.
+                  Added output_vertices_to and output_primitives_to, which
+                  write to a Writer instead of a FILE.
+                  Added output_vertices_parallel and
+                  output_primitives_parallel.
+                  Vertex IDs are read from a table built when vertices are
+                  renumbered, if possible.
+                  Material names are remembered for each colour instead of
+                  being got every time the material changes.
+                  Vertex numbers and counts are now of type VertexIndex.
+                  Include Spawn.h instead of Clip.h.
  */
 
 /* ISO library header files */
@@ -27,6 +39,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <limits.h>
+#include <stdlib.h>
 
 /* Local header files */
 #include "Internal/3dObjMisc.h"
@@ -34,16 +47,70 @@
 #include "Coord.h"
 #include "Vertex.h"
 #include "Primitive.h"
+#include "Writer.h"
+#include "Spawn.h"
 
-static int convert_vnum(const VertexArray * const varray, int v,
-                        const int vtotal, const int vobject,
-                        const VertexStyle vstyle)
+enum {
+  /* Number of vertices or primitives formatted by each thread at once */
+  OUTPUT_CHUNK_SIZE = 4096,
+  /* Number of material names remembered (indexed by colour) */
+  MATERIAL_CACHE_SIZE = 64,
+  MATERIAL_NAME_SIZE = 64
+};
+
+typedef struct {
+  const char *object_name;
+  VertexIndex vtotal;
+  VertexIndex vobject;
+  const VertexArray *varray;
+  VertexIndex rot;
+  Group const *groups;
+  int (*get_colour)(const Primitive *pp, void *arg);
+  int (*get_material)(char *buf, size_t buf_size, int colour, void *arg);
+  void *arg;
+  VertexStyle vstyle;
+  MeshStyle mstyle;
+} OutputParams;
+
+typedef struct {
+  bool valid;
+  int colour;
+  char name[MATERIAL_NAME_SIZE];
+} MaterialEntry;
+
+/* Names of recently used materials, to avoid getting the name every time
+   the material changes */
+typedef struct {
+  MaterialEntry entries[MATERIAL_CACHE_SIZE];
+} MaterialCache;
+
+/* Text formatted by one thread, for concatenation in order */
+typedef struct {
+  const OutputParams *params;
+  MaterialCache materials;
+  Writer writer;
+  WriterMemory mem;
+  bool success;
+  int group; /* -1 for vertices */
+  VertexIndex first; /* vertex or primitive number */
+  VertexIndex end;
+  int last_colour;
+} OutputThread;
+
+/* remap is the table of vertex IDs for varray, or NULL if out of date. */
+static VertexIndex convert_vnum(const VertexArray * const varray,
+                                const VertexIndex * const remap,
+                                VertexIndex v, const VertexIndex vtotal,
+                                const VertexIndex vobject,
+                                const VertexStyle vstyle)
 {
   assert(varray != NULL);
   assert(vtotal >= 0);
   assert(vobject > 0);
+  assert(remap == vertex_array_get_remap(varray));
 
-  const int id = vertex_array_get_id(varray, v);
+  const VertexIndex id = (remap != NULL) ? remap[v] :
+                         vertex_array_get_id(varray, v);
   if (vstyle == VertexStyle_Negative) {
     assert(id <= vobject);
     v = - (vobject - id);
@@ -54,42 +121,40 @@ static int convert_vnum(const VertexArray * const varray, int v,
   return v;
 }
 
-bool output_vertices(FILE * const out, const int vobject,
-                     const VertexArray * const varray,
-                     const int rot)
+static bool write_vertex_range(Writer * const out,
+                               const VertexArray * const varray,
+                               const VertexIndex rot,
+                               const VertexIndex first,
+                               const VertexIndex end)
 {
   assert(out != NULL);
-  assert(!ferror(out));
-  assert(vobject > 0);
+  assert(first >= 0);
+  assert(end <= vertex_array_get_num_vertices(varray));
 
-  if (fprintf(out, "\n# %d vertices\n", vobject) < 0) {
-    return false;
-  }
-
-  const int nvertices = vertex_array_get_num_vertices(varray);
-  for (int v = 0; v < nvertices; ++v) {
-    if ((v == rot) && fputs("# Following vertices rotate\n", out) == EOF) {
+  for (VertexIndex v = first; v < end; ++v) {
+    if ((v == rot) && !writer_puts(out, "# Following vertices rotate\n")) {
       return false;
     }
 
     Coord (* const coords)[3] = vertex_array_get_coords(varray, v);
 
     if (!vertex_array_is_used(varray, v)) {
-      DEBUGF("Omitting vertex %d {%"PCOORD",%"PCOORD",%"PCOORD"} "
+      DEBUGF("Omitting vertex %"PVERTEXINDEX
+             " {%"PCOORD",%"PCOORD",%"PCOORD"} "
              "from the output\n",
              v, (*coords)[0], (*coords)[1], (*coords)[2]);
       continue;
     }
 
-    if (fputs("v", out) == EOF) {
+    if (!writer_puts(out, "v")) {
       return false;
     }
     for (size_t dim = 0; dim < ARRAY_SIZE(*coords); ++dim) {
-      if (fprintf(out, " %f", (*coords)[dim]) < 0) {
+      if (!writer_puts(out, " ") || !writer_put_coord(out, (*coords)[dim])) {
         return false;
       }
     }
-    if (fputs("\n", out) == EOF) {
+    if (!writer_puts(out, "\n")) {
       return false;
     }
   }
@@ -97,23 +162,54 @@ bool output_vertices(FILE * const out, const int vobject,
   return true;
 }
 
-static bool output_primitive(FILE * const out, const Primitive * const pp,
-                           const int vtotal, const int vobject,
-                           const VertexArray * const varray,
-                           const VertexStyle vstyle,
-                           const MeshStyle mstyle)
+bool output_vertices_to(Writer * const out, const VertexIndex vobject,
+                        const VertexArray * const varray,
+                        const VertexIndex rot)
+{
+  assert(out != NULL);
+  assert(vobject > 0);
+
+  return writer_puts(out, "\n# ") && writer_put_int(out, vobject) &&
+         writer_puts(out, " vertices\n") &&
+         write_vertex_range(out, varray, rot, 0,
+                            vertex_array_get_num_vertices(varray));
+}
+
+bool output_vertices(FILE * const out, const VertexIndex vobject,
+                     const VertexArray * const varray,
+                     const VertexIndex rot)
 {
   assert(out != NULL);
   assert(!ferror(out));
+
+  Writer writer;
+  writer_init_file(&writer, out);
+  const bool success = output_vertices_to(&writer, vobject, varray, rot) &&
+                       writer_flush(&writer);
+  writer_free(&writer);
+  return success;
+}
+
+static bool write_primitive(Writer * const out, const Primitive * const pp,
+                            const VertexIndex vtotal,
+                            const VertexIndex vobject,
+                            const VertexArray * const varray,
+                            const VertexIndex * const remap,
+                            const VertexStyle vstyle,
+                            const MeshStyle mstyle)
+{
+  assert(out != NULL);
   assert(vtotal >= 0);
   assert(vobject > 0);
 
   const int nsides = primitive_get_num_sides(pp);
   if ((nsides > 3) && (mstyle != MeshStyle_NoChange)) {
-    int s, v[3] = {0, 0, 0};
+    int s;
+    VertexIndex v[3] = {0, 0, 0};
     for (s = 0; s < 2; ++s) {
       v[s] = convert_vnum(
-               varray, primitive_get_side(pp, s), vtotal, vobject, vstyle);
+               varray, remap, primitive_get_side(pp, s), vtotal, vobject,
+               vstyle);
     }
 
     for (; s < nsides; ++s) {
@@ -134,9 +230,9 @@ static bool output_primitive(FILE * const out, const Primitive * const pp,
 
       /* Replace the first or third vertex (always replace the third
          when making triangle fans) */
-      const int vnext = convert_vnum(
-                          varray, primitive_get_side(pp, sindex), vtotal,
-                          vobject, vstyle);
+      const VertexIndex vnext = convert_vnum(
+                          varray, remap, primitive_get_side(pp, sindex),
+                          vtotal, vobject, vstyle);
       if ((mstyle == MeshStyle_TriangleFan) || !(s % 2)) {
         v[2] = vnext;
       } else {
@@ -144,15 +240,15 @@ static bool output_primitive(FILE * const out, const Primitive * const pp,
         v[0] = vnext;
       }
 
-      if (fputs("f", out) == EOF) {
+      if (!writer_puts(out, "f")) {
         return false;
       }
       for (size_t ts = 0; ts < ARRAY_SIZE(v); ++ts) {
-        if (fprintf(out, " %d", v[ts]) < 0) {
+        if (!writer_puts(out, " ") || !writer_put_int(out, v[ts])) {
           return false;
         }
       }
-      if (fputs("\n", out) == EOF) {
+      if (!writer_puts(out, "\n")) {
         return false;
       }
 
@@ -174,27 +270,178 @@ static bool output_primitive(FILE * const out, const Primitive * const pp,
       primitive_type = "f";
       break;
     }
-    if (fputs(primitive_type, out) == EOF) {
+    if (!writer_puts(out, primitive_type)) {
       return false;
     }
     for (int s = 0; s < nsides; ++s) {
-      const int v = convert_vnum(
-                      varray, primitive_get_side(pp, s),
+      const VertexIndex v = convert_vnum(
+                      varray, remap, primitive_get_side(pp, s),
                       vtotal, vobject, vstyle);
-      if (fprintf(out, " %d", v) < 0) {
+      if (!writer_puts(out, " ") || !writer_put_int(out, v)) {
         return false;
       }
     } /* next side */
-    if (fputs("\n", out) == EOF) {
+    if (!writer_puts(out, "\n")) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static int get_primitive_colour(const OutputParams * const params,
+                                const Primitive * const pp)
+{
+  assert(params != NULL);
+  return (params->get_colour != NULL) ?
+         params->get_colour(pp, params->arg) :
+         primitive_get_colour(pp);
+}
+
+static void material_cache_init(MaterialCache * const materials)
+{
+  assert(materials != NULL);
+  for (size_t e = 0; e < ARRAY_SIZE(materials->entries); ++e) {
+    materials->entries[e].valid = false;
+  }
+}
+
+/* Returns the name of the material for a colour, or NULL on failure. */
+static const char *get_material_name(const OutputParams * const params,
+                                     MaterialCache * const materials,
+                                     const int colour)
+{
+  assert(params != NULL);
+  assert(materials != NULL);
+
+  MaterialEntry * const entry = materials->entries +
+    ((unsigned)colour % ARRAY_SIZE(materials->entries));
+
+  if (!entry->valid || (entry->colour != colour)) {
+    const int n = (params->get_material != NULL) ?
+                  params->get_material(entry->name, sizeof(entry->name),
+                                       colour, params->arg) :
+                  snprintf(entry->name, sizeof(entry->name), "colour_%d",
+                           colour);
+    if (n < 0) {
+      entry->valid = false;
+      return NULL;
+    }
+    entry->valid = true;
+    entry->colour = colour;
+  }
+  return entry->name;
+}
+
+/* last_colour is the colour of the previous primitive output (if any),
+   which is updated. */
+static bool write_primitive_range(Writer * const out,
+                                  const OutputParams * const params,
+                                  const int g, const int first,
+                                  const int end, int * const last_colour,
+                                  MaterialCache * const materials)
+{
+  assert(out != NULL);
+  assert(params != NULL);
+  assert(last_colour != NULL);
+
+  const char * const object_name = params->object_name;
+  const Group *const group = params->groups + g;
+  const int nprimitives = group_get_num_primitives(group);
+  assert(first >= 0);
+  assert(end <= nprimitives);
+  const VertexIndex * const remap = vertex_array_get_remap(params->varray);
+
+  if ((first == 0) && (nprimitives > 0)) {
+    if (!writer_puts(out, "\n# ") || !writer_put_int(out, nprimitives) ||
+        !writer_puts(out, " primitives\n")) {
+      return false;
+    }
+
+    if (!writer_puts(out, "g ") || !writer_puts(out, object_name) ||
+        !writer_puts(out, " ") || !writer_puts(out, object_name) ||
+        !writer_puts(out, "_") || !writer_put_int(out, g) ||
+        !writer_puts(out, "\n")) {
       return false;
     }
   }
 
+  for (int p = first; p < end; ++p) {
+    const Primitive * const pp = group_get_primitive(group, p);
+    int const colour = get_primitive_colour(params, pp);
+
+    if (*last_colour != colour) {
+      const char * const material = get_material_name(params, materials,
+                                                      colour);
+      if (material == NULL) {
+        return false;
+      }
+      if (!writer_puts(out, "usemtl ") || !writer_puts(out, material) ||
+          !writer_puts(out, "\n")) {
+        return false;
+      }
+      *last_colour = colour;
+    }
+
+    if (!write_primitive(out, pp, params->vtotal, params->vobject,
+                         params->varray, remap, params->vstyle,
+                         params->mstyle)) {
+      return false;
+    }
+  } /* next primitive */
+
+  return true;
+}
+
+bool output_primitives_to(Writer * const out,
+                          const char * const object_name,
+                          const VertexIndex vtotal,
+                          const VertexIndex vobject,
+                          const VertexArray * const varray,
+                          Group const * const groups,
+                          int const ngroups,
+                          int (*get_colour)(const Primitive *pp, void *arg),
+                          int (*get_material)(char *buf, size_t buf_size,
+                                              int colour, void *arg),
+                          void *arg, const VertexStyle vstyle,
+                          const MeshStyle mstyle)
+{
+  assert(out != NULL);
+  assert(groups != NULL);
+  assert(vtotal >= 0);
+  assert(vobject > 0);
+
+  const OutputParams params = {
+    .object_name = object_name,
+    .vtotal = vtotal,
+    .vobject = vobject,
+    .varray = varray,
+    .rot = -1,
+    .groups = groups,
+    .get_colour = get_colour,
+    .get_material = get_material,
+    .arg = arg,
+    .vstyle = vstyle,
+    .mstyle = mstyle,
+  };
+
+  MaterialCache materials;
+  material_cache_init(&materials);
+
+  int last_colour = INT_MAX;
+  for (int g = 0; g < ngroups; ++g) {
+    if (!write_primitive_range(out, &params, g, 0,
+                               group_get_num_primitives(groups + g),
+                               &last_colour, &materials)) {
+      return false;
+    }
+  } /* next group */
+
   return true;
 }
 
 bool output_primitives(FILE * const out, const char * const object_name,
-                     const int vtotal, const int vobject,
+                     const VertexIndex vtotal, const VertexIndex vobject,
                      const VertexArray * const varray,
                      Group const * const groups,
                      int const ngroups,
@@ -206,52 +453,202 @@ bool output_primitives(FILE * const out, const char * const object_name,
 {
   assert(out != NULL);
   assert(!ferror(out));
-  assert(groups != NULL);
-  assert(vtotal >= 0);
-  assert(vobject > 0);
 
-  int last_colour = INT_MAX;
-  for (int g = 0; g < ngroups; ++g) {
-    const Group *const group = groups + g;
-    const int nprimitives = group_get_num_primitives(group);
+  Writer writer;
+  writer_init_file(&writer, out);
+  const bool success = output_primitives_to(&writer, object_name, vtotal,
+                                            vobject, varray, groups, ngroups,
+                                            get_colour, get_material, arg,
+                                            vstyle, mstyle) &&
+                       writer_flush(&writer);
+  writer_free(&writer);
+  return success;
+}
 
-    if (nprimitives > 0) {
-      if (fprintf(out, "\n# %d primitives\n", nprimitives) < 0) {
-        return false;
+static void output_thread(void * const arg)
+{
+  OutputThread * const thread = arg;
+  assert(thread != NULL);
+  const OutputParams * const params = thread->params;
+
+  thread->success = ((thread->group < 0) ?
+                     write_vertex_range(&thread->writer, params->varray,
+                                        params->rot, thread->first,
+                                        thread->end) :
+                     write_primitive_range(&thread->writer, params,
+                                           thread->group,
+                                           (int)thread->first,
+                                           (int)thread->end,
+                                           &thread->last_colour,
+                                           &thread->materials)) &&
+                    writer_flush(&thread->writer);
+}
+
+/* Formats the vertices (if ngroups is negative) or the primitives of the
+   given groups in chunks, using one chunk per thread, then writes the
+   output of all threads in the same order as it would have been if output
+   serially before formatting the next batch of chunks. */
+static bool output_parallel(Writer * const out,
+                            const OutputParams * const params,
+                            const int ngroups, const int nthreads,
+                            ClipSpawnFn * const spawn, void * const context)
+{
+  assert(out != NULL);
+  assert(params != NULL);
+  assert(nthreads > 1);
+  assert(spawn != NULL);
+
+  OutputThread * const threads = malloc(sizeof(*threads) * (size_t)nthreads);
+  void ** const args = malloc(sizeof(*args) * (size_t)nthreads);
+  if ((threads == NULL) || (args == NULL)) {
+    DEBUGF("Failed to allocate memory for %d output threads\n", nthreads);
+    free(args);
+    free(threads);
+    return false;
+  }
+
+  for (int t = 0; t < nthreads; ++t) {
+    threads[t].params = params;
+    material_cache_init(&threads[t].materials);
+    writer_memory_init(&threads[t].mem);
+    writer_init_memory(&threads[t].writer, &threads[t].mem);
+    args[t] = threads + t;
+  }
+
+  bool success = true;
+  int g = (ngroups < 0) ? -1 : 0, last_colour = INT_MAX;
+  VertexIndex first = 0;
+  const int end_g = (ngroups < 0) ? 0 : ngroups;
+
+  while (success) {
+    int nchunks = 0;
+    while ((nchunks < nthreads) && (g < end_g)) {
+      const VertexIndex count = (g < 0) ?
+                        vertex_array_get_num_vertices(params->varray) :
+                        group_get_num_primitives(params->groups + g);
+      if (first >= count) {
+        ++g;
+        first = 0;
+        continue;
       }
 
-      if (fprintf(out, "g %s %s_%d\n", object_name, object_name, g) < 0) {
-        return false;
+      OutputThread * const thread = threads + nchunks++;
+      thread->group = g;
+      thread->first = first;
+      thread->end = (count - first > OUTPUT_CHUNK_SIZE) ?
+                    first + OUTPUT_CHUNK_SIZE : count;
+      thread->last_colour = last_colour;
+      first = thread->end;
+
+      /* The next chunk starts with the colour that the serial output
+         would have had at that point, to decide whether to change material */
+      if (g >= 0) {
+        last_colour = get_primitive_colour(params,
+          group_get_primitive(params->groups + g, (int)thread->end - 1));
       }
     }
 
-    for (int p = 0; p < nprimitives; ++p) {
-      const Primitive * const pp = group_get_primitive(group, p);
-      int const colour = (get_colour != NULL) ?
-                         get_colour(pp, arg) :
-                         primitive_get_colour(pp);
+    if (nchunks == 0) {
+      break;
+    }
 
-      if (last_colour != colour) {
-        char material[64];
-        int n = (get_material != NULL) ?
-                get_material(material, sizeof(material), colour, arg) :
-                snprintf(material, sizeof(material), "colour_%d", colour);
+    DEBUGF("Formatting %d chunks of output\n", nchunks);
+    if (!spawn(context, nchunks, output_thread, args)) {
+      DEBUGF("Failed to start output threads\n");
+      success = false;
+      break;
+    }
 
-        if (n < 0) {
-          return false;
-        }
-        n = fprintf(out, "usemtl %s\n", material);
-        if (n < 0) {
-          return false;
-        }
-        last_colour = colour;
-      }
+    for (int t = 0; t < nchunks && success; ++t) {
+      success = threads[t].success &&
+                writer_write(out, threads[t].mem.data, threads[t].mem.len);
+      threads[t].mem.len = 0;
+    }
+  }
 
-      if (!output_primitive(out, pp, vtotal, vobject, varray, vstyle, mstyle)) {
-        return false;
-      }
-    } /* next primitive */
-  } /* next group */
+  for (int t = 0; t < nthreads; ++t) {
+    writer_free(&threads[t].writer);
+    writer_memory_free(&threads[t].mem);
+  }
+  free(args);
+  free(threads);
+  return success;
+}
 
-  return true;
+bool output_vertices_parallel(Writer * const out, const VertexIndex vobject,
+                              const VertexArray * const varray,
+                              const VertexIndex rot, const int nthreads,
+                              ClipSpawnFn * const spawn,
+                              void * const context)
+{
+  assert(out != NULL);
+  assert(vobject > 0);
+
+  if ((nthreads <= 1) || (spawn == NULL)) {
+    return output_vertices_to(out, vobject, varray, rot);
+  }
+
+  const OutputParams params = {
+    .object_name = NULL,
+    .vtotal = 0,
+    .vobject = vobject,
+    .varray = varray,
+    .rot = rot,
+    .groups = NULL,
+    .get_colour = NULL,
+    .get_material = NULL,
+    .arg = NULL,
+    .vstyle = VertexStyle_Positive,
+    .mstyle = MeshStyle_NoChange,
+  };
+
+  return writer_puts(out, "\n# ") && writer_put_int(out, vobject) &&
+         writer_puts(out, " vertices\n") &&
+         output_parallel(out, &params, -1, nthreads, spawn, context);
+}
+
+bool output_primitives_parallel(Writer * const out,
+                                const char * const object_name,
+                                const VertexIndex vtotal,
+                                const VertexIndex vobject,
+                                const VertexArray * const varray,
+                                Group const * const groups,
+                                int const ngroups,
+                                int (*get_colour)(const Primitive *pp,
+                                                  void *arg),
+                                int (*get_material)(char *buf,
+                                                    size_t buf_size,
+                                                    int colour, void *arg),
+                                void *arg, const VertexStyle vstyle,
+                                const MeshStyle mstyle, const int nthreads,
+                                ClipSpawnFn * const spawn,
+                                void * const context)
+{
+  assert(out != NULL);
+  assert(groups != NULL);
+  assert(vtotal >= 0);
+  assert(vobject > 0);
+  assert(ngroups >= 0);
+
+  if ((nthreads <= 1) || (spawn == NULL)) {
+    return output_primitives_to(out, object_name, vtotal, vobject, varray,
+                                groups, ngroups, get_colour, get_material,
+                                arg, vstyle, mstyle);
+  }
+
+  const OutputParams params = {
+    .object_name = object_name,
+    .vtotal = vtotal,
+    .vobject = vobject,
+    .varray = varray,
+    .rot = -1,
+    .groups = groups,
+    .get_colour = get_colour,
+    .get_material = get_material,
+    .arg = arg,
+    .vstyle = vstyle,
+    .mstyle = mstyle,
+  };
+
+  return output_parallel(out, &params, ngroups, nthreads, spawn, context);
 }
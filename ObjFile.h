@@ -20,6 +20,12 @@
 /* History:
   CJB: 05-Aug-18: Copied this source file from SF3KtoObj.
   CJB: 11-Dec-20: Removed redundant uses of the 'extern' keyword.
+  CJB: 14-Oct-26: Added output_vertices_to and output_primitives_to.
+                  Added output_vertices_parallel and
+                  output_primitives_parallel.
+                  Documented when get_material is called.
+                  Vertex numbers and counts are now of type VertexIndex.
+                  Include Spawn.h instead of Clip.h.
  */
 
 #ifndef OBJFILE_H
@@ -31,6 +37,8 @@
 #include "Primitive.h"
 #include "Vertex.h"
 #include "Group.h"
+#include "Writer.h"
+#include "Spawn.h"
 
 typedef enum {
   VertexStyle_Positive,
@@ -44,16 +52,59 @@ typedef enum {
 } MeshStyle;
 
 bool output_vertices(
-        FILE *out, int vobject, const VertexArray *varray,
-        int rot);
+        FILE *out, VertexIndex vobject, const VertexArray *varray,
+        VertexIndex rot);
 
+/* A 'usemtl' statement precedes each primitive whose colour (found by
+   calling get_colour, or primitive_get_colour if null) differs from that of
+   the previous primitive. The material is named by calling get_material,
+   or "colour_N" if null. Names are remembered, so get_material must always
+   give the same name for the same colour and needn't be called every time
+   the material changes. mesh_order_by_colour can be used to reduce the
+   number of changes. */
 bool output_primitives(
         FILE *out, const char *object_name,
-        int vtotal, int vobject, const VertexArray *varray,
+        VertexIndex vtotal, VertexIndex vobject, const VertexArray *varray,
         Group const *groups, int ngroups,
         int (*get_colour)(const Primitive *pp, void *arg),
         int (*get_material)(char *buf, size_t buf_size,
                             int colour, void *arg),
         void *arg, VertexStyle vstyle, MeshStyle mstyle);
 
+/* These variants of output_vertices and output_primitives write to a
+   Writer, which may buffer some of the output. A true result only means
+   that no error has occurred so far: writer_flush must also succeed. */
+bool output_vertices_to(
+        Writer *out, VertexIndex vobject, const VertexArray *varray,
+        VertexIndex rot);
+
+bool output_primitives_to(
+        Writer *out, const char *object_name,
+        VertexIndex vtotal, VertexIndex vobject, const VertexArray *varray,
+        Group const *groups, int ngroups,
+        int (*get_colour)(const Primitive *pp, void *arg),
+        int (*get_material)(char *buf, size_t buf_size,
+                            int colour, void *arg),
+        void *arg, VertexStyle vstyle, MeshStyle mstyle);
+
+/* Same as output_vertices_to and output_primitives_to except that chunks
+   of the output may be formatted concurrently, using up to nthreads
+   threads started by calling spawn (with the given context). The output is
+   identical to that of the serial functions, which are used instead if
+   nthreads is less than 2 or spawn is null. get_colour and get_material
+   may be called concurrently and more than once for the same primitive. */
+bool output_vertices_parallel(
+        Writer *out, VertexIndex vobject, const VertexArray *varray,
+        VertexIndex rot, int nthreads, ClipSpawnFn *spawn, void *context);
+
+bool output_primitives_parallel(
+        Writer *out, const char *object_name,
+        VertexIndex vtotal, VertexIndex vobject, const VertexArray *varray,
+        Group const *groups, int ngroups,
+        int (*get_colour)(const Primitive *pp, void *arg),
+        int (*get_material)(char *buf, size_t buf_size,
+                            int colour, void *arg),
+        void *arg, VertexStyle vstyle, MeshStyle mstyle,
+        int nthreads, ClipSpawnFn *spawn, void *context);
+
 #endif /* OBJFILE_H */
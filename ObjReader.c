@@ -0,0 +1,673 @@
+/*
+ * 3dObjLib: OBJ file parsing
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this source file.
+                  Faces with too many sides are split into a fan.
+                  Vertex numbers are now of type VertexIndex.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+/* Local header files */
+#include "Internal/3dObjMisc.h"
+#include "ObjReader.h"
+#include "Coord.h"
+#include "Vertex.h"
+#include "Primitive.h"
+#include "Group.h"
+
+enum {
+  READER_BUF_SIZE = 64 * 1024,
+  VERTEX_BATCH_SIZE = 256, /* number of vertices added at once */
+  MAX_NAME_LEN = 255, /* of groups and materials */
+  MAX_NUMBER_LEN = 63, /* of numbers that are converted by strtod */
+  MAX_FAST_DIGITS = 15, /* significant digits exactly representable */
+  MAX_FAST_EXP = 22 /* largest power of 10 exactly representable */
+};
+
+/* Powers of 10 that can be represented exactly by a double */
+static const double powers_of_10[MAX_FAST_EXP + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef struct {
+  VertexArray *varray;
+  Group *groups;
+  int ngroups;
+  int (*get_group)(const char *name, void *arg);
+  int (*get_colour)(const char *name, void *arg);
+  void *arg;
+  VertexIndex vbase; /* number of vertices before reading */
+  int group;
+  bool group_used;
+  int colour;
+  int nprimitives;
+  int line;
+  int nbatch;
+  Coord batch[VERTEX_BATCH_SIZE][3];
+} ObjInput;
+
+static bool is_space(const char c)
+{
+  return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static bool is_digit(const char c)
+{
+  return (c >= '0') && (c <= '9');
+}
+
+static const char *skip_space(const char *p, const char * const end)
+{
+  while ((p < end) && is_space(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+static const char *skip_token(const char *p, const char * const end)
+{
+  while ((p < end) && !is_space(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+/* Converts a number that is too long or complex for parse_coord */
+static bool convert_coord(const char * const start, const char * const end,
+                          Coord * const c)
+{
+  char str[MAX_NUMBER_LEN + 1];
+  const size_t len = (size_t)(end - start);
+  if (len > MAX_NUMBER_LEN) {
+    DEBUGF("Number is too long\n");
+    return false;
+  }
+  memcpy(str, start, len);
+  str[len] = '\0';
+
+  char *endp;
+  *c = strtod(str, &endp);
+  return (endp == str + len);
+}
+
+/* Parses a decimal number without calling strtod unless it has so many
+   significant digits or such a large exponent that the result could be
+   inexact. Otherwise the result is correctly rounded because the
+   significand and power of 10 are both representable. */
+static bool parse_coord(const char ** const pp, const char * const end,
+                        Coord * const c)
+{
+  const char * const start = skip_space(*pp, end);
+  const char * const token_end = skip_token(start, end);
+  const char *p = start;
+  *pp = token_end;
+
+  bool negative = false;
+  if ((p < token_end) && ((*p == '-') || (*p == '+'))) {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  uint64_t significand = 0;
+  int ndigits = 0, exponent = 0;
+  bool any = false;
+  for (; (p < token_end) && is_digit(*p); ++p) {
+    any = true;
+    if (ndigits <= MAX_FAST_DIGITS) {
+      significand = (significand * 10) + (uint64_t)(*p - '0');
+      ndigits += (significand > 0);
+    } else {
+      ++exponent;
+    }
+  }
+  if ((p < token_end) && (*p == '.')) {
+    for (++p; (p < token_end) && is_digit(*p); ++p) {
+      any = true;
+      if (ndigits <= MAX_FAST_DIGITS) {
+        significand = (significand * 10) + (uint64_t)(*p - '0');
+        ndigits += (significand > 0);
+        --exponent;
+      }
+    }
+  }
+  if (any && (p < token_end) && ((*p == 'e') || (*p == 'E'))) {
+    ++p;
+    bool negative_exp = false;
+    if ((p < token_end) && ((*p == '-') || (*p == '+'))) {
+      negative_exp = (*p == '-');
+      ++p;
+    }
+    int e = 0;
+    if ((p == token_end) || !is_digit(*p)) {
+      any = false;
+    }
+    for (; (p < token_end) && is_digit(*p); ++p) {
+      if (e < INT_MAX / 20) {
+        e = (e * 10) + (*p - '0');
+      }
+    }
+    exponent += negative_exp ? -e : e;
+  }
+
+  if (!any || (p != token_end) || (ndigits > MAX_FAST_DIGITS) ||
+      (exponent < -MAX_FAST_EXP) || (exponent > MAX_FAST_EXP)) {
+    if (!convert_coord(start, token_end, c)) {
+      DEBUGF("Bad number '%.*s'\n", (int)(token_end - start), start);
+      return false;
+    }
+    return true;
+  }
+
+  double x = (double)significand;
+  if (exponent < 0) {
+    x /= powers_of_10[-exponent];
+  } else {
+    x *= powers_of_10[exponent];
+  }
+  *c = negative ? -x : x;
+  return true;
+}
+
+/* Parses a vertex number, ignoring any texture or normal number that
+   follows it, and converts it to an index in the vertex array. */
+static bool parse_vertex(ObjInput * const in, const char ** const pp,
+                         const char * const end, VertexIndex * const v)
+{
+  const char *p = skip_space(*pp, end);
+  const char * const token_end = skip_token(p, end);
+  *pp = token_end;
+
+  bool negative = false;
+  if ((p < token_end) && ((*p == '-') || (*p == '+'))) {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  const VertexIndex nvertices = vertex_array_get_num_vertices(in->varray) -
+                                in->vbase;
+  long long n = 0;
+  if ((p == token_end) || !is_digit(*p)) {
+    DEBUGF("Missing vertex number on line %d\n", in->line);
+    return false;
+  }
+  for (; (p < token_end) && is_digit(*p); ++p) {
+    /* Stop accumulating digits once the number is out of range */
+    if (n <= nvertices) {
+      n = (n > (LLONG_MAX - 9) / 10) ? LLONG_MAX : (n * 10) + (*p - '0');
+    }
+  }
+  if ((p < token_end) && (*p != '/')) {
+    DEBUGF("Bad vertex number on line %d\n", in->line);
+    return false;
+  }
+
+  /* Numbers count from 1 for the first vertex or -1 for the last */
+  if ((n < 1) || (n > nvertices)) {
+    DEBUGF("Vertex number %s%lld out of range on line %d\n",
+           negative ? "-" : "", n, in->line);
+    return false;
+  }
+  *v = in->vbase + (VertexIndex)(negative ? nvertices - n : n - 1);
+  return true;
+}
+
+static bool parse_name(const char *p, const char * const end,
+                       char (* const name)[MAX_NAME_LEN + 1])
+{
+  p = skip_space(p, end);
+  const char *name_end = end;
+  while ((name_end > p) && is_space(name_end[-1])) {
+    --name_end;
+  }
+
+  const size_t len = (size_t)(name_end - p);
+  if (len > MAX_NAME_LEN) {
+    DEBUGF("Name is too long\n");
+    return false;
+  }
+  memcpy(*name, p, len);
+  (*name)[len] = '\0';
+  return true;
+}
+
+static bool flush_vertices(ObjInput * const in)
+{
+  assert(in != NULL);
+  assert(in->nbatch >= 0);
+
+  if ((in->nbatch > 0) &&
+      (vertex_array_add_vertices(in->varray, in->batch, in->nbatch) < 0)) {
+    return false;
+  }
+  in->nbatch = 0;
+  return true;
+}
+
+static bool add_vertex(ObjInput * const in, const char *p,
+                       const char * const end)
+{
+  assert(in != NULL);
+  assert(in->nbatch < VERTEX_BATCH_SIZE);
+
+  /* Any weight or colour that follows the coordinates is ignored */
+  Coord (* const coords)[3] = in->batch + in->nbatch;
+  for (size_t dim = 0; dim < ARRAY_SIZE(*coords); ++dim) {
+    if (!parse_coord(&p, end, &(*coords)[dim])) {
+      DEBUGF("Bad vertex on line %d\n", in->line);
+      return false;
+    }
+  }
+
+  return (++in->nbatch < VERTEX_BATCH_SIZE) || flush_vertices(in);
+}
+
+static Primitive *add_primitive(ObjInput * const in)
+{
+  assert(in != NULL);
+
+  if ((in->group < 0) || (in->group >= in->ngroups)) {
+    DEBUGF("Group %d out of range on line %d\n", in->group, in->line);
+    return NULL;
+  }
+
+  Primitive * const pp = group_add_primitive(in->groups + in->group);
+  if (pp != NULL) {
+    primitive_set_colour(pp, in->colour);
+    primitive_set_id(pp, in->nprimitives++);
+    in->group_used = true;
+  }
+  return pp;
+}
+
+static bool add_face(ObjInput * const in, const char *p,
+                     const char * const end)
+{
+  Primitive *pp = add_primitive(in);
+  if (pp == NULL) {
+    return false;
+  }
+
+  for (p = skip_space(p, end); p < end; p = skip_space(p, end)) {
+    VertexIndex v;
+    if (!parse_vertex(in, &p, end, &v)) {
+      return false;
+    }
+
+    if (primitive_get_num_sides(pp) == PRIMITIVE_MAX_SIDES) {
+      /* Continue the face as a fan of polygons which all share its first
+         vertex, each beginning with the last vertex of the one before */
+      const VertexIndex first = primitive_get_side(pp, 0),
+                        last = primitive_get_side(pp, PRIMITIVE_MAX_SIDES - 1);
+      pp = add_primitive(in);
+      if ((pp == NULL) || (primitive_add_side(pp, first) < 0) ||
+          (primitive_add_side(pp, last) < 0)) {
+        return false;
+      }
+    }
+
+    if (primitive_add_side(pp, v) < 0) {
+      return false;
+    }
+  }
+
+  if (primitive_get_num_sides(pp) == 0) {
+    DEBUGF("Face has no vertices on line %d\n", in->line);
+    return false;
+  }
+  return true;
+}
+
+static bool add_points(ObjInput * const in, const char *p,
+                       const char * const end)
+{
+  for (p = skip_space(p, end); p < end; p = skip_space(p, end)) {
+    VertexIndex v;
+    if (!parse_vertex(in, &p, end, &v)) {
+      return false;
+    }
+    Primitive * const pp = add_primitive(in);
+    if ((pp == NULL) || (primitive_add_side(pp, v) < 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool add_lines(ObjInput * const in, const char *p,
+                      const char * const end)
+{
+  VertexIndex last_v = -1;
+  for (p = skip_space(p, end); p < end; p = skip_space(p, end)) {
+    VertexIndex v;
+    if (!parse_vertex(in, &p, end, &v)) {
+      return false;
+    }
+    if (last_v >= 0) {
+      Primitive * const pp = add_primitive(in);
+      if ((pp == NULL) || (primitive_add_side(pp, last_v) < 0) ||
+          (primitive_add_side(pp, v) < 0)) {
+        return false;
+      }
+    }
+    last_v = v;
+  }
+
+  if (last_v < 0) {
+    DEBUGF("Line has no vertices on line %d\n", in->line);
+    return false;
+  }
+  return true;
+}
+
+static bool set_group(ObjInput * const in, const char * const p,
+                      const char * const end)
+{
+  assert(in != NULL);
+
+  if (in->get_group == NULL) {
+    if (in->group_used) {
+      ++in->group;
+      in->group_used = false;
+    }
+    return true;
+  }
+
+  char name[MAX_NAME_LEN + 1];
+  if (!parse_name(p, end, &name)) {
+    return false;
+  }
+
+  in->group = in->get_group(name, in->arg);
+  if ((in->group < 0) || (in->group >= in->ngroups)) {
+    DEBUGF("Bad group '%s' on line %d\n", name, in->line);
+    return false;
+  }
+  return true;
+}
+
+static bool set_material(ObjInput * const in, const char * const p,
+                         const char * const end)
+{
+  assert(in != NULL);
+
+  char name[MAX_NAME_LEN + 1];
+  if (!parse_name(p, end, &name)) {
+    return false;
+  }
+
+  if (in->get_colour != NULL) {
+    in->colour = in->get_colour(name, in->arg);
+  } else {
+    static const char prefix[] = "colour_";
+    int colour = 0;
+    if (strncmp(name, prefix, sizeof(prefix) - 1) == 0) {
+      char *endp;
+      const long n = strtol(name + sizeof(prefix) - 1, &endp, 10);
+      if ((*endp == '\0') && (n >= INT_MIN) && (n <= INT_MAX)) {
+        colour = (int)n;
+      }
+    }
+    in->colour = colour;
+  }
+  return true;
+}
+
+static bool parse_line(ObjInput * const in, const char *p,
+                       const char * const end)
+{
+  assert(in != NULL);
+  ++in->line;
+
+  p = skip_space(p, end);
+  const char * const keyword = p;
+  p = skip_token(p, end);
+  const size_t len = (size_t)(p - keyword);
+
+  if ((len == 1) && (keyword[0] == 'v')) {
+    return add_vertex(in, p, end);
+  }
+
+  /* Vertices must be added before they can be referred to */
+  if (!flush_vertices(in)) {
+    return false;
+  }
+
+  if (len == 1) {
+    switch (keyword[0]) {
+    case 'f':
+      return add_face(in, p, end);
+    case 'l':
+      return add_lines(in, p, end);
+    case 'p':
+      return add_points(in, p, end);
+    case 'g':
+      return set_group(in, p, end);
+    default:
+      break;
+    }
+  } else if ((len == 6) && (memcmp(keyword, "usemtl", len) == 0)) {
+    return set_material(in, p, end);
+  }
+
+  return true;
+}
+
+/* Parses all of the complete lines in size bytes of data (and any
+   incomplete last line too if final is true). Returns false on error,
+   otherwise the number of bytes parsed. */
+static bool parse_lines(ObjInput * const in, const char * const data,
+                        const size_t size, const bool final,
+                        size_t * const nparsed)
+{
+  assert(in != NULL);
+  assert(data != NULL || size == 0);
+  assert(nparsed != NULL);
+
+  const char *p = data;
+  const char * const end = data + size;
+  while (p < end) {
+    const char * const eol = memchr(p, '\n', (size_t)(end - p));
+    if (eol == NULL) {
+      if (!final) {
+        break;
+      }
+      if (!parse_line(in, p, end)) {
+        return false;
+      }
+      p = end;
+    } else {
+      if (!parse_line(in, p, eol)) {
+        return false;
+      }
+      p = eol + 1;
+    }
+  }
+
+  *nparsed = (size_t)(p - data);
+  return true;
+}
+
+static void input_init(ObjInput * const in, VertexArray * const varray,
+                       Group * const groups, const int ngroups,
+                       int (*get_group)(const char *name, void *arg),
+                       int (*get_colour)(const char *name, void *arg),
+                       void * const arg)
+{
+  assert(in != NULL);
+  assert(varray != NULL);
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+
+  in->varray = varray;
+  in->groups = groups;
+  in->ngroups = ngroups;
+  in->get_group = get_group;
+  in->get_colour = get_colour;
+  in->arg = arg;
+  in->vbase = vertex_array_get_num_vertices(varray);
+  in->group = 0;
+  in->group_used = false;
+  in->colour = 0;
+  in->nprimitives = 0;
+  in->line = 0;
+  in->nbatch = 0;
+}
+
+bool input_obj(ObjReaderFn * const fn, void * const context,
+               VertexArray * const varray, Group * const groups,
+               const int ngroups,
+               int (*get_group)(const char *name, void *arg),
+               int (*get_colour)(const char *name, void *arg),
+               void * const arg)
+{
+  assert(fn != NULL);
+
+  ObjInput * const in = malloc(sizeof(*in));
+  size_t size = READER_BUF_SIZE;
+  char *buf = malloc(size);
+  if ((in == NULL) || (buf == NULL)) {
+    DEBUGF("Failed to allocate memory for input\n");
+    free(buf);
+    free(in);
+    return false;
+  }
+  input_init(in, varray, groups, ngroups, get_group, get_colour, arg);
+
+  /* Incomplete lines are moved to the start of the buffer, which is only
+     extended if it is too small to hold a whole line. */
+  bool success = true, final = false;
+  size_t len = 0;
+  while (success && !final) {
+    if (len == size) {
+      char * const new_buf = (size <= SIZE_MAX / 2) ?
+                             realloc(buf, size * 2) : NULL;
+      if (new_buf == NULL) {
+        DEBUGF("Failed to allocate memory for a line of input\n");
+        success = false;
+        break;
+      }
+      buf = new_buf;
+      size *= 2;
+    }
+
+    size_t n = 0;
+    if (!fn(context, buf + len, size - len, &n)) {
+      DEBUGF("Failed to read input\n");
+      success = false;
+      break;
+    }
+    assert(n <= size - len);
+    final = (n == 0);
+    len += n;
+
+    size_t nparsed;
+    success = parse_lines(in, buf, len, final, &nparsed);
+    if (success) {
+      len -= nparsed;
+      memmove(buf, buf + nparsed, len);
+    }
+  }
+
+  if (success) {
+    success = flush_vertices(in);
+  }
+
+  free(buf);
+  free(in);
+  return success;
+}
+
+static bool read_file(void * const context, char * const buf,
+                      const size_t size, size_t * const n)
+{
+  FILE * const in = context;
+  assert(in != NULL);
+  assert(n != NULL);
+  *n = fread(buf, 1, size, in);
+  return !ferror(in);
+}
+
+bool input_obj_file(FILE * const in, VertexArray * const varray,
+                    Group * const groups, const int ngroups,
+                    int (*get_group)(const char *name, void *arg),
+                    int (*get_colour)(const char *name, void *arg),
+                    void * const arg)
+{
+  assert(in != NULL);
+  assert(!ferror(in));
+  return input_obj(read_file, in, varray, groups, ngroups, get_group,
+                   get_colour, arg);
+}
+
+/* Counts the lines that begin with a 'v' statement */
+static VertexIndex count_vertices(const char * const data, const size_t size)
+{
+  VertexIndex count = 0;
+  const char *p = data;
+  const char * const end = data + size;
+
+  while (p < end) {
+    p = skip_space(p, end);
+    if (((end - p) >= 2) && (p[0] == 'v') && is_space(p[1]) &&
+        (count < VERTEX_INDEX_MAX)) {
+      ++count;
+    }
+    const char * const eol = memchr(p, '\n', (size_t)(end - p));
+    p = (eol != NULL) ? eol + 1 : end;
+  }
+  return count;
+}
+
+bool input_obj_memory(const char * const data, const size_t size,
+                      VertexArray * const varray, Group * const groups,
+                      const int ngroups,
+                      int (*get_group)(const char *name, void *arg),
+                      int (*get_colour)(const char *name, void *arg),
+                      void * const arg)
+{
+  assert(data != NULL || size == 0);
+
+  ObjInput * const in = malloc(sizeof(*in));
+  if (in == NULL) {
+    DEBUGF("Failed to allocate memory for input\n");
+    return false;
+  }
+  input_init(in, varray, groups, ngroups, get_group, get_colour, arg);
+
+  /* Failure to reserve space only degrades performance */
+  const VertexIndex nvertices = count_vertices(data, size);
+  if (nvertices <= VERTEX_INDEX_MAX - in->vbase) {
+    (void)vertex_array_reserve(varray, in->vbase + nvertices);
+  }
+
+  size_t nparsed;
+  const bool success = parse_lines(in, data, size, true, &nparsed) &&
+                       flush_vertices(in);
+  free(in);
+  return success;
+}
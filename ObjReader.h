@@ -0,0 +1,84 @@
+/*
+ * 3dObjLib: OBJ file parsing
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this header file.
+                  Faces with too many sides are split into a fan.
+ */
+
+#ifndef OBJREADER_H
+#define OBJREADER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Vertex.h"
+#include "Group.h"
+
+/* Type of function called to read the next chunk of input into buf, which
+   can hold size bytes. It must set *n to the number of bytes read (0 at
+   the end of the input) and return false if an error occurred. */
+typedef bool ObjReaderFn(void *context, char *buf, size_t size, size_t *n);
+
+/* Appends the vertices ('v') and primitives ('f', 'l' and 'p') defined by
+   OBJ input to varray and groups. Each 'f' statement is one primitive
+   (or a fan of primitives sharing its first vertex, if it has more than
+   PRIMITIVE_MAX_SIDES vertices), whereas each vertex of a 'p' statement
+   and each segment of an 'l' statement is a separate primitive.
+   Primitives are numbered in order of definition (starting from zero) and
+   their colour is set by the last 'usemtl' statement. Vertex numbers may
+   be positive or negative (i.e. relative to the last vertex defined) but
+   cannot refer to vertices that were in varray beforehand. Other
+   statements are ignored.
+
+   The group that primitives are added to is chosen by calling get_group
+   with the names given by each 'g' statement. It must return a group
+   number less than ngroups, or a negative value if the names are invalid.
+   If get_group is null, then the first primitives are added to group 0
+   and each 'g' statement after any primitives selects the next group.
+
+   The colour of primitives is found by calling get_colour with the name
+   given by each 'usemtl' statement. If get_colour is null then names of
+   the form "colour_N" (as output by output_primitives) select colour N and
+   any other name selects colour 0.
+
+   Returns false if the input is invalid, could not be read, or there is
+   not enough memory, in which case some of it may have been added. */
+bool input_obj(ObjReaderFn *fn, void *context,
+               VertexArray *varray, Group *groups, int ngroups,
+               int (*get_group)(const char *name, void *arg),
+               int (*get_colour)(const char *name, void *arg),
+               void *arg);
+
+bool input_obj_file(FILE *in, VertexArray *varray, Group *groups,
+                    int ngroups,
+                    int (*get_group)(const char *name, void *arg),
+                    int (*get_colour)(const char *name, void *arg),
+                    void *arg);
+
+/* Same as input_obj except that the whole input is already in memory (or
+   mapped) at data. It is parsed in place. */
+bool input_obj_memory(const char *data, size_t size,
+                      VertexArray *varray, Group *groups, int ngroups,
+                      int (*get_group)(const char *name, void *arg),
+                      int (*get_colour)(const char *name, void *arg),
+                      void *arg);
+
+#endif /* OBJREADER_H */
@@ -45,6 +45,22 @@
                   guard against leaving members uninitialized.
   CJB: 30-Jul-22: Extra range check in primitive_get_side to stop a wrong
                   warning from GCC's -Warray-bounds.
+  CJB: 14-Oct-26: Reinstated primitive_get_bbox for use by the clipping
+                  module.
+                  Added primitive_set_side.
+                  primitive_clip now projects the back primitive onto the
+                  plane once and tests points and edges against all of its
+                  edges using an initial pass that can be vectorised.
+                  The maximum number of sides is now PRIMITIVE_MAX_SIDES.
+                  primitive_contains can use snapped coordinates.
+                  Added primitive_clip_stats.
+                  The plane found from the normal vector is now cached.
+                  Added primitive_precompute.
+                  The front primitive is also projected once by
+                  primitive_clip and primitive_contains, using loops
+                  specialised for each plane found by vector_find_plane.
+                  Sides are now of type VertexIndex.
+                  Fixed an unused parameter warning if BBOX is 0.
  */
 
 /* ISO library header files */
@@ -67,15 +83,16 @@ void primitive_init(Primitive * const primitive)
     .id = 0,
     .nsides = 0,
     .has_normal = false,
+    .plane_z = 0,
 #if BBOX
     .has_bbox = false,
 #endif
   };
 }
 
-int primitive_get_side(const Primitive * const primitive, const int n)
+VertexIndex primitive_get_side(const Primitive * const primitive, const int n)
 {
-  int side = -1;
+  VertexIndex side = -1;
 
   assert(primitive != NULL);
   assert(primitive->nsides <= (int)ARRAY_SIZE(primitive->sides));
@@ -90,7 +107,7 @@ int primitive_get_side(const Primitive * const primitive, const int n)
   return side;
 }
 
-int primitive_add_side(Primitive * const primitive, const int v)
+int primitive_add_side(Primitive * const primitive, const VertexIndex v)
 {
   int side = -1;
 
@@ -105,7 +122,7 @@ int primitive_add_side(Primitive * const primitive, const int v)
 #if BBOX
       primitive->has_bbox = false;
 #endif
-      DEBUGF("Set side %d of primitive %p to vertex %d\n",
+      DEBUGF("Set side %d of primitive %p to vertex %"PVERTEXINDEX"\n",
               primitive->nsides, (void *)primitive, v);
 
     } else {
@@ -113,7 +130,32 @@ int primitive_add_side(Primitive * const primitive, const int v)
              ARRAY_SIZE(primitive->sides));
     }
   } else {
-    DEBUGF("Invalid vertex number %d\n", v);
+    DEBUGF("Invalid vertex number %"PVERTEXINDEX"\n", v);
+  }
+  return side;
+}
+
+int primitive_set_side(Primitive * const primitive, const int n,
+                       const VertexIndex v)
+{
+  int side = -1;
+
+  assert(primitive != NULL);
+  assert(primitive->nsides <= (int)ARRAY_SIZE(primitive->sides));
+
+  if ((n >= 0) && (n < primitive->nsides) &&
+      (n < (int)ARRAY_SIZE(primitive->sides)) && (v >= 0)) {
+    side = n;
+    primitive->sides[side] = v;
+    primitive->has_normal = false;
+#if BBOX
+    primitive->has_bbox = false;
+#endif
+    DEBUGF("Set side %d of primitive %p to vertex %"PVERTEXINDEX"\n",
+           n, (void *)primitive, v);
+  } else {
+    DEBUGF("Invalid side number %d or vertex number %"PVERTEXINDEX"\n",
+           n, v);
   }
   return side;
 }
@@ -137,7 +179,7 @@ void primitive_reverse_sides(Primitive * const primitive)
 
   const int mid = primitive->nsides/2;
   for (int low = 0; low < mid; ++low) {
-    const int temp = primitive->sides[low];
+    const VertexIndex temp = primitive->sides[low];
     const int high = (primitive->nsides - low) - 1;
     primitive->sides[low] = primitive->sides[high];
     primitive->sides[high] = temp;
@@ -166,7 +208,7 @@ static bool primitive_make_normal(Primitive * const primitive,
     Coord (*coords[3])[3];
 
     for (int side = 0; side < 3; ++side) {
-      const int v = primitive_get_side(primitive, side);
+      const VertexIndex v = primitive_get_side(primitive, side);
       coords[side] = vertex_array_get_coords(varray, v);
     }
 
@@ -191,6 +233,9 @@ static bool primitive_ensure_normal(Primitive * const primitive,
   assert(primitive != NULL);
   if (!primitive->has_normal) {
     if (primitive_make_normal(primitive, varray, &primitive->normal)) {
+      Plane plane;
+      vector_find_plane(&primitive->normal, &plane);
+      primitive->plane_z = plane.z;
       primitive->has_normal = true;
     }
   }
@@ -270,7 +315,6 @@ void primitive_set_id(Primitive * const primitive, int id)
   }
 }
 
-#if BBOX
 static bool primitive_make_bbox(Primitive * const primitive,
                                 const VertexArray * const varray,
                                 Coord (*const low)[3],
@@ -289,14 +333,14 @@ static bool primitive_make_bbox(Primitive * const primitive,
   } else {
     /* Compute the smallest cuboid region containing all vertices of
        the primitive. */
-    const int p0 = primitive_get_side(primitive, 0);
+    const VertexIndex p0 = primitive_get_side(primitive, 0);
     Coord (* const coords0)[3] = vertex_array_get_coords(varray, p0);
     for (size_t dim = 0; dim < ARRAY_SIZE(*coords0); ++dim) {
       (*low)[dim] = (*high)[dim] = (*coords0)[dim];
     }
 
     for (int s = 1; s < nsides; ++s) {
-      const int pv = primitive_get_side(primitive, s);
+      const VertexIndex pv = primitive_get_side(primitive, s);
       Coord (* const coords)[3] = vertex_array_get_coords(varray, pv);
 
       for (size_t dim = 0; dim < ARRAY_SIZE(*coords); ++dim) {
@@ -324,6 +368,7 @@ static bool primitive_make_bbox(Primitive * const primitive,
   return has_bbox;
 }
 
+#if BBOX
 static bool primitive_ensure_bbox(Primitive * const primitive,
                                   const VertexArray * const varray)
 {
@@ -338,13 +383,48 @@ static bool primitive_ensure_bbox(Primitive * const primitive,
 }
 #endif /* BBOX */
 
+bool primitive_get_bbox(Primitive * const primitive,
+                        const VertexArray * const varray,
+                        Coord (* const low)[3], Coord (* const high)[3])
+{
+  assert(primitive != NULL);
+  assert(low != NULL);
+  assert(high != NULL);
+
+#if BBOX
+  if (!primitive_ensure_bbox(primitive, varray)) {
+    return false;
+  }
+
+  for (size_t dim = 0; dim < ARRAY_SIZE(*low); ++dim) {
+    (*low)[dim] = primitive->low[dim];
+    (*high)[dim] = primitive->high[dim];
+  }
+  return true;
+#else /* BBOX */
+  return primitive_make_bbox(primitive, varray, low, high);
+#endif /* BBOX */
+}
+
+bool primitive_precompute(Primitive * const primitive,
+                          const VertexArray * const varray)
+{
+  assert(primitive != NULL);
+#if BBOX
+  /* The bounding box includes the vertices used to compute the normal */
+  (void)primitive_ensure_bbox(primitive, varray);
+#endif /* BBOX */
+  return primitive_ensure_normal(primitive, varray);
+}
+
 bool primitive_find_plane(Primitive * const primitive,
                           const VertexArray * const varray,
                           Plane * const plane)
 {
+  assert(plane != NULL);
   const bool has_normal = primitive_ensure_normal(primitive, varray);
   if (has_normal) {
-    vector_find_plane(&primitive->normal, plane);
+    vector_plane_ignoring(primitive->plane_z, plane);
   }
   return has_normal;
 }
@@ -400,13 +480,13 @@ bool primitive_coplanar(Primitive *p, Primitive *q,
          it is facing the same direction as p. */
       nsides_q = primitive_get_num_sides(q);
     }
-    int const vp = primitive_get_side(p, 0);
+    VertexIndex const vp = primitive_get_side(p, 0);
 
     /* Check each vertex of q for coplanarity until we find one in a
        different plane from p (or skip this loop if p and q are polygons
        facing different directions -- see above). */
     for (int s = 0; coplanar && (s < nsides_q); ++s) {
-      int const vq = primitive_get_side(q, s);
+      VertexIndex const vq = primitive_get_side(q, s);
 
       /* Find whether each vertex of q is in the same plane as polygon p by
          projecting a vector between that vertex and the first vertex of p
@@ -437,7 +517,7 @@ bool primitive_coplanar(Primitive *p, Primitive *q,
              dist);
 
       coplanar = coord_equal(dist, 0);
-      DEBUGF("Vertex %d is%s coplanar with polygon %p\n", vq,
+      DEBUGF("Vertex %"PVERTEXINDEX" is%s coplanar with polygon %p\n", vq,
              coplanar ? "" : " not", (void *)p);
     }
   }
@@ -474,84 +554,224 @@ static Coord primitive_get_top_y(Primitive * const primitive,
   return top_y;
 }
 
+/* The sides of a primitive projected onto a plane, so that a point or edge
+   can be tested against every edge without looking up any vertices.
+   Edge s runs from (x[s+1],y[s+1]) to (x[s],y[s]), where element 0 is the
+   last vertex. Testing each edge is split into a pass that rejects edges
+   without dependencies between iterations (which a compiler can vectorise)
+   and a pass over the remaining edges. */
+enum { MaxSides = PRIMITIVE_MAX_SIDES };
+
+typedef struct {
+  int nsides;
+  VertexIndex sides[MaxSides];
+  Coord x[MaxSides + 1];
+  Coord y[MaxSides + 1];
+  Coord top_y;
+#if COORD_SNAP
+  bool snapped; /* false if any coordinates were out of range */
+  SnapPoint snap[MaxSides + 1];
+#endif
+} Projection;
+
+/* This is called with constant dimensions for each of the planes that
+   vector_find_plane can find, so that the compiler can specialise it. */
+static void primitive_project_dims(const Primitive * const primitive,
+                                   const VertexArray * const varray,
+                                   const Plane plane, const size_t xd,
+                                   const size_t yd, Projection * const proj)
+{
+  assert(xd == plane.x);
+  assert(yd == plane.y);
+  NOT_USED(plane);
+
+  const int nsides = proj->nsides;
+  for (int s = 0; s < nsides; ++s) {
+    const VertexIndex v = primitive->sides[s];
+    Coord (* const coords)[3] = vertex_array_get_coords(varray, v);
+    proj->sides[s] = v;
+    proj->x[s + 1] = (*coords)[xd];
+    proj->y[s + 1] = (*coords)[yd];
+#if COORD_SNAP
+    if (!vector_snap(coords, plane, &proj->snap[s + 1])) {
+      proj->snapped = false;
+    }
+#endif
+  }
+}
+
+static void primitive_project_sides(const Primitive * const primitive,
+                                    const VertexArray * const varray,
+                                    const Plane plane,
+                                    Projection * const proj)
+{
+  assert(primitive != NULL);
+  assert(proj != NULL);
+
+  const int nsides = primitive_get_num_sides(primitive);
+  proj->nsides = nsides;
+#if COORD_SNAP
+  proj->snapped = true;
+#endif
+  if ((plane.x == 2) && (plane.y == 1)) {
+    primitive_project_dims(primitive, varray, plane, 2, 1, proj);
+  } else if ((plane.x == 0) && (plane.y == 2)) {
+    primitive_project_dims(primitive, varray, plane, 0, 2, proj);
+  } else if ((plane.x == 0) && (plane.y == 1)) {
+    primitive_project_dims(primitive, varray, plane, 0, 1, proj);
+  } else {
+    primitive_project_dims(primitive, varray, plane, plane.x, plane.y,
+                           proj);
+  }
+  if (nsides > 0) {
+    proj->x[0] = proj->x[nsides];
+    proj->y[0] = proj->y[nsides];
+#if COORD_SNAP
+    proj->snap[0] = proj->snap[nsides];
+#endif
+  }
+}
+
+static void primitive_project(Primitive * const primitive,
+                              const VertexArray * const varray,
+                              const Plane plane, Projection * const proj)
+{
+  primitive_project_sides(primitive, varray, plane, proj);
+  if (proj->nsides >= 3) {
+    proj->top_y = primitive_get_top_y(primitive, varray, plane);
+  }
+}
+
+#if COORD_SNAP
+/* Like primitive_contains_point, this assumes that points within about
+   MAX_FLT_ERR of an edge are contained within a polygon. */
+static bool primitive_snap_contains_point(const Projection * const proj,
+                                          const SnapPoint * const point)
+{
+  assert(proj != NULL);
+  assert(proj->snapped);
+  assert(point != NULL);
+
+  bool is_inside = false;
+  const int nsides = proj->nsides;
+  for (int s = 0; s < nsides; ++s) {
+    const SnapPoint * const start = &proj->snap[s + 1],
+                    * const end = &proj->snap[s];
+
+    const CoordSnap cross = vector_snap_cross(start, end, point);
+    if ((cross == 0) &&
+        (point->x + COORD_SNAP_SCALE >= LOWEST(start->x, end->x)) &&
+        (point->x - COORD_SNAP_SCALE <= HIGHEST(start->x, end->x)) &&
+        (point->y + COORD_SNAP_SCALE >= LOWEST(start->y, end->y)) &&
+        (point->y - COORD_SNAP_SCALE <= HIGHEST(start->y, end->y))) {
+      DEBUGF("Point is coincident with edge %d\n", s);
+      return true;
+    }
+
+    /* Count the edges crossed by a ray from the point to infinite +x.
+       Each edge includes its lower endpoint but not its upper endpoint,
+       to avoid erroneously recording two crossings at one corner. */
+    if ((start->y > point->y) != (end->y > point->y)) {
+      if ((cross > 0) == (end->y > start->y)) {
+        DEBUGF("%s\n", is_inside ? "Inside to outside" : "Outside to inside");
+        is_inside = !is_inside;
+      }
+    }
+  }
+
+  return is_inside;
+}
+#endif /* COORD_SNAP */
+
 /* This implementation allows for floating-point error and assumes that
    nearby points are contained within a polygon. This is important because
-   it is used to decide which half of a split polygon to delete. */
+   it is used to decide which half of a split polygon to delete. The point
+   is side t of another projected primitive. */
 static bool primitive_contains_point(Primitive * const primitive,
+                                     const Projection * const proj,
                                      const VertexArray * const varray,
-                                     const int v, const Plane plane)
+                                     const Projection * const points,
+                                     const int t, const Plane plane)
 {
   bool is_inside = false;
 
   assert(primitive != NULL);
+  assert(proj != NULL);
+  assert(points != NULL);
+  assert(t >= 0);
+  assert(t < points->nsides);
+  NOT_USED(varray);
+#if !BBOX && !COORD_SNAP
+  NOT_USED(plane);
+#endif
 
-  const int nsides = primitive_get_num_sides(primitive);
+  const VertexIndex v = points->sides[t];
+
+  const int nsides = proj->nsides;
   if (nsides < 3) {
-    DEBUGF("Primitive %p with %d sides can't contain point %d\n",
+    DEBUGF("Primitive %p with %d sides can't contain point %"PVERTEXINDEX"\n",
            (void *)primitive, nsides, v);
     return false;
   }
 
-  Coord (*start)[3];
-  Coord start_x, start_y;
-
-  const int last_side = primitive_get_side(primitive, nsides - 1);
-  if (last_side == v) {
-    DEBUGF("Point %d is also the end of the last edge\n", v);
-    return true;
+  for (int s = 0; s < nsides; ++s) {
+    if (proj->sides[s] == v) {
+      DEBUGF("Point %"PVERTEXINDEX" is also the start of edge %d\n", v, s);
+      return true;
+    }
   }
 
-  Coord (*end)[3] = vertex_array_get_coords(varray, last_side);
-  Coord end_x = *vector_x(end, plane);
-  Coord end_y = *vector_y(end, plane);
-
-  Coord (* const point)[3] = vertex_array_get_coords(varray, v);
-  const Coord px = *vector_x(point, plane);
-  Coord py = *vector_y(point, plane);
+  const Coord px = points->x[t + 1];
+  const Coord py = points->y[t + 1];
 
 #if BBOX
   /* If the point is outside the bounding box (even allowing for error)
      then it can't be inside the polygon. */
   assert(primitive->has_bbox);
-  if (!vector_xy_greater_or_equal(point, &primitive->low, plane) ||
-      !vector_xy_greater_or_equal(&primitive->high, point, plane)) {
-    DEBUGF("Point %d is outside bounding box of primitive %p\n",
+  if (coord_less_than(px, primitive->low[plane.x]) ||
+      coord_less_than(py, primitive->low[plane.y]) ||
+      coord_less_than(primitive->high[plane.x], px) ||
+      coord_less_than(primitive->high[plane.y], py)) {
+    DEBUGF("Point %"PVERTEXINDEX" is outside bounding box of primitive %p\n",
            v, (void *)primitive);
     return false;
   }
 #endif /* BBOX */
 
-  Coord const top_y = primitive_get_top_y(primitive, varray, plane);
+#if COORD_SNAP
+  if (proj->snapped) {
+    /* Snapping only needs to be repeated if some point couldn't be */
+    SnapPoint snap;
+    if (points->snapped) {
+      return primitive_snap_contains_point(proj, &points->snap[t + 1]);
+    }
+    if (vector_snap(vertex_array_get_coords(varray, v), plane, &snap)) {
+      return primitive_snap_contains_point(proj, &snap);
+    }
+  }
+#endif /* COORD_SNAP */
+
+  /* Select edges that might be in the path of a ray from the point
+     to be tested to infinite +x by ignoring edges left of the point. */
+  bool select[MaxSides];
+  for (int s = 0; s < nsides; ++s) {
+    select[s] = !coord_less_than(HIGHEST(proj->x[s + 1], proj->x[s]), px);
+  }
 
-  for (int s = 0;
-       s < nsides; ++s,
-       end = start, end_x = start_x, end_y = start_y) {
+  Coord const top_y = proj->top_y;
 
-    const int v2 = primitive_get_side(primitive, s);
-    if (v2 == v) {
-      DEBUGF("Point %d is also the start of edge %d\n", v, s);
-      return true;
+  for (int s = 0; s < nsides; ++s) {
+    if (!select[s]) {
+      continue;
     }
 
-    start = vertex_array_get_coords(varray, v2);
-    start_x = *vector_x(start, plane);
-    start_y = *vector_y(start, plane);
-    assert(end_x == *vector_x(end, plane));
-    assert(end_y == *vector_y(end, plane));
+    const Coord start_x = proj->x[s + 1], start_y = proj->y[s + 1];
+    const Coord end_x = proj->x[s], end_y = proj->y[s];
 
-    DEBUGF("Testing point %d:%"PCOORD",%"PCOORD" against edge %d:"
+    DEBUGF("Testing point %"PVERTEXINDEX":%"PCOORD",%"PCOORD" against edge %d:"
            "%"PCOORD",%"PCOORD" .. %"PCOORD",%"PCOORD"\n",
             v, px, py, s, start_x, start_y, end_x, end_y);
 
-    /* Select edges that might be in the path of a ray from the point
-       to be tested to infinite +x. */
-
-    /* Ignore edges left of the point to be tested. */
-    const Coord high_x = HIGHEST(start_x, end_x);
-    if (coord_less_than(high_x, px)) {
-      continue;
-    }
-
     /* Treat horizontal edges specially to avoid division by 0: */
     if (coord_equal(end_y, start_y)) {
       /* Ignore horizontal edges right of the point to be tested. */
@@ -563,7 +783,8 @@ static bool primitive_contains_point(Primitive * const primitive,
 
       if (coord_equal(py, end_y) || coord_equal(py, start_y)) {
         /* Horizontal edge intersects the point at its y coordinate. */
-        DEBUGF("Point %d is coincident with horizontal edge %d\n", v, s);
+        DEBUGF("Point %"PVERTEXINDEX" is coincident with horizontal edge %d\n",
+               v, s);
         return true;
       }
 
@@ -605,8 +826,8 @@ static bool primitive_contains_point(Primitive * const primitive,
       intersect_x = start_x;
     } else {
       /* Sloping edge intersects the horizontal ray somewhere
-          along its length. */
-      const Coord m = vector_y_gradient(start, end, plane);
+          along its length. This is the same as vector_y_gradient. */
+      const Coord m = (end_y - start_y) / (end_x - start_x);
        /* The equation of any line is y=mx+c.
           This can be rearranged as c=y-mx. Since we know m, we can
           can substitute the coordinates of any point on the line into
@@ -625,7 +846,7 @@ static bool primitive_contains_point(Primitive * const primitive,
     /* Unfortunately an inexact comparison here allows more leeway for
        points near steep lines than shallow ones. */
     if (coord_equal(px, intersect_x)) {
-      DEBUGF("Point %d is coincident with edge %d\n", v, s);
+      DEBUGF("Point %"PVERTEXINDEX" is coincident with edge %d\n", v, s);
       return true;
     }
 
@@ -659,12 +880,15 @@ bool primitive_contains(Primitive * const q, Primitive * const p,
 #endif /* BBOX */
 
   /* Check for any vertices of primitive P lying within primitive Q. */
-  const int nsides_p = primitive_get_num_sides(p);
+  Projection proj, points;
+  primitive_project(q, varray, plane, &proj);
+  primitive_project_sides(p, varray, plane, &points);
+
+  const int nsides_p = points.nsides;
   for (int t = 0; t < nsides_p; ++t) {
-    const int side_p = primitive_get_side(p, t);
-    if (!primitive_contains_point(q, varray, side_p, plane)) {
-      DEBUGF("Primitive %p does not contain side %d (vertex %d) "
-             "of primitive %p\n", (void *)q, t, side_p, (void *)p);
+    if (!primitive_contains_point(q, &proj, varray, &points, t, plane)) {
+      DEBUGF("Primitive %p does not contain side %d (vertex %"PVERTEXINDEX") "
+             "of primitive %p\n", (void *)q, t, points.sides[t], (void *)p);
       return false;
     }
   }
@@ -687,34 +911,35 @@ bool primitive_equal(const Primitive * const q, const Primitive * const p)
 
   if (nsides_p > 0) {
     /* Search for the first vertex of P in Q. */
-    const int first_side_p = primitive_get_side(p, 0);
+    const VertexIndex first_side_p = primitive_get_side(p, 0);
     bool found = false;
     int s;
     for (s = 0; !found && (s < nsides_q); ++s) {
-      const int side_q = primitive_get_side(q, s);
+      const VertexIndex side_q = primitive_get_side(q, s);
       if (side_q == first_side_p) {
-        DEBUGF("Found first vertex %d of primitive %p as side %d/%d of %p\n",
+        DEBUGF("Found first vertex %"PVERTEXINDEX" of primitive %p "
+               "as side %d/%d of %p\n",
                 first_side_p, (void *)p, s, nsides_q, (void *)q);
         found = true;
       }
     }
 
     if (!found) {
-      DEBUGF("First vertex %d of primitive %p is not in %p\n",
+      DEBUGF("First vertex %"PVERTEXINDEX" of primitive %p is not in %p\n",
               first_side_p, (void *)p, (void *)q);
       return false;
     }
 
     /* Check that the following vertices are the same in P and Q. */
     for (int t = 1 /* intentional */; t < nsides_p; ++t, ++s) {
-      const int side_p = primitive_get_side(p, t);
+      const VertexIndex side_p = primitive_get_side(p, t);
       if (s >= nsides_q) {
         s = 0;
       }
-      const int side_q = primitive_get_side(q, s);
+      const VertexIndex side_q = primitive_get_side(q, s);
       if (side_q != side_p) {
-        DEBUGF("Side %d/%d (%d) of primitive %p mismatches "
-               "side %d/%d (%d) of %p\n",
+        DEBUGF("Side %d/%d (%"PVERTEXINDEX") of primitive %p mismatches "
+               "side %d/%d (%"PVERTEXINDEX") of %p\n",
                t, nsides_p, side_p, (void *)p,
                s, nsides_q, side_q, (void *)q);
         return false;
@@ -726,29 +951,59 @@ bool primitive_equal(const Primitive * const q, const Primitive * const p)
   return true;
 }
 
-bool primitive_intersect(const Primitive * const primitive,
-                         const int a, const int b,
-                         const VertexArray * const varray,
-                         const Plane plane)
+/* The edge runs from vertex a at (ax,ay) to vertex b at (bx,by). */
+static bool primitive_intersect_edge(const Primitive * const primitive,
+                                     const Projection * const proj,
+                                     const VertexIndex a, const Coord ax,
+                                     const Coord ay, const VertexIndex b,
+                                     const Coord bx, const Coord by,
+                                     const VertexArray * const varray,
+                                     const Plane plane)
 {
-  const int nsides = primitive_get_num_sides(primitive);
+  assert(proj != NULL);
+
+  const int nsides = proj->nsides;
   if (nsides < 3) {
     /* We might be able to handle this for lines and points in future
        but there's currently no need. */
-    DEBUGF("Primitive %p with %d sides can't intersect with edge %d,%d\n",
+    DEBUGF("Primitive %p with %d sides can't intersect with edge "
+           "%"PVERTEXINDEX",%"PVERTEXINDEX"\n",
            (void *)primitive, nsides, a, b);
   } else {
-    int last_side = primitive_get_side(primitive, nsides-1);
-    /* Use last_side twice: first as the start of an edge and last as the end
-       of an edge. */
+    const Coord ab_low_x = LOWEST(ax, bx), ab_high_x = HIGHEST(ax, bx),
+                ab_low_y = LOWEST(ay, by), ab_high_y = HIGHEST(ay, by);
+
+    /* Select edges whose extent overlaps that of the given edge. These
+       are the same tests that vertex_array_edges_intersect begins with. */
+    bool select[MaxSides];
     for (int s = 0; s < nsides; ++s) {
-      const int side = primitive_get_side(primitive, s);
+      const Coord cd_low_x = LOWEST(proj->x[s], proj->x[s + 1]),
+                  cd_high_x = HIGHEST(proj->x[s], proj->x[s + 1]),
+                  cd_low_y = LOWEST(proj->y[s], proj->y[s + 1]),
+                  cd_high_y = HIGHEST(proj->y[s], proj->y[s + 1]);
+
+      select[s] = !coord_less_than(cd_high_x, ab_low_x) &&
+                  !coord_less_than(ab_high_x, cd_low_x) &&
+                  !coord_less_than(cd_high_y, ab_low_y) &&
+                  !coord_less_than(ab_high_y, cd_low_y);
+    }
+
+    /* Use the last side twice: first as the start of an edge and last as
+       the end of an edge. */
+    for (int s = 0; s < nsides; ++s) {
+      if (!select[s]) {
+        continue;
+      }
+
+      const VertexIndex last_side = proj->sides[s > 0 ? s - 1 : nsides - 1];
+      const VertexIndex side = proj->sides[s];
 
       /* Shared vertices don't count. */
       if ((a == last_side) || (b == last_side) ||
           (a == side) || (b == side)) {
-        DEBUGF("Edge %d .. %d is joined with line %d .. %d "
-               "(shared vertex)\n", a, b, last_side, side);
+        DEBUGF("Edge %"PVERTEXINDEX" .. %"PVERTEXINDEX" is joined with "
+               "line %"PVERTEXINDEX" .. %"PVERTEXINDEX" (shared vertex)\n",
+               a, b, last_side, side);
       } else {
         Coord intersect[3];
         if (vertex_array_edges_intersect(varray, a, b, last_side, side,
@@ -759,33 +1014,54 @@ bool primitive_intersect(const Primitive * const primitive,
              We cannot treat any endpoints of the back polygon's edges as
              exclusive because it's common for a back polygon to be split by
              a line that happens to pass through one of its corners. */
-          if (vector_equal(&intersect,
-                           vertex_array_get_coords(varray, a))) {
-            DEBUGF("Edge %d .. %d is joined with line %d .. %d "
-                   "(at vertex %d)\n", a, b, last_side, side, a);
-          } else if (vector_equal(&intersect,
-                                  vertex_array_get_coords(varray, b))) {
-            DEBUGF("Edge %d .. %d is joined with line %d .. %d "
-                   "(at vertex %d)\n", a, b, last_side, side, b);
+          Coord (* const va)[3] = vertex_array_get_coords(varray, a);
+          Coord (* const vb)[3] = vertex_array_get_coords(varray, b);
+          if (vector_equal(&intersect, va)) {
+            DEBUGF("Edge %"PVERTEXINDEX" .. %"PVERTEXINDEX" is joined with "
+                   "line %"PVERTEXINDEX" .. %"PVERTEXINDEX" "
+                   "(at vertex %"PVERTEXINDEX")\n", a, b, last_side, side, a);
+          } else if (vector_equal(&intersect, vb)) {
+            DEBUGF("Edge %"PVERTEXINDEX" .. %"PVERTEXINDEX" is joined with "
+                   "line %"PVERTEXINDEX" .. %"PVERTEXINDEX" "
+                   "(at vertex %"PVERTEXINDEX")\n", a, b, last_side, side, b);
           } else {
-            DEBUGF("Side %d (%d) of primitive %p intersects edge %d,%d\n",
+            DEBUGF("Side %d (%"PVERTEXINDEX") of primitive %p intersects "
+                   "edge %"PVERTEXINDEX",%"PVERTEXINDEX"\n",
                     s, side, (void *)primitive, a, b);
             return true;
           }
         }
       }
-      last_side = side;
     }
   }
 
-  DEBUGF("Primitive %p and edge %d,%d do not intersect\n",
+  DEBUGF("Primitive %p and edge %"PVERTEXINDEX",%"PVERTEXINDEX
+         " do not intersect\n",
          (void *)primitive, a, b);
   return false;
 }
 
-bool primitive_split(Primitive * const primitive, const int a, const int b,
-                     VertexArray * const varray, const Plane plane,
-                     Primitive * const out, bool * const split)
+bool primitive_intersect(const Primitive * const primitive,
+                         const VertexIndex a, const VertexIndex b,
+                         const VertexArray * const varray,
+                         const Plane plane)
+{
+  Coord (* const va)[3] = vertex_array_get_coords(varray, a);
+  Coord (* const vb)[3] = vertex_array_get_coords(varray, b);
+  Projection proj;
+  primitive_project_sides(primitive, varray, plane, &proj);
+  return primitive_intersect_edge(primitive, &proj,
+                                  a, *vector_x(va, plane), *vector_y(va, plane),
+                                  b, *vector_x(vb, plane), *vector_y(vb, plane),
+                                  varray, plane);
+}
+
+static bool primitive_split_counted(Primitive * const primitive,
+                                    const VertexIndex a, const VertexIndex b,
+                                    VertexArray * const varray,
+                                    const Plane plane, Primitive * const out,
+                                    bool * const split,
+                                    PrimitiveClipStats * const stats)
 {
   assert(out != NULL);
   assert(split != NULL);
@@ -803,26 +1079,32 @@ bool primitive_split(Primitive * const primitive, const int a, const int b,
     DEBUGF("Can't split primitive %p with %d sides\n",
            (void *)primitive, num_sides);
   } else {
-    int last_side = primitive_get_side(primitive, num_sides-1);
+    VertexIndex last_side = primitive_get_side(primitive, num_sides-1);
 
     for (int s = 0; s < num_sides; ++s) {
-      const int side = primitive_get_side(primitive, s);
-      DEBUGF("Back side %d/%d: %d\n", s, num_sides, side);
+      const VertexIndex side = primitive_get_side(primitive, s);
+      DEBUGF("Back side %d/%d: %"PVERTEXINDEX"\n", s, num_sides, side);
 
       Coord intersect[3];
       if ((state != SPLIT_COMPLETE) &&
           vertex_array_edge_intersects_line(varray, last_side, side,
                                             a, b, plane, &intersect))
       {
-        DEBUGF("Splitting edge %d .. %d with line %d .. %d\n",
+        DEBUGF("Splitting edge %"PVERTEXINDEX" .. %"PVERTEXINDEX
+               " with line %"PVERTEXINDEX" .. %"PVERTEXINDEX"\n",
                 last_side, side, a, b);
 
-        int v = vertex_array_find_vertex(varray, &intersect);
+        VertexIndex v = vertex_array_find_vertex(varray, &intersect);
         if (v < 0) {
           v = vertex_array_add_vertex(varray, &intersect);
           if (v < 0) {
             return false;
           }
+          if (stats != NULL) {
+            ++stats->nvertices_added;
+          }
+        } else if (stats != NULL) {
+          ++stats->nvertices_found;
         }
 
         if (state == SPLIT_IN_PROGRESS) {
@@ -888,7 +1170,7 @@ bool primitive_split(Primitive * const primitive, const int a, const int b,
            tmp_sides, (void *)&tmp, (void *)primitive);
 
     for (int s = 0; s < tmp_sides; ++s) {
-      const int side = primitive_get_side(&tmp, s);
+      const VertexIndex side = primitive_get_side(&tmp, s);
       if (primitive_add_side(primitive, side) < 0) {
         return false;
       }
@@ -903,6 +1185,7 @@ bool primitive_split(Primitive * const primitive, const int a, const int b,
       for (size_t n = 0; n < ARRAY_SIZE(out->normal); ++n) {
         out->normal[n] = primitive->normal[n];
       }
+      out->plane_z = primitive->plane_z;
       out->has_normal = true;
     }
   } else {
@@ -912,10 +1195,20 @@ bool primitive_split(Primitive * const primitive, const int a, const int b,
   return true;
 }
 
-bool primitive_clip(Primitive * const primitive,
-                    Primitive * const clipper,
-                    VertexArray * const varray, const Plane plane,
-                    Primitive * const out, bool * const split)
+bool primitive_split(Primitive * const primitive, const VertexIndex a,
+                     const VertexIndex b,
+                     VertexArray * const varray, const Plane plane,
+                     Primitive * const out, bool * const split)
+{
+  return primitive_split_counted(primitive, a, b, varray, plane, out, split,
+                                 NULL);
+}
+
+bool primitive_clip_stats(Primitive * const primitive,
+                          Primitive * const clipper,
+                          VertexArray * const varray, const Plane plane,
+                          Primitive * const out, bool * const split,
+                          PrimitiveClipStats * const stats)
 {
   assert(clipper != NULL);
   assert(clipper != primitive);
@@ -934,6 +1227,9 @@ bool primitive_clip(Primitive * const primitive,
   if (!vector_xy_less_than(&clipper->low, &primitive->high, plane) ||
       !vector_xy_less_than(&primitive->low, &clipper->high, plane)) {
     DEBUGF("Primitive bboxes do not overlap\n");
+    if (stats != NULL) {
+      ++stats->nbbox_rejected;
+    }
     return true;
   }
 #endif /* BBOX */
@@ -948,22 +1244,33 @@ bool primitive_clip(Primitive * const primitive,
     return false;
   }
 
-  int last_side = primitive_get_side(clipper, num_sides-1);
+  /* The back primitive is only modified by splitting it, which ends the
+     loop, so it only needs to be projected once. The front primitive's
+     vertices are also projected once instead of for each test. */
+  Projection proj, front;
+  primitive_project(primitive, varray, plane, &proj);
+  primitive_project_sides(clipper, varray, plane, &front);
+
+  VertexIndex last_side = front.sides[num_sides - 1];
   bool last_inside = primitive_contains_point(
-                       primitive, varray, last_side, plane);
+                       primitive, &proj, varray, &front, num_sides - 1, plane);
 
   for (int t = 0; !(*split) && (t < num_sides); ++t) {
-    const int side = primitive_get_side(clipper, t);
-    DEBUGF("Front side %d: %d\n", t, side);
+    const VertexIndex side = front.sides[t];
+    DEBUGF("Front side %d: %"PVERTEXINDEX"\n", t, side);
 
+    /* Element 0 of the arrays of coordinates is the last vertex */
     const bool this_inside = primitive_contains_point(
-                               primitive, varray, side, plane);
+                               primitive, &proj, varray, &front, t, plane);
     if ((last_inside && this_inside) ||
-        primitive_intersect(primitive, last_side, side, varray, plane)) {
+        primitive_intersect_edge(primitive, &proj,
+                                 last_side, front.x[t], front.y[t],
+                                 side, front.x[t + 1], front.y[t + 1],
+                                 varray, plane)) {
       /* The back polygon contains or is intersected by this edge of the front
          primitive so we need to split it along the line of the edge. */
-      if (!primitive_split(primitive, last_side, side,
-                           varray, plane, out, split)) {
+      if (!primitive_split_counted(primitive, last_side, side,
+                                   varray, plane, out, split, stats)) {
         DEBUGF("Clipping of primitive %p failed\n", (void *)primitive);
         return false;
       }
@@ -976,13 +1283,22 @@ bool primitive_clip(Primitive * const primitive,
   return true;
 }
 
+bool primitive_clip(Primitive * const primitive,
+                    Primitive * const clipper,
+                    VertexArray * const varray, const Plane plane,
+                    Primitive * const out, bool * const split)
+{
+  return primitive_clip_stats(primitive, clipper, varray, plane, out, split,
+                              NULL);
+}
+
 void primitive_set_used(const Primitive * const primitive,
                         const VertexArray * const varray)
 {
   const int num_sides = primitive_get_num_sides(primitive);
 
   for (int s = 0; s < num_sides; ++s) {
-    const int v = primitive_get_side(primitive, s);
+    const VertexIndex v = primitive_get_side(primitive, s);
     vertex_array_set_used(varray, v);
   }
 }
@@ -997,11 +1313,11 @@ int primitive_get_skew_side(Primitive * const primitive,
            (void *)primitive, num_sides);
   } else {
     /* Check for skew polygons. */
-    const int v0 = primitive_get_side(primitive, 0);
+    const VertexIndex v0 = primitive_get_side(primitive, 0);
     Coord (* const coords)[3] = vertex_array_get_coords(varray, v0);
 
     for (int s = 3; s < num_sides; ++s) {
-       const int v = primitive_get_side(primitive, s);
+       const VertexIndex v = primitive_get_side(primitive, s);
 
       /* Check that each side of the primitive is orthogonal to the normal
          of the first two sides. The volume of the parallelepiped
@@ -25,6 +25,16 @@
                   Added a macro to allow bounding box optimisations to be
                   disabled.
   CJB: 11-Dec-20: Removed redundant uses of the 'extern' keyword.
+  CJB: 14-Oct-26: Reinstated primitive_get_bbox for use by the clipping
+                  module.
+                  Added primitive_set_side.
+                  The maximum number of sides is now set by a macro.
+                  Cached data now precedes the sides so that it shares
+                  cache lines with the first few sides.
+                  Added primitive_clip_stats.
+                  The plane found from the normal vector is now cached.
+                  Added primitive_precompute.
+                  Sides are now of type VertexIndex.
  */
 
 #ifndef PRIMITIVE_H
@@ -41,27 +51,46 @@
      BBOX=0: 5.24 seconds
      BBOX=1: 2.66 seconds (roughly double speed)
 */
+#ifndef BBOX
 #define BBOX 1
+#endif
+
+/* Maximum number of sides of a primitive. Every primitive has space for
+   this many, so a smaller value makes groups of triangles and quadrilaterals
+   more compact, whereas a bigger value allows more complex polygons (e.g.
+   fragments produced by clipping). The default is 15. */
+#ifndef PRIMITIVE_MAX_SIDES
+#define PRIMITIVE_MAX_SIDES 15
+#endif
+
+#if PRIMITIVE_MAX_SIDES < 3
+#error PRIMITIVE_MAX_SIDES must be at least 3
+#endif
 
 typedef struct {
   int colour;
   int id;
   int nsides;
-  int sides[15];
-  Coord normal[3];
   bool has_normal;
+  unsigned char plane_z; /* biggest component of the normal, if any */
 #if BBOX
   bool has_bbox;
+#endif
+  Coord normal[3];
+#if BBOX
   Coord low[3];
   Coord high[3];
 #endif
+  VertexIndex sides[PRIMITIVE_MAX_SIDES]; /* only the first nsides are used */
 } Primitive;
 
 void primitive_init(Primitive *primitive);
 
-int primitive_get_side(const Primitive *primitive, int n);
+VertexIndex primitive_get_side(const Primitive *primitive, int n);
 
-int primitive_add_side(Primitive *primitive, int v);
+int primitive_add_side(Primitive *primitive, VertexIndex v);
+
+int primitive_set_side(Primitive *primitive, int n, VertexIndex v);
 
 void primitive_delete_all(Primitive *primitive);
 
@@ -88,6 +117,15 @@ void primitive_set_id(Primitive *primitive, int id);
 bool primitive_coplanar(Primitive *p, Primitive *q,
                         const VertexArray *varray);
 
+bool primitive_get_bbox(Primitive *primitive,
+                        const VertexArray *varray,
+                        Coord (*low)[3], Coord (*high)[3]);
+
+/* Computes any of the normal vector, plane and bounding box which aren't
+   cached, so that later calls don't need to read the vertices. Returns
+   true if the primitive has a normal vector. */
+bool primitive_precompute(Primitive *primitive, const VertexArray *varray);
+
 bool primitive_find_plane(Primitive *primitive,
                           const VertexArray *varray, Plane *plane);
 
@@ -97,10 +135,10 @@ bool primitive_contains(Primitive *q, Primitive *p,
 bool primitive_equal(const Primitive *q, const Primitive *p);
 
 bool primitive_intersect(const Primitive *primitive,
-                         int a, int b,
+                         VertexIndex a, VertexIndex b,
                          const VertexArray *varray, Plane plane);
 
-bool primitive_split(Primitive *primitive, int a, int b,
+bool primitive_split(Primitive *primitive, VertexIndex a, VertexIndex b,
                      VertexArray *varray, Plane plane,
                      Primitive *out, bool *split);
 
@@ -109,6 +147,21 @@ bool primitive_clip(Primitive *primitive,
                     VertexArray *varray, Plane plane,
                     Primitive *out, bool *split);
 
+/* Counts of events during calls to primitive_clip_stats. */
+typedef struct {
+  long long nbbox_rejected; /* bounding boxes didn't overlap */
+  long long nvertices_added; /* intersections at new vertices */
+  long long nvertices_found; /* intersections at existing vertices */
+} PrimitiveClipStats;
+
+/* Same as primitive_clip except that events are added to the counts in
+   stats (if not NULL). */
+bool primitive_clip_stats(Primitive *primitive,
+                          Primitive *clipper,
+                          VertexArray *varray, Plane plane,
+                          Primitive *out, bool *split,
+                          PrimitiveClipStats *stats);
+
 void primitive_set_used(const Primitive *primitive,
                         const VertexArray *varray);
 
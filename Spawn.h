@@ -0,0 +1,41 @@
+/*
+ * 3dObjLib: Callbacks for starting threads
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this header file from parts of Clip.h.
+ */
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <stdbool.h>
+
+/* Type of function to be run on a separate thread. */
+typedef void ClipThreadFn(void *arg);
+
+/* Type of function supplied by the caller of clip_polygons_parallel (and
+   other functions that can use several threads) to start threads. It must
+   call fn once for each of the nthreads elements of args, concurrently if
+   possible, and not return until every call has returned. It should return
+   false if any of the calls could not be made, in which case the result of
+   any that were made is ignored. */
+typedef bool ClipSpawnFn(void *context, int nthreads, ClipThreadFn *fn,
+                         void *const args[]);
+
+#endif /* SPAWN_H */
@@ -0,0 +1,613 @@
+/*
+ * 3dObjLib: Tiled processing of scenes
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this source file.
+                  Vertex numbers are now of type VertexIndex.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+/* Local header files */
+#include "Internal/3dObjMisc.h"
+#include "TileGrid.h"
+#include "Coord.h"
+#include "Vertex.h"
+#include "Group.h"
+#include "Primitive.h"
+#include "Writer.h"
+#include "Clip.h"
+#include "ObjFile.h"
+
+enum {
+  /* Cutting a convex polygon along a plane adds at most one side */
+  CUT_MAX_POINTS = PRIMITIVE_MAX_SIDES + 6
+};
+
+/* A point of a primitive being cut, and the line segment on which the edge
+   to the next point lies. Points of intersection are always interpolated
+   along the whole of an original edge of the primitive, or the whole of an
+   edge made by cutting it, so that neighbouring tiles find the same points
+   however much of the edge each of them has. */
+typedef struct {
+  Coord coords[3];
+  VertexIndex v; /* vertex number, or -1 for a new point */
+  Coord line[2][3];
+  bool chord; /* the edge to the next point hasn't got a line yet */
+} CutPoint;
+
+/* A plane along which primitives are cut, keeping the side above it
+   (if low) or below it. */
+typedef struct {
+  int dim;
+  Coord pos;
+  bool low;
+} CutPlane;
+
+static Coord tile_boundary(const TileGrid * const grid, const size_t dim,
+                           const int k)
+{
+  assert(grid != NULL);
+  assert(dim < ARRAY_SIZE(grid->size));
+  assert(k > 0);
+  assert(k < grid->ntiles[dim]);
+  return grid->low[dim] + (Coord)k * grid->size[dim];
+}
+
+bool tile_grid_init(TileGrid * const grid, Coord (* const low)[3],
+                    Coord (* const high)[3], Coord (* const size)[3])
+{
+  assert(grid != NULL);
+  assert(low != NULL);
+  assert(high != NULL);
+  assert(size != NULL);
+
+  long long total = 1;
+  for (size_t dim = 0; dim < ARRAY_SIZE(grid->ntiles); ++dim) {
+    assert((*size)[dim] >= 0);
+    grid->low[dim] = (*low)[dim];
+    grid->size[dim] = (*size)[dim];
+    grid->ntiles[dim] = 1;
+
+    if (((*size)[dim] > 0) && ((*high)[dim] > (*low)[dim])) {
+      const double n = ceil(((double)(*high)[dim] - (*low)[dim]) /
+                            (*size)[dim]);
+      if (n > INT_MAX) {
+        DEBUGF("Too many tiles in dimension %zu\n", dim);
+        return false;
+      }
+      grid->ntiles[dim] = n < 1 ? 1 : (int)n;
+    }
+
+    total *= grid->ntiles[dim];
+    if (total > INT_MAX) {
+      DEBUGF("Too many tiles\n");
+      return false;
+    }
+  }
+
+  DEBUGF("Grid of %d x %d x %d tiles\n",
+         grid->ntiles[0], grid->ntiles[1], grid->ntiles[2]);
+  return true;
+}
+
+int tile_grid_get_num_tiles(const TileGrid * const grid)
+{
+  assert(grid != NULL);
+  return grid->ntiles[0] * grid->ntiles[1] * grid->ntiles[2];
+}
+
+static void get_tile_pos(const TileGrid * const grid, int t,
+                         int (* const pos)[3])
+{
+  assert(grid != NULL);
+  assert(t >= 0);
+  assert(t < tile_grid_get_num_tiles(grid));
+  assert(pos != NULL);
+
+  for (size_t dim = 0; dim < ARRAY_SIZE(*pos); ++dim) {
+    (*pos)[dim] = t % grid->ntiles[dim];
+    t /= grid->ntiles[dim];
+  }
+}
+
+void tile_grid_get_bounds(const TileGrid * const grid, const int t,
+                          Coord (* const low)[3], Coord (* const high)[3])
+{
+  assert(low != NULL);
+  assert(high != NULL);
+
+  int pos[3];
+  get_tile_pos(grid, t, &pos);
+  for (size_t dim = 0; dim < ARRAY_SIZE(pos); ++dim) {
+    (*low)[dim] = (pos[dim] > 0) ?
+                  tile_boundary(grid, dim, pos[dim]) : -(Coord)HUGE_VAL;
+    (*high)[dim] = (pos[dim] < grid->ntiles[dim] - 1) ?
+                   tile_boundary(grid, dim, pos[dim] + 1) : (Coord)HUGE_VAL;
+  }
+}
+
+/* Points within MAX_FLT_ERR of a plane are treated as on it, otherwise
+   cutting would make edges too short for primitive_coplanar. Both tiles
+   test the same coordinates, so they agree about which points are on it. */
+static bool is_on(const CutPlane * const plane, const Coord * const coords)
+{
+  assert(plane != NULL);
+  assert(coords != NULL);
+  return coord_equal(coords[plane->dim], plane->pos);
+}
+
+static bool is_inside(const CutPlane * const plane,
+                      const Coord * const coords)
+{
+  assert(plane != NULL);
+  assert(coords != NULL);
+  const Coord c = coords[plane->dim];
+  return is_on(plane, coords) ||
+         (plane->low ? (c > plane->pos) : (c < plane->pos));
+}
+
+static int compare_coords(const Coord * const a, const Coord * const b)
+{
+  for (size_t dim = 0; dim < 3; ++dim) {
+    if (a[dim] != b[dim]) {
+      return (a[dim] < b[dim]) ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/* Finds the point at which a line segment crosses a plane, interpolating
+   from the same end of the segment regardless of its direction. */
+static void cut_line(const CutPoint * const from,
+                     const CutPlane * const plane, Coord (* const coords)[3])
+{
+  assert(from != NULL);
+  assert(plane != NULL);
+  assert(coords != NULL);
+
+  const bool swap = compare_coords(from->line[0], from->line[1]) > 0;
+  const Coord * const a = from->line[swap ? 1 : 0];
+  const Coord * const b = from->line[swap ? 0 : 1];
+  const int d = plane->dim;
+  assert(a[d] != b[d]);
+
+  const Coord t = (plane->pos - a[d]) / (b[d] - a[d]);
+  for (size_t dim = 0; dim < ARRAY_SIZE(*coords); ++dim) {
+    (*coords)[dim] = a[dim] + (b[dim] - a[dim]) * t;
+  }
+  (*coords)[d] = plane->pos;
+}
+
+static void set_line(CutPoint * const point, const CutPoint * const to)
+{
+  assert(point != NULL);
+  assert(to != NULL);
+  memcpy(point->line[0], point->coords, sizeof(point->coords));
+  memcpy(point->line[1], to->coords, sizeof(to->coords));
+  point->chord = false;
+}
+
+/* Cuts a closed polygon (if closed) or a line segment along a plane.
+   Returns the new number of points, or -1 if there are too many. */
+static int cut_points(const CutPoint * const in, const int n,
+                      const bool closed, const CutPlane * const plane,
+                      CutPoint * const out)
+{
+  assert(in != NULL);
+  assert(n > 0);
+  assert(plane != NULL);
+  assert(out != NULL);
+
+  int nout = 0;
+  const int nedges = closed ? n : n - 1;
+
+  for (int k = 0; k < n; ++k) {
+    const CutPoint * const p = in + k;
+    const bool p_inside = is_inside(plane, p->coords);
+
+    if (p_inside) {
+      if (nout >= CUT_MAX_POINTS) {
+        return -1;
+      }
+      out[nout++] = *p;
+    }
+
+    if (k >= nedges) {
+      continue;
+    }
+
+    const CutPoint * const q = in + (k + 1) % n;
+    const bool q_inside = is_inside(plane, q->coords);
+    if (p_inside == q_inside) {
+      continue;
+    }
+
+    if (p_inside && is_on(plane, p->coords)) {
+      /* Leaving from a point on the plane: no new point is needed but the
+         edge from it now runs along the plane */
+      out[nout - 1].chord = closed;
+      continue;
+    }
+    if (q_inside && is_on(plane, q->coords)) {
+      continue; /* entering at a point on the plane */
+    }
+
+    if (nout >= CUT_MAX_POINTS) {
+      return -1;
+    }
+    CutPoint * const cut = out + nout++;
+    cut_line(p, plane, &cut->coords);
+    cut->v = -1;
+    /* Entering: the edge to q is on the same line as before.
+       Leaving: the edge runs along the plane to the next point. */
+    memcpy(cut->line, p->line, sizeof(cut->line));
+    cut->chord = p_inside && closed;
+  }
+
+  /* Each edge along the plane lies on the line between its ends */
+  for (int k = 0; k < nout; ++k) {
+    if (out[k].chord) {
+      set_line(out + k, out + (k + 1) % nout);
+    }
+  }
+
+  return nout;
+}
+
+/* Finds whether a primitive cut to the bounds of a tile belongs to it, given
+   its points. Points may be slightly outside the tile (see is_on), so the
+   centre of a primitive on the boundary between two tiles is compared with
+   both bounds; it belongs to the tile above the boundary unless its centre
+   is below the boundary. */
+static bool is_owned(const CutPoint * const points, const int n,
+                     const Coord * const low, const Coord * const high)
+{
+  assert(points != NULL);
+  assert(n > 0);
+  assert(low != NULL);
+  assert(high != NULL);
+
+  for (size_t dim = 0; dim < 3; ++dim) {
+    double sum = 0.0;
+    for (int k = 0; k < n; ++k) {
+      sum += points[k].coords[dim];
+    }
+    const Coord centre = (Coord)(sum / n);
+    if ((centre < low[dim]) || (centre >= high[dim])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Replaces the sides of primitive n of a group by the given points,
+   adding vertices for new points and splitting the primitive into a fan if
+   it has too many sides. Returns the number of primitives it became, or -1
+   if there is not enough memory. */
+static int replace_sides(VertexArray * const varray, Group * const group,
+                         const int n, CutPoint * const points,
+                         const int npoints)
+{
+  assert(points != NULL);
+  assert(npoints > 0);
+
+  for (int k = 0; k < npoints; ++k) {
+    if (points[k].v < 0) {
+      points[k].v = vertex_array_add_vertex(varray, &points[k].coords);
+      if (points[k].v < 0) {
+        return -1;
+      }
+    }
+  }
+
+  /* Each primitive of a fan shares its first vertex and one edge with the
+     previous primitive */
+  const Primitive original = *group_get_primitive(group, n);
+  int nprims = 0;
+  for (int start = 1; ; ) {
+    Primitive *pp = (nprims == 0) ?
+                    group_get_primitive(group, n) :
+                    group_insert_primitive(group, n + nprims);
+    if (pp == NULL) {
+      return -1;
+    }
+    *pp = original;
+    primitive_delete_all(pp);
+
+    const int end = LOWEST(npoints, start + PRIMITIVE_MAX_SIDES - 1);
+    if (primitive_add_side(pp, points[0].v) < 0) {
+      return -1;
+    }
+    for (int k = start; k < end; ++k) {
+      if (primitive_add_side(pp, points[k].v) < 0) {
+        return -1;
+      }
+    }
+    ++nprims;
+
+    if (end >= npoints) {
+      break;
+    }
+    start = end - 1;
+  }
+  return nprims;
+}
+
+/* Cuts primitive n of a group along the given planes. Returns the number of
+   primitives it became (0 if it was deleted) or -1 on failure. */
+static int cut_primitive(VertexArray * const varray, Group * const group,
+                         const int n, const CutPlane * const planes,
+                         const int nplanes, const Coord * const low,
+                         const Coord * const high)
+{
+  assert(planes != NULL);
+  assert(low != NULL);
+  assert(high != NULL);
+
+  const Primitive * const pp = group_get_primitive(group, n);
+  assert(pp != NULL);
+  const int nsides = primitive_get_num_sides(pp);
+  const bool closed = nsides > 2;
+
+  CutPoint buf[2][CUT_MAX_POINTS];
+  CutPoint *points = buf[0];
+  int npoints = nsides;
+  for (int s = 0; s < nsides; ++s) {
+    const VertexIndex v = primitive_get_side(pp, s);
+    Coord (* const coords)[3] = vertex_array_get_coords(varray, v);
+    assert(coords != NULL);
+    memcpy(points[s].coords, *coords, sizeof(*coords));
+    points[s].v = v;
+  }
+  for (int s = 0; s < nsides; ++s) {
+    set_line(points + s, points + (s + 1) % nsides);
+  }
+
+  bool changed = false;
+  for (int c = 0; c < nplanes && npoints > 0; ++c) {
+    bool inside = true;
+    for (int k = 0; k < npoints && inside; ++k) {
+      inside = is_inside(planes + c, points[k].coords);
+    }
+    if (inside) {
+      continue;
+    }
+
+    CutPoint * const out = (points == buf[0]) ? buf[1] : buf[0];
+    npoints = cut_points(points, npoints, closed, planes + c, out);
+    if (npoints < 0) {
+      DEBUGF("Too many points cutting primitive %d\n", n);
+      return -1;
+    }
+    points = out;
+    changed = true;
+  }
+
+  if ((npoints < (closed ? 3 : nsides)) ||
+      !is_owned(points, npoints, low, high)) {
+    DEBUGF("Primitive %d doesn't belong to this tile\n", n);
+    group_delete_primitive(group, n);
+    return 0;
+  }
+
+  return changed ? replace_sides(varray, group, n, points, npoints) : 1;
+}
+
+bool tile_grid_cut(const TileGrid * const grid, const int t,
+                   VertexArray * const varray, Group * const groups,
+                   const int ngroups)
+{
+  assert(groups != NULL || ngroups == 0);
+  assert(ngroups >= 0);
+
+  Coord low[3], high[3];
+  tile_grid_get_bounds(grid, t, &low, &high);
+
+  /* Always cut in the same order so that neighbouring tiles make the same
+     edges along their shared boundary */
+  CutPlane planes[6];
+  int nplanes = 0;
+  for (size_t dim = 0; dim < ARRAY_SIZE(low); ++dim) {
+    if (low[dim] != -(Coord)HUGE_VAL) {
+      planes[nplanes++] = (CutPlane){.dim = dim, .pos = low[dim],
+                                     .low = true};
+    }
+    if (high[dim] != (Coord)HUGE_VAL) {
+      planes[nplanes++] = (CutPlane){.dim = dim, .pos = high[dim],
+                                     .low = false};
+    }
+  }
+
+  for (int g = 0; g < ngroups; ++g) {
+    Group * const group = &groups[g];
+    for (int p = 0; p < group_get_num_primitives(group); ) {
+      const int nprims = cut_primitive(varray, group, p, planes, nplanes,
+                                       low, high);
+      if (nprims < 0) {
+        return false;
+      }
+      p += nprims;
+    }
+  }
+  return true;
+}
+
+static VertexIndex get_original(const VertexArray * const varray,
+                                VertexIndex v)
+{
+  const Vertex *vertex = vertex_array_get_vertex(varray, v);
+  while ((vertex != NULL) && (vertex->dup >= 0)) {
+    v = vertex->dup;
+    vertex = vertex_array_get_vertex(varray, v);
+  }
+  return v;
+}
+
+/* Makes primitives use the original of each duplicate vertex, so that
+   group_set_used doesn't mark duplicates. Points of intersection can be
+   duplicates of the ends of an edge, so consecutive sides which become the
+   same are merged and primitives which become too small are deleted. */
+static void use_originals(Group * const groups, const int ngroups,
+                          const VertexArray * const varray)
+{
+  for (int g = 0; g < ngroups; ++g) {
+    Group * const group = &groups[g];
+    for (int p = 0; p < group_get_num_primitives(group); ) {
+      Primitive * const pp = group_get_primitive(group, p);
+      const int nsides = primitive_get_num_sides(pp);
+      VertexIndex sides[PRIMITIVE_MAX_SIDES];
+      int n = 0;
+      bool changed = false;
+
+      for (int s = 0; s < nsides; ++s) {
+        const VertexIndex side = primitive_get_side(pp, s);
+        const VertexIndex v = get_original(varray, side);
+        if (v != side) {
+          changed = true;
+        }
+        if ((n > 0) && (sides[n - 1] == v)) {
+          changed = true;
+        } else {
+          sides[n++] = v;
+        }
+      }
+      if ((n > 1) && (sides[n - 1] == sides[0])) {
+        --n;
+        changed = true;
+      }
+
+      if (n < LOWEST(nsides, 3)) {
+        DEBUGF("Primitive %d of group %d is degenerate\n", p, g);
+        group_delete_primitive(group, p);
+        continue;
+      }
+
+      if (changed) {
+        primitive_delete_all(pp);
+        for (int s = 0; s < n; ++s) {
+          (void)primitive_add_side(pp, sides[s]);
+        }
+      }
+      ++p;
+    }
+  }
+}
+
+bool tile_grid_output(
+        Writer * const out, const TileGrid * const grid,
+        TileSourceFn * const source, void * const context,
+        const int ngroups, const int * const group_order,
+        const int group_order_len, const ClipBudget * const budget,
+        const char * const object_name, VertexIndex * const vtotal,
+        int (* const get_colour)(const Primitive *pp, void *arg),
+        int (* const get_material)(char *buf, size_t buf_size,
+                                   int colour, void *arg),
+        void * const arg, const VertexStyle vstyle, const MeshStyle mstyle,
+        const bool verbose)
+{
+  assert(out != NULL);
+  assert(grid != NULL);
+  assert(source != NULL);
+  assert(ngroups > 0);
+  assert(vtotal != NULL);
+  assert(*vtotal >= 0);
+
+  Group * const groups = malloc(sizeof(*groups) * (size_t)ngroups);
+  if (groups == NULL) {
+    if (verbose) {
+      printf("Failed to allocate %d groups\n", ngroups);
+    }
+    return false;
+  }
+  for (int g = 0; g < ngroups; ++g) {
+    group_init(&groups[g]);
+  }
+
+  /* The same memory is reused for every tile */
+  VertexArray varray;
+  vertex_array_init(&varray);
+  (void)vertex_array_enable_index(&varray);
+
+  bool success = true;
+  const int ntiles = tile_grid_get_num_tiles(grid);
+  for (int t = 0; success && (t < ntiles); ++t) {
+    vertex_array_clear(&varray);
+    for (int g = 0; g < ngroups; ++g) {
+      group_delete_all(&groups[g]);
+    }
+
+    Coord low[3], high[3];
+    tile_grid_get_bounds(grid, t, &low, &high);
+    if (!source(context, &low, &high, &varray, groups, ngroups)) {
+      if (verbose) {
+        printf("Failed to get tile %d\n", t);
+      }
+      success = false;
+      break;
+    }
+
+    if (!tile_grid_cut(grid, t, &varray, groups, ngroups) ||
+        (vertex_array_find_duplicates(&varray, verbose) < 0)) {
+      if (verbose) {
+        printf("Failed to cut tile %d\n", t);
+      }
+      success = false;
+      break;
+    }
+    use_originals(groups, ngroups, &varray);
+
+    if (!clip_polygons_budget(&varray, groups, group_order, group_order_len,
+                              verbose, budget, NULL)) {
+      success = false;
+      break;
+    }
+
+    for (int g = 0; g < ngroups; ++g) {
+      group_set_used(&groups[g], &varray);
+    }
+    const VertexIndex nvertices = vertex_array_renumber(&varray, verbose);
+    if (verbose) {
+      printf("Tile %d of %d has %" PVERTEXINDEX " vertices\n",
+             t + 1, ntiles, nvertices);
+    }
+    if (nvertices == 0) {
+      continue;
+    }
+
+    success = output_vertices_to(out, nvertices, &varray, -1) &&
+              output_primitives_to(out, object_name, *vtotal, nvertices,
+                                   &varray, groups, ngroups, get_colour,
+                                   get_material, arg, vstyle, mstyle);
+    *vtotal += nvertices;
+  }
+
+  for (int g = 0; g < ngroups; ++g) {
+    group_free(&groups[g]);
+  }
+  free(groups);
+  vertex_array_free(&varray);
+  return success;
+}
@@ -0,0 +1,105 @@
+/*
+ * 3dObjLib: Tiled processing of scenes
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this header file.
+                  Vertex numbers are now of type VertexIndex.
+ */
+
+#ifndef TILEGRID_H
+#define TILEGRID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Coord.h"
+#include "Vertex.h"
+#include "Group.h"
+#include "Primitive.h"
+#include "Writer.h"
+#include "Clip.h"
+#include "ObjFile.h"
+
+/* A scene too big to be held in memory at once can be divided into a grid
+   of tiles which are processed one at a time. Primitives which straddle
+   the boundaries between tiles are cut along them, so that every piece of
+   geometry belongs to exactly one tile. Points on a boundary are found in
+   the same way by both tiles, so each tile's output fits its neighbours'
+   exactly (except within MAX_FLT_ERR of vertices which are that close to a
+   boundary). Tiles should be much bigger than MAX_FLT_ERR. Primitives must
+   be convex. */
+typedef struct {
+  Coord low[3]; /* the first tile in each dimension starts here */
+  Coord size[3]; /* of a tile, or 0 if the dimension isn't divided */
+  int ntiles[3];
+} TileGrid;
+
+/* Divides the box from low to high into tiles of the given size (or not at
+   all in dimensions in which the size is 0). Tiles at the edges of the grid
+   extend to infinity, so geometry outside the box is not lost. Returns false
+   if there would be more than INT_MAX tiles. */
+bool tile_grid_init(TileGrid *grid, Coord (*low)[3], Coord (*high)[3],
+                    Coord (*size)[3]);
+
+int tile_grid_get_num_tiles(const TileGrid *grid);
+
+/* Gets the bounds of tile t, which may be infinite. */
+void tile_grid_get_bounds(const TileGrid *grid, int t,
+                          Coord (*low)[3], Coord (*high)[3]);
+
+/* Cuts the primitives of the groups along the boundaries of tile t and
+   deletes the pieces (and any other primitives) which don't belong to it.
+   Vertices are added for points of intersection; nothing is deleted from
+   varray. Returns false if there is not enough memory, in which case
+   some primitives may not have been cut. */
+bool tile_grid_cut(const TileGrid *grid, int t, VertexArray *varray,
+                   Group *groups, int ngroups);
+
+/* Type of function called to add every vertex and primitive of the scene
+   that might intersect the box from low to high (the bounds of a tile) to
+   varray and groups, which are empty. It can add other primitives too, at
+   the cost of more memory and time. It must return false if the scene
+   could not be read. */
+typedef bool TileSourceFn(void *context, Coord (*low)[3],
+                          Coord (*high)[3], VertexArray *varray,
+                          Group *groups, int ngroups);
+
+/* Processes a scene one tile at a time: each tile's primitives are got by
+   calling source (with the given context), cut by tile_grid_cut, unified
+   with vertex_array_find_duplicates, clipped by clip_polygons_budget and
+   output by output_vertices_to and output_primitives_to. Memory is only
+   needed for the biggest tile. Duplicate vertices are only found within
+   a tile, so a vertex on a boundary is output once for each tile.
+
+   vtotal is the number of vertices output before the scene, which is
+   updated. The other arguments are as for clip_polygons_budget and
+   output_primitives_to. Returns false on failure, in which case some of
+   the scene may have been output. */
+bool tile_grid_output(
+        Writer *out, const TileGrid *grid,
+        TileSourceFn *source, void *context, int ngroups,
+        const int *group_order, int group_order_len,
+        const ClipBudget *budget, const char *object_name,
+        VertexIndex *vtotal,
+        int (*get_colour)(const Primitive *pp, void *arg),
+        int (*get_material)(char *buf, size_t buf_size,
+                            int colour, void *arg),
+        void *arg, VertexStyle vstyle, MeshStyle mstyle, bool verbose);
+
+#endif /* TILEGRID_H */
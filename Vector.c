@@ -23,6 +23,8 @@
                   Rewrote vector_xy_less_than to use coord_less_than.
                   Added a companion function, vector_xy_greater_or_equal.
   CJB: 17-Nov-18: vector_x/y/z are no longer inline functions.
+  CJB: 14-Oct-26: Added vector_snap and vector_snap_cross.
+                  Added vector_plane_ignoring.
  */
 
 /* ISO library header files */
@@ -406,13 +408,49 @@ void vector_find_plane(Coord (* const vector)[3], Plane * const plane)
   }
 
   DEBUGF("Biggest range %"PCOORD" is dimension %zu\n", biggest, bd);
-  plane->x = (0 == bd ? 2 : 0);
-  plane->y = (1 == bd ? 2 : 1);
+  vector_plane_ignoring(bd, plane);
+}
+
+void vector_plane_ignoring(const size_t z, Plane * const plane)
+{
+  assert(z < 3);
+  assert(plane != NULL);
+
+  plane->x = (0 == z ? 2 : 0);
+  plane->y = (1 == z ? 2 : 1);
   /* We'll ignore the z dimension when projecting the plane into two
      dimensions so set it to the biggest component of the plane's normal
      vector. */
-  plane->z = bd;
+  plane->z = z;
+}
+
+#if COORD_SNAP
+bool vector_snap(Coord (* const a)[3], const Plane p, SnapPoint * const s)
+{
+  assert(s != NULL);
+  return coord_snap(*vector_x(a, p), &s->x) &&
+         coord_snap(*vector_y(a, p), &s->y);
+}
+
+CoordSnap vector_snap_cross(const SnapPoint * const a,
+                            const SnapPoint * const b,
+                            const SnapPoint * const c)
+{
+  assert(a != NULL);
+  assert(b != NULL);
+  assert(c != NULL);
+
+  const CoordSnap ex = b->x - a->x, ey = b->y - a->y;
+  const CoordSnap cross = (ex * (c->y - a->y)) - (ey * (c->x - a->x));
+
+  /* The distance of C from the line is the magnitude of the cross product
+     divided by the length of the line, which is at least the length of its
+     longest component. */
+  const CoordSnap ex_mag = ex < 0 ? -ex : ex, ey_mag = ey < 0 ? -ey : ey;
+  const CoordSnap cross_mag = cross < 0 ? -cross : cross;
+  return cross_mag <= HIGHEST(ex_mag, ey_mag) * COORD_SNAP_SCALE ? 0 : cross;
 }
+#endif /* COORD_SNAP */
 
 void vector_print(Coord (* const a)[3])
 {
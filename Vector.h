@@ -23,6 +23,8 @@
   CJB: 17-Nov-18: vector_x/y/z are no longer inline functions.
                   Plane indices are now bytes instead of size_t values.
   CJB: 11-Dec-20: Removed redundant uses of the 'extern' keyword.
+  CJB: 14-Oct-26: Added vector_snap and vector_snap_cross.
+                  Added vector_plane_ignoring.
  */
 
 #ifndef VECTOR_H
@@ -83,6 +85,27 @@ bool vector_intersect(Coord (*va)[3], Coord (*vb)[3],
 
 void vector_find_plane(Coord (*vector)[3], Plane *plane);
 
+/* Gets the plane found by vector_find_plane for a vector whose biggest
+   component is in dimension z. */
+void vector_plane_ignoring(size_t z, Plane *plane);
+
+#if COORD_SNAP
+/* Coordinates of a vector projected onto a plane and snapped to a grid */
+typedef struct {
+  CoordSnap x;
+  CoordSnap y;
+} SnapPoint;
+
+/* Returns false if either coordinate is out of range. */
+bool vector_snap(Coord (*a)[3], Plane p, SnapPoint *s);
+
+/* Returns the cross product of B-A and C-A, which is positive if C is left
+   of the line through A and B or negative if it is right of it. Returns 0
+   if C is within about MAX_FLT_ERR of the line (or A and B are equal). */
+CoordSnap vector_snap_cross(const SnapPoint *a, const SnapPoint *b,
+                            const SnapPoint *c);
+#endif /* COORD_SNAP */
+
 void vector_print(Coord (*a)[3]);
 
 #endif /* VECTOR_H */
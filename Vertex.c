@@ -31,6 +31,27 @@
   CJB: 30-Aug-18: Added a function to mark all vertices as used.
   CJB: 09-Jan-21: Initialize struct using compound literal assignment to
                   guard against leaving members uninitialized.
+  CJB: 14-Oct-26: Added an optional spatial index to avoid a linear search
+                  in vertex_array_find_vertex.
+                  Added overlays, which allow vertices to be added without
+                  modifying the underlying array.
+                  Added vertex_array_reserve and vertex_array_add_vertices.
+                  Added vertex_array_hash_duplicates.
+                  Added vertex_array_init_allocator. All memory is allocated
+                  using the allocator (if any) given by the caller.
+                  vertex_array_edge_intersects_line and
+                  vertex_array_edges_intersect can use snapped coordinates.
+                  vertex_array_renumber now builds a table of output IDs
+                  so that vertex_array_get_id needn't follow links from
+                  duplicates to their originals.
+                  Added vertex_array_reorder.
+                  Vertex numbers, IDs and counts now have type
+                  VertexIndex. Array sizes are checked for overflow and
+                  vertex_array_add_vertex fails instead of overflowing.
+                  Growth of an overlay is limited so that the number of
+                  vertices allocated cannot overflow.
+                  Added vertex_array_hash_duplicates_parallel.
+                  Its spawn parameter now has type ClipSpawnFn.
  */
 
 /* ISO library header files */
@@ -39,6 +60,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <math.h>
 
 /* Local header files */
 #include "Internal/3dObjMisc.h"
@@ -55,12 +77,52 @@ void vertex_array_init(VertexArray * const varray)
     .nsorted = 0,
     .vertices = NULL,
     .sorted = NULL,
+    .nbuckets = 0,
+    .buckets = NULL,
+    .next = NULL,
+    .base = NULL,
+    .nbase = 0,
+    .alloc = NULL,
+    .remap = NULL,
+    .nremap = 0,
   };
 }
 
+static void discard_remap(VertexArray * const varray)
+{
+  assert(varray != NULL);
+  allocator_free(varray->alloc, varray->remap);
+  varray->remap = NULL;
+  varray->nremap = 0;
+}
+
+void vertex_array_init_allocator(VertexArray * const varray,
+                                 const Allocator * const alloc)
+{
+  vertex_array_init(varray);
+  varray->alloc = alloc;
+}
+
+void vertex_array_init_overlay(VertexArray * const varray,
+                               const VertexArray * const base)
+{
+  assert(varray != NULL);
+  assert(base != NULL);
+  assert(base->base == NULL);
+
+  vertex_array_init(varray);
+  varray->base = base;
+  varray->nbase = base->nvertices;
+}
+
 void vertex_array_clear(VertexArray * const varray)
 {
   varray->nvertices = 0;
+  discard_remap(varray);
+
+  for (int b = 0; b < varray->nbuckets; ++b) {
+    varray->buckets[b] = -1;
+  }
 }
 
 void vertex_array_free(VertexArray * const varray)
@@ -68,11 +130,15 @@ void vertex_array_free(VertexArray * const varray)
   assert(varray != NULL);
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
-  free(varray->vertices);
-  free(varray->sorted);
+  allocator_free(varray->alloc, varray->vertices);
+  allocator_free(varray->alloc, varray->sorted);
+  allocator_free(varray->alloc, varray->buckets);
+  allocator_free(varray->alloc, varray->next);
+  discard_remap(varray);
 }
 
-Vertex *vertex_array_get_vertex(const VertexArray * const varray, const int n)
+Vertex *vertex_array_get_vertex(const VertexArray * const varray,
+                                const VertexIndex n)
 {
   Vertex *vertex = NULL;
 
@@ -80,70 +146,92 @@ Vertex *vertex_array_get_vertex(const VertexArray * const varray, const int n)
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
 
-  if ((n >= 0) && (n < varray->nvertices)) {
-    vertex = &varray->vertices[n];
+  if ((n >= 0) && (n < varray->nbase)) {
+    vertex = vertex_array_get_vertex(varray->base, n);
+  } else if ((n >= varray->nbase) && (n - varray->nbase < varray->nvertices)) {
+    vertex = &varray->vertices[n - varray->nbase];
   } else {
-    DEBUGF("Invalid vertex number %d\n", n);
+    DEBUGF("Invalid vertex number %"PVERTEXINDEX"\n", n);
   }
   return vertex;
 }
 
-int vertex_array_get_num_vertices(const VertexArray * const varray)
+VertexIndex vertex_array_get_num_vertices(const VertexArray * const varray)
 {
   assert(varray != NULL);
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
-  return varray->nvertices;
+  return varray->nbase + varray->nvertices;
 }
 
 void vertex_array_set_all_used(const VertexArray *varray)
 {
   assert(varray != NULL);
+  assert(varray->base == NULL);
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
 
-  const int nvertices = varray->nvertices;
-  for (int v = 0; v < nvertices; ++v) {
+  const VertexIndex nvertices = varray->nvertices;
+  for (VertexIndex v = 0; v < nvertices; ++v) {
     vertex_array_set_used(varray, v);
   }
 }
 
-void vertex_array_set_used(const VertexArray * const varray, const int n)
+void vertex_array_set_used(const VertexArray * const varray,
+                           const VertexIndex n)
 {
   Vertex * const vertex = vertex_array_get_vertex(varray, n);
   if (vertex != NULL) {
-    DEBUGF("Marking vertex %d\n", n);
+    DEBUGF("Marking vertex %"PVERTEXINDEX"\n", n);
     vertex->marked = true;
   }
 }
 
-bool vertex_array_is_used(const VertexArray * const varray, const int n)
+bool vertex_array_is_used(const VertexArray * const varray,
+                          const VertexIndex n)
 {
   bool is_used = false;
   Vertex * const vertex = vertex_array_get_vertex(varray, n);
   if (vertex != NULL) {
     is_used = vertex->marked;
-    DEBUGF("Vertex %d is%s marked\n", n, is_used ? "" : " not");
+    DEBUGF("Vertex %"PVERTEXINDEX" is%s marked\n",
+           n, is_used ? "" : " not");
   }
   return is_used;
 }
 
-int vertex_array_get_id(const VertexArray * const varray, const int n)
+const VertexIndex *vertex_array_get_remap(const VertexArray * const varray)
 {
-  int id = -1;
+  assert(varray != NULL);
+  return (varray->nremap > 0) && (varray->nremap == varray->nvertices) ?
+         varray->remap : NULL;
+}
+
+VertexIndex vertex_array_get_id(const VertexArray * const varray,
+                                const VertexIndex n)
+{
+  const VertexIndex * const remap = vertex_array_get_remap(varray);
+  if ((remap != NULL) && (n >= 0) && (n < varray->nremap)) {
+    DEBUGF("Vertex %"PVERTEXINDEX" has ID %"PVERTEXINDEX"\n", n, remap[n]);
+    return remap[n];
+  }
+
+  VertexIndex id = -1;
   Vertex *vertex = vertex_array_get_vertex(varray, n);
   while ((vertex != NULL) && (vertex->dup >= 0)) {
-    DEBUGF("Vertex %d duplicates %d\n", n, vertex->dup);
+    DEBUGF("Vertex %"PVERTEXINDEX" duplicates %"PVERTEXINDEX"\n",
+           n, vertex->dup);
     vertex = vertex_array_get_vertex(varray, vertex->dup);
   }
   if (vertex != NULL) {
     id = vertex->id;
   }
-  DEBUGF("Vertex %d has ID %d\n", n, id);
+  DEBUGF("Vertex %"PVERTEXINDEX" has ID %"PVERTEXINDEX"\n", n, id);
   return id;
 }
 
-Coord (*vertex_array_get_coords(const VertexArray * const varray, const int n))[3]
+Coord (*vertex_array_get_coords(const VertexArray * const varray,
+                                 const VertexIndex n))[3]
 {
   Coord (*coords)[3] = NULL;
   Vertex * const vertex = vertex_array_get_vertex(varray, n);
@@ -153,47 +241,215 @@ Coord (*vertex_array_get_coords(const VertexArray * const varray, const int n))[
   return coords;
 }
 
-int vertex_array_alloc_vertices(VertexArray * const varray, const int n)
+static void alloc_vertices(VertexArray * const varray, const VertexIndex new_n)
+{
+  assert(varray != NULL);
+  assert(new_n > varray->nalloc);
+
+  /* The size in bytes of the biggest array must not overflow */
+  if ((uintmax_t)new_n > SIZE_MAX / sizeof(Vertex)) {
+    DEBUGF("Too many vertices %"PVERTEXINDEX"\n", new_n);
+    return;
+  }
+
+  /* If the spatial index is enabled then it needs a link for every
+     vertex. It doesn't matter if it ends up bigger than required. */
+  if (varray->nbuckets > 0) {
+    const size_t nbytes = sizeof(*varray->next) * new_n;
+    VertexIndex * const new_next = allocator_realloc(varray->alloc,
+                                                     varray->next, nbytes);
+    if (new_next == NULL) {
+      DEBUGF("Failed to allocate %zu bytes for vertex links\n", nbytes);
+      return;
+    }
+    varray->next = new_next;
+  }
+
+  const size_t nbytes = sizeof(Vertex) * new_n;
+  Vertex * const new_alloc = allocator_realloc(varray->alloc,
+                                               varray->vertices, nbytes);
+  if (new_alloc == NULL) {
+    DEBUGF("Failed to allocate %zu bytes for vertices\n", nbytes);
+  } else {
+    varray->vertices = new_alloc;
+    varray->nalloc = new_n;
+  }
+}
+
+VertexIndex vertex_array_alloc_vertices(VertexArray * const varray,
+                                        const VertexIndex n)
 {
   assert(varray != NULL);
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
 
+  /* Space is only allocated for vertices not in the base array */
   if (n >= 0) {
-    if (n > varray->nalloc) {
-      int new_n = varray->nalloc ? varray->nalloc * 2 : 8;
-      if (new_n < n) {
-        new_n = n;
+    if (n - varray->nbase > varray->nalloc) {
+      /* Don't allow the returned index to overflow for an overlay */
+      const VertexIndex limit = VERTEX_INDEX_MAX - varray->nbase;
+      VertexIndex new_n = varray->nalloc > limit / 2 ?
+                          limit :
+                          varray->nalloc ? varray->nalloc * 2 : 8;
+      if (new_n > limit) {
+        new_n = limit;
       }
-      const size_t nbytes = sizeof(Vertex) * new_n;
-      Vertex * const new_alloc = realloc(varray->vertices, nbytes);
-      if (new_alloc == NULL) {
-        DEBUGF("Failed to allocate %zu bytes for vertices\n", nbytes);
-      } else {
-        varray->vertices = new_alloc;
-        varray->nalloc = new_n;
+      if (new_n < n - varray->nbase) {
+        new_n = n - varray->nbase;
       }
+      alloc_vertices(varray, new_n);
     }
   } else {
-    DEBUGF("Invalid number of vertices %d\n", n);
+    DEBUGF("Invalid number of vertices %"PVERTEXINDEX"\n", n);
+  }
+
+  assert(varray->nvertices <= varray->nalloc);
+  return varray->nbase + varray->nalloc;
+}
+
+bool vertex_array_reserve(VertexArray * const varray, const VertexIndex n)
+{
+  assert(varray != NULL);
+  assert(varray->nvertices >= 0);
+  assert(varray->nvertices <= varray->nalloc);
+
+  if (n < 0) {
+    DEBUGF("Invalid number of vertices %"PVERTEXINDEX"\n", n);
+    return false;
+  }
+
+  if (n - varray->nbase > varray->nalloc) {
+    const VertexIndex limit = VERTEX_INDEX_MAX - varray->nbase;
+    alloc_vertices(varray, n - varray->nbase > limit ?
+                           limit : n - varray->nbase);
   }
 
   assert(varray->nvertices <= varray->nalloc);
-  return varray->nalloc;
+  return n - varray->nbase <= varray->nalloc;
+}
+
+/* Width of a cell of the spatial index. Coordinates within MAX_FLT_ERR of
+   each other are always in the same or adjacent cells. */
+#define INDEX_CELL_SIZE (MAX_FLT_ERR * 2)
+
+/* Limit on the magnitude of quantised coordinates, to avoid undefined
+   behaviour when converting huge or non-finite coordinates. */
+#define INDEX_CELL_LIMIT (1LL << 52)
+
+enum { INDEX_MIN_BUCKETS = 64 };
+
+/* Width of a cell of the temporary hash table used to find duplicates.
+   Unlike the spatial index, it doesn't need to be small to be efficient
+   for vertices added in arbitrary order but searching fewer cells for
+   each vertex is faster. */
+#define DUP_CELL_SIZE (INDEX_CELL_SIZE * 8)
+
+static long long quantise(const double c, const double cell_size)
+{
+  /* Note that this also catches NaN */
+  const double q = floor(c / cell_size);
+  if (!(q > -INDEX_CELL_LIMIT)) {
+    return -INDEX_CELL_LIMIT;
+  }
+  if (q > INDEX_CELL_LIMIT) {
+    return INDEX_CELL_LIMIT;
+  }
+  return (long long)q;
+}
+
+static long long index_cell(const double c)
+{
+  return quantise(c, INDEX_CELL_SIZE);
+}
+
+static int cell_hash(long long (* const cell)[3], const int nbuckets)
+{
+  assert(cell != NULL);
+  assert(nbuckets > 0);
+
+  unsigned long long h = 0;
+  for (size_t dim = 0; dim < ARRAY_SIZE(*cell); ++dim) {
+    h = (h ^ (unsigned long long)(*cell)[dim]) * 0x9E3779B97F4A7C15ULL;
+  }
+  h ^= h >> 32;
+
+  /* The number of buckets is a power of two */
+  return (int)(h & (unsigned long long)(nbuckets - 1));
+}
+
+static int index_hash(const VertexArray * const varray,
+                      long long (* const cell)[3])
+{
+  assert(varray != NULL);
+  assert(varray->nbuckets > 0);
+  return cell_hash(cell, varray->nbuckets);
+}
+
+static void index_add_vertex(const VertexArray * const varray,
+                             const VertexIndex v)
+{
+  assert(varray != NULL);
+  assert(v >= 0);
+  assert(v < varray->nvertices);
+
+  long long cell[3];
+  for (size_t dim = 0; dim < ARRAY_SIZE(cell); ++dim) {
+    cell[dim] = index_cell(varray->vertices[v].coords[dim]);
+  }
+
+  const int b = index_hash(varray, &cell);
+  varray->next[v] = varray->buckets[b];
+  varray->buckets[b] = v;
+}
+
+static bool index_make(VertexArray * const varray, const int nbuckets)
+{
+  assert(varray != NULL);
+  assert(nbuckets > 0);
+  assert((nbuckets & (nbuckets - 1)) == 0);
+
+  const size_t nbytes = sizeof(*varray->buckets) * nbuckets;
+  VertexIndex * const buckets = allocator_alloc(varray->alloc, nbytes);
+  if (buckets == NULL) {
+    DEBUGF("Failed to allocate %zu bytes for vertex index\n", nbytes);
+    return false;
+  }
+
+  for (int b = 0; b < nbuckets; ++b) {
+    buckets[b] = -1;
+  }
+
+  allocator_free(varray->alloc, varray->buckets);
+  varray->buckets = buckets;
+  varray->nbuckets = nbuckets;
+
+  const VertexIndex nvertices = varray->nvertices;
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    index_add_vertex(varray, v);
+  }
+
+  DEBUGF("Indexed %"PVERTEXINDEX" vertices using %d buckets\n",
+         nvertices, nbuckets);
+  return true;
 }
 
-int vertex_array_add_vertex(VertexArray * const varray, Coord (* const coords)[3])
+VertexIndex vertex_array_add_vertex(VertexArray * const varray,
+                                    Coord (* const coords)[3])
 {
-  int v = -1;
+  VertexIndex v = -1;
 
   assert(varray != NULL);
   assert(coords != NULL);
   assert(varray->nvertices >= 0);
-  assert(varray->nvertices < INT_MAX);
 
-  const int new_nvert = varray->nvertices + 1;
+  if (varray->nvertices >= VERTEX_INDEX_MAX - varray->nbase) {
+    DEBUGF("Too many vertices\n");
+    return -1;
+  }
+
+  const VertexIndex new_nvert = varray->nbase + varray->nvertices + 1;
   if (vertex_array_alloc_vertices(varray, new_nvert) >= new_nvert) {
-    v = varray->nvertices++;
+    v = varray->nbase + varray->nvertices++;
     assert(varray->nvertices <= varray->nalloc);
 
     Vertex * const vertex = vertex_array_get_vertex(varray, v);
@@ -209,13 +465,78 @@ int vertex_array_add_vertex(VertexArray * const varray, Coord (* const coords)[3
       vertex->coords[dim] = (*coords)[dim];
     }
 
-    DEBUGF("Added vertex %d {%"PCOORD",%"PCOORD",%"PCOORD"}\n", v,
+    DEBUGF("Added vertex %"PVERTEXINDEX" {%"PCOORD",%"PCOORD",%"PCOORD"}\n", v,
            (*coords)[0], (*coords)[1], (*coords)[2]);
+
+    /* Keep the load factor of the spatial index at no more than one vertex
+       per bucket. Failure to grow it only degrades performance. */
+    if (varray->nbuckets > 0) {
+      if ((varray->nvertices <= varray->nbuckets) ||
+          (varray->nbuckets > INT_MAX / 2) ||
+          !index_make(varray, varray->nbuckets * 2)) {
+        index_add_vertex(varray, v - varray->nbase);
+      }
+    }
   }
 
   return v;
 }
 
+VertexIndex vertex_array_add_vertices(VertexArray * const varray,
+                                      Coord (* const coords)[3],
+                                      const VertexIndex count)
+{
+  assert(varray != NULL);
+  assert(coords != NULL || count == 0);
+  assert(varray->nvertices >= 0);
+
+  if (count < 0 ||
+      count > VERTEX_INDEX_MAX - varray->nbase - varray->nvertices) {
+    DEBUGF("Invalid number of vertices %"PVERTEXINDEX"\n", count);
+    return -1;
+  }
+
+  const VertexIndex first = varray->nbase + varray->nvertices;
+  if (vertex_array_alloc_vertices(varray, first + count) < first + count) {
+    return -1;
+  }
+
+  for (VertexIndex i = 0; i < count; ++i) {
+    Vertex * const vertex = varray->vertices + varray->nvertices + i;
+    *vertex = (Vertex){
+      .marked = false,
+      .id = first + i,
+      .dup = -1,
+    };
+
+    for (size_t dim = 0; dim < ARRAY_SIZE(coords[i]); ++dim) {
+      vertex->coords[dim] = coords[i][dim];
+    }
+  }
+
+  const VertexIndex old_nvert = varray->nvertices;
+  varray->nvertices += count;
+  DEBUGF("Added %"PVERTEXINDEX" vertices from %"PVERTEXINDEX"\n",
+         count, first);
+
+  /* Rebuild the spatial index once instead of doubling it repeatedly.
+     Failure to grow it only degrades performance. */
+  if (varray->nbuckets > 0) {
+    int nbuckets = varray->nbuckets;
+    while (nbuckets < varray->nvertices && nbuckets <= INT_MAX / 2) {
+      nbuckets *= 2;
+    }
+
+    if (nbuckets == varray->nbuckets || !index_make(varray, nbuckets)) {
+      for (VertexIndex v = old_nvert; v < varray->nvertices; ++v) {
+        index_add_vertex(varray, v);
+      }
+    }
+  }
+
+  return first;
+}
+
 static int compare_vertices(const void *a, const void *b)
 {
   /* We are sorting an array of pointers to vertices, so a and b are pointers
@@ -249,26 +570,32 @@ static int compare_vertices(const void *a, const void *b)
   return 0;
 }
 
-int vertex_array_find_duplicates(VertexArray * const varray,
-                                 const bool verbose)
+VertexIndex vertex_array_find_duplicates(VertexArray * const varray,
+                                         const bool verbose)
 {
-  int n = 0;
+  VertexIndex n = 0;
   assert(varray != NULL);
+  assert(varray->base == NULL);
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
 
-  const int nvertices = varray->nvertices;
+  /* Links to originals are about to change */
+  discard_remap(varray);
+
+  const VertexIndex nvertices = varray->nvertices;
   if (nvertices > 0) {
     /* Allocate a temporary array of pointers to vertices */
     if (nvertices > varray->nsorted) {
-      int new_n = varray->nsorted ? varray->nsorted * 2 : 8;
+      VertexIndex new_n = varray->nsorted > VERTEX_INDEX_MAX / 2 ?
+                          VERTEX_INDEX_MAX :
+                          varray->nsorted ? varray->nsorted * 2 : 8;
       if (new_n < nvertices) {
         new_n = nvertices;
       }
-      const size_t nbytes = sizeof(Vertex *) * new_n;
-      free(varray->sorted);
+      const size_t nbytes = sizeof(Vertex *) * (size_t)new_n;
+      allocator_free(varray->alloc, varray->sorted);
       varray->nsorted = 0;
-      varray->sorted = malloc(nbytes);
+      varray->sorted = allocator_alloc(varray->alloc, nbytes);
       if (varray->sorted == NULL) {
         if (verbose) {
           printf("Failed to allocate %zu bytes for sorted vertices\n",
@@ -280,7 +607,7 @@ int vertex_array_find_duplicates(VertexArray * const varray,
     }
     Vertex ** const sorted = varray->sorted;
 
-    for (int v = 0; v < nvertices; ++v) {
+    for (VertexIndex v = 0; v < nvertices; ++v) {
       sorted[v] = &varray->vertices[v];
     }
 
@@ -291,13 +618,14 @@ int vertex_array_find_duplicates(VertexArray * const varray,
        This should be done before marking vertices as used otherwise
        we may end up in a situation where a duplicate vertex is kept
        but the original is discarded */
-    int last = 0;
-    for (int v = 1 /* intentional */; v < nvertices; ++v) {
+    VertexIndex last = 0;
+    for (VertexIndex v = 1 /* intentional */; v < nvertices; ++v) {
       assert(sorted[last] != sorted[v]);
       if (vector_equal(&sorted[last]->coords, &sorted[v]->coords)) {
         ++n;
         if (verbose) {
-          printf("Vertex %d duplicates %d {%"PCOORD",%"PCOORD",%"PCOORD"}\n",
+          printf("Vertex %"PVERTEXINDEX" duplicates %"PVERTEXINDEX
+                 " {%"PCOORD",%"PCOORD",%"PCOORD"}\n",
                   sorted[v]->id, sorted[last]->id,
                   sorted[v]->coords[0], sorted[v]->coords[1],
                   sorted[v]->coords[2]);
@@ -324,55 +652,647 @@ int vertex_array_find_duplicates(VertexArray * const varray,
     }
   }
   if (verbose) {
-    printf("%d/%d vertices were duplicates\n", n, varray->nvertices);
+    printf("%"PVERTEXINDEX"/%"PVERTEXINDEX" vertices were duplicates\n",
+           n, varray->nvertices);
+  }
+  return n;
+}
+
+typedef struct {
+  Coord coords[3];
+  VertexIndex v;
+  VertexIndex next;
+} DupKey;
+
+/* Number of slabs of the vertices' extent along the x axis for each thread
+   of vertex_array_hash_duplicates_parallel. Slabs are dealt to threads in
+   turn, so that the work is shared evenly even if the vertices are not. */
+enum { DUP_SLABS_PER_THREAD = 8 };
+
+/* Maximum number of vertices compared (on average for each vertex) when
+   finding those near slab boundaries, before giving up and searching all
+   of the vertices with one thread. */
+enum { DUP_MAX_SHARE_WORK = 16 };
+
+/* The original of a vertex which must be searched for with one thread */
+enum { DUP_SHARED = -2 };
+
+typedef struct {
+  Vertex *vertices;
+  VertexIndex *list; /* vertices in order, or NULL for all */
+  VertexIndex count;
+  VertexIndex *found; /* original of each vertex (by number), or -1 */
+  DupKey *keys;
+  VertexIndex *buckets;
+  int nbuckets;
+  /* The rest is only used to find vertices near slab boundaries */
+  double slab_size;
+  VertexIndex *vbuckets; /* first vertex in each cell (by position) */
+  VertexIndex *vnext; /* next vertex in the same cell (by position) */
+  VertexIndex *stack;
+  bool *shared;
+  bool success;
+} DupSearch;
+
+static int dup_num_buckets(const VertexIndex nvertices)
+{
+  int nbuckets = INDEX_MIN_BUCKETS;
+  while ((nbuckets < nvertices) && (nbuckets <= INT_MAX / 2)) {
+    nbuckets *= 2;
+  }
+  return nbuckets;
+}
+
+static void dup_cell_range(Coord (* const coords)[3],
+                           long long (* const low)[3],
+                           long long (* const high)[3])
+{
+  for (size_t dim = 0; dim < ARRAY_SIZE(*low); ++dim) {
+    const double c = (*coords)[dim], margin = MAX_FLT_ERR * 1.0625;
+    (*low)[dim] = quantise(c - margin, DUP_CELL_SIZE);
+    (*high)[dim] = quantise(c + margin, DUP_CELL_SIZE);
+  }
+}
+
+static int dup_cell_hash(Coord (* const coords)[3], const int nbuckets)
+{
+  long long cell[3];
+  for (size_t dim = 0; dim < ARRAY_SIZE(cell); ++dim) {
+    cell[dim] = quantise((*coords)[dim], DUP_CELL_SIZE);
+  }
+  return cell_hash(&cell, nbuckets);
+}
+
+/* Finds the original of each vertex in the list (or array), which is
+   stored in the found array instead of changing the vertex. */
+static void dup_search(DupSearch * const search)
+{
+  assert(search != NULL);
+  DupKey * const keys = search->keys;
+  VertexIndex * const buckets = search->buckets;
+  VertexIndex nkeys = 0;
+
+  for (int b = 0; b < search->nbuckets; ++b) {
+    buckets[b] = -1;
+    if (search->vbuckets != NULL) {
+      search->vbuckets[b] = -1;
+    }
+  }
+
+  for (VertexIndex i = 0; i < search->count; ++i) {
+    const VertexIndex v = search->list ? search->list[i] : i;
+    Vertex * const vertex = &search->vertices[v];
+
+    /* Find the lowest-numbered earlier vertex with equal coordinates
+       by searching every cell that could contain one (as in
+       vertex_array_find_vertex). Unlike comparing neighbours in sorted
+       order, this can't miss a duplicate because another vertex was
+       sorted between them. */
+    long long low[3], high[3];
+    dup_cell_range(&vertex->coords, &low, &high);
+
+    VertexIndex found = -1;
+    long long cell[3];
+    for (cell[0] = low[0]; cell[0] <= high[0]; ++cell[0]) {
+      for (cell[1] = low[1]; cell[1] <= high[1]; ++cell[1]) {
+        for (cell[2] = low[2]; cell[2] <= high[2]; ++cell[2]) {
+          const int b = cell_hash(&cell, search->nbuckets);
+          for (VertexIndex k = buckets[b]; k >= 0; k = keys[k].next) {
+            if (((found < 0) || (keys[k].v < found)) &&
+                vector_equal(&keys[k].coords, &vertex->coords)) {
+              found = keys[k].v;
+            }
+          }
+        }
+      }
+    }
+    search->found[v] = found;
+
+    const int b = dup_cell_hash(&vertex->coords, search->nbuckets);
+    if (search->vbuckets != NULL) {
+      search->vnext[i] = search->vbuckets[b];
+      search->vbuckets[b] = i;
+    }
+
+    if (found < 0) {
+      /* Only vertices that aren't duplicates can be originals */
+      DupKey * const key = &keys[nkeys];
+      for (size_t dim = 0; dim < ARRAY_SIZE(key->coords); ++dim) {
+        key->coords[dim] = vertex->coords[dim];
+      }
+      key->v = v;
+      key->next = buckets[b];
+      buckets[b] = nkeys++;
+    }
+  }
+}
+
+static bool dup_is_same(Coord (* const a)[3], Coord (* const b)[3])
+{
+  for (size_t dim = 0; dim < ARRAY_SIZE(*a); ++dim) {
+    if ((*a)[dim] != (*b)[dim]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Marks the vertices in the list whose originals might be in another slab:
+   those within MAX_FLT_ERR of a slab boundary and those linked to them by
+   a chain of equal vertices. Any other vertex is only equal to vertices in
+   the same slab, so its original was found correctly. */
+static void dup_share(DupSearch * const search)
+{
+  assert(search != NULL);
+  assert(search->slab_size > 0);
+  Vertex * const vertices = search->vertices;
+  const VertexIndex * const list = search->list;
+  bool * const shared = search->shared;
+  long long work = (long long)search->count * DUP_MAX_SHARE_WORK;
+
+  for (VertexIndex i = 0; i < search->count; ++i) {
+    shared[i] = false;
+  }
+
+  for (VertexIndex i = 0; i < search->count; ++i) {
+    const double x = vertices[list[i]].coords[0],
+                 margin = MAX_FLT_ERR * 1.0625;
+    if (shared[i] || (quantise(x - margin, search->slab_size) ==
+                      quantise(x + margin, search->slab_size))) {
+      continue;
+    }
+
+    VertexIndex nstack = 0;
+    shared[i] = true;
+    search->stack[nstack++] = i;
+    while (nstack > 0) {
+      Vertex * const vertex = &vertices[list[search->stack[--nstack]]];
+      long long low[3], high[3];
+      dup_cell_range(&vertex->coords, &low, &high);
+
+      long long cell[3];
+      for (cell[0] = low[0]; cell[0] <= high[0]; ++cell[0]) {
+        for (cell[1] = low[1]; cell[1] <= high[1]; ++cell[1]) {
+          for (cell[2] = low[2]; cell[2] <= high[2]; ++cell[2]) {
+            const int b = cell_hash(&cell, search->nbuckets);
+            for (VertexIndex k = search->vbuckets[b]; k >= 0;
+                 k = search->vnext[k]) {
+              if (--work < 0) {
+                search->success = false;
+                return;
+              }
+              Vertex * const other = &vertices[list[k]];
+              if (shared[k] || !vector_equal(&other->coords,
+                                             &vertex->coords)) {
+                continue;
+              }
+              /* Vertices with the same coordinates have the same
+                 neighbours, so only one of them needs to be searched */
+              shared[k] = true;
+              if (!dup_is_same(&other->coords, &vertex->coords)) {
+                search->stack[nstack++] = k;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  for (VertexIndex i = 0; i < search->count; ++i) {
+    if (shared[i]) {
+      search->found[list[i]] = DUP_SHARED;
+    }
+  }
+}
+
+static void dup_run_thread(void * const arg)
+{
+  DupSearch * const search = arg;
+  dup_search(search);
+  dup_share(search);
+}
+
+static bool dup_alloc_search(DupSearch * const search,
+                             const Allocator * const alloc, const bool share)
+{
+  assert(search != NULL);
+  const size_t n = (size_t)HIGHEST(search->count, 1);
+  search->nbuckets = dup_num_buckets(search->count);
+  search->keys = allocator_alloc(alloc, sizeof(*search->keys) * n);
+  search->buckets = allocator_alloc(alloc, sizeof(*search->buckets) *
+                                           (size_t)search->nbuckets);
+  bool success = (search->keys != NULL) && (search->buckets != NULL);
+  if (share) {
+    search->vbuckets = allocator_alloc(alloc, sizeof(*search->vbuckets) *
+                                              (size_t)search->nbuckets);
+    search->vnext = allocator_alloc(alloc, sizeof(*search->vnext) * n);
+    search->stack = allocator_alloc(alloc, sizeof(*search->stack) * n);
+    search->shared = allocator_alloc(alloc, sizeof(*search->shared) * n);
+    success = success && (search->vbuckets != NULL) &&
+              (search->vnext != NULL) && (search->stack != NULL) &&
+              (search->shared != NULL);
+  }
+  if (!success) {
+    DEBUGF("Failed to allocate memory to find duplicates of %"PVERTEXINDEX
+           " vertices\n", search->count);
+  }
+  return success;
+}
+
+static void dup_free_search(DupSearch * const search,
+                            const Allocator * const alloc)
+{
+  assert(search != NULL);
+  allocator_free(alloc, search->shared);
+  allocator_free(alloc, search->stack);
+  allocator_free(alloc, search->vnext);
+  allocator_free(alloc, search->vbuckets);
+  allocator_free(alloc, search->buckets);
+  allocator_free(alloc, search->keys);
+}
+
+/* Links each vertex to the original found for it, if any. Returns the
+   number of duplicates. */
+static VertexIndex dup_link(VertexArray * const varray,
+                            const VertexIndex * const found,
+                            const bool verbose)
+{
+  VertexIndex n = 0;
+  for (VertexIndex v = 0; v < varray->nvertices; ++v) {
+    if (found[v] < 0) {
+      assert(found[v] != DUP_SHARED);
+      continue;
+    }
+
+    Vertex * const vertex = &varray->vertices[v],
+           * const original = &varray->vertices[found[v]];
+    ++n;
+    if (verbose) {
+      printf("Vertex %"PVERTEXINDEX" duplicates %"PVERTEXINDEX
+             " {%"PCOORD",%"PCOORD",%"PCOORD"}\n",
+              vertex->id, original->id,
+              vertex->coords[0], vertex->coords[1], vertex->coords[2]);
+    }
+
+    /* Link the duplicate vertex to the original and make sure that the
+       original is output instead of it (as in
+       vertex_array_find_duplicates). */
+    vertex->dup = found[v];
+    if (vertex->marked) {
+      original->marked = true;
+      vertex->marked = false;
+    }
+  }
+  return n;
+}
+
+VertexIndex vertex_array_hash_duplicates(VertexArray * const varray,
+                                         const bool verbose)
+{
+  VertexIndex n = 0;
+  assert(varray != NULL);
+  assert(varray->base == NULL);
+  assert(varray->nvertices >= 0);
+  assert(varray->nvertices <= varray->nalloc);
+
+  /* Links to originals are about to change */
+  discard_remap(varray);
+
+  const VertexIndex nvertices = varray->nvertices;
+  if (nvertices > 0) {
+    /* Allocate a temporary hash table of vertices that aren't duplicates,
+       keyed on quantised coordinates (like the spatial index). Copies of
+       their coordinates are stored in the table to avoid reading the
+       vertex array in random order. */
+    DupSearch search = {.vertices = varray->vertices, .list = NULL,
+                        .count = nvertices};
+    const size_t nbytes = sizeof(*search.found) * (size_t)nvertices;
+    search.found = allocator_alloc(varray->alloc, nbytes);
+    if ((search.found == NULL) ||
+        !dup_alloc_search(&search, varray->alloc, false)) {
+      if (verbose) {
+        printf("Failed to allocate memory for vertex hash table\n");
+      }
+      n = -1;
+    } else {
+      dup_search(&search);
+      n = dup_link(varray, search.found, verbose);
+    }
+    dup_free_search(&search, varray->alloc);
+    allocator_free(varray->alloc, search.found);
+    if (n < 0) {
+      return -1;
+    }
+  }
+  if (verbose) {
+    printf("%"PVERTEXINDEX"/%"PVERTEXINDEX" vertices were duplicates\n",
+           n, varray->nvertices);
   }
   return n;
 }
 
+static int dup_thread_of(const double x, const double slab_size,
+                         const int nthreads)
+{
+  const int t = (int)(quantise(x, slab_size) % nthreads);
+  return t < 0 ? t + nthreads : t;
+}
+
+VertexIndex vertex_array_hash_duplicates_parallel(
+        VertexArray * const varray, const bool verbose, const int nthreads,
+        ClipSpawnFn * const spawn, void * const context)
+{
+  assert(varray != NULL);
+  assert(varray->base == NULL);
+  assert(varray->nvertices >= 0);
+  assert(varray->nvertices <= varray->nalloc);
+
+  /* Messages about individual vertices must be output in order */
+  const VertexIndex nvertices = varray->nvertices;
+  if (verbose || (nthreads <= 1) || (spawn == NULL) || (nvertices == 0)) {
+    return vertex_array_hash_duplicates(varray, verbose);
+  }
+
+  /* Links to originals are about to change */
+  discard_remap(varray);
+
+  /* Divide the extent of the vertices along the x axis into slabs */
+  Vertex * const vertices = varray->vertices;
+  double low = HUGE_VAL, high = -HUGE_VAL;
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    low = LOWEST(low, vertices[v].coords[0]);
+    high = HIGHEST(high, vertices[v].coords[0]);
+  }
+  double slab_size = (high - low) /
+                     ((double)nthreads * DUP_SLABS_PER_THREAD);
+  if (!(slab_size >= DUP_CELL_SIZE)) {
+    slab_size = DUP_CELL_SIZE;
+  }
+
+  const Allocator * const alloc = varray->alloc;
+  const size_t nbytes = sizeof(VertexIndex) * (size_t)nvertices;
+  VertexIndex * const found = allocator_alloc(alloc, nbytes);
+  VertexIndex * const list = allocator_alloc(alloc, nbytes);
+  DupSearch * const searches = allocator_alloc(alloc, sizeof(*searches) *
+                                                      (size_t)nthreads);
+  void ** const args = allocator_alloc(alloc, sizeof(*args) *
+                                              (size_t)nthreads);
+  bool success = (found != NULL) && (list != NULL) && (searches != NULL) &&
+                 (args != NULL);
+  int nsearches = 0;
+
+  if (success) {
+    /* Make a list of the vertices in each thread's slabs, in order */
+    for (int t = 0; t < nthreads; ++t) {
+      searches[t] = (DupSearch){.vertices = vertices, .count = 0,
+                                .found = found, .slab_size = slab_size,
+                                .success = true};
+    }
+    for (VertexIndex v = 0; v < nvertices; ++v) {
+      ++searches[dup_thread_of(vertices[v].coords[0], slab_size,
+                               nthreads)].count;
+    }
+    VertexIndex pos = 0;
+    for (int t = 0; t < nthreads; ++t) {
+      searches[t].list = list + pos;
+      pos += searches[t].count;
+      searches[t].count = 0;
+    }
+    for (VertexIndex v = 0; v < nvertices; ++v) {
+      DupSearch * const search = &searches[
+                 dup_thread_of(vertices[v].coords[0], slab_size, nthreads)];
+      search->list[search->count++] = v;
+    }
+
+    for (; success && (nsearches < nthreads); ++nsearches) {
+      success = dup_alloc_search(&searches[nsearches], alloc, true);
+      args[nsearches] = &searches[nsearches];
+    }
+  }
+
+  bool spawned = false;
+  if (success) {
+    spawned = spawn(context, nthreads, dup_run_thread, args);
+    for (int t = 0; spawned && (t < nthreads); ++t) {
+      spawned = searches[t].success;
+    }
+  }
+
+  for (int t = 0; t < nsearches; ++t) {
+    dup_free_search(&searches[t], alloc);
+  }
+
+  VertexIndex n = 0;
+  if (spawned) {
+    /* Search for the originals of vertices near slab boundaries */
+    DupSearch search = {.vertices = vertices, .list = list, .count = 0,
+                        .found = found};
+    for (VertexIndex v = 0; v < nvertices; ++v) {
+      if (found[v] == DUP_SHARED) {
+        list[search.count++] = v;
+      }
+    }
+    success = dup_alloc_search(&search, alloc, false);
+    if (success) {
+      dup_search(&search);
+      n = dup_link(varray, found, false);
+    }
+    dup_free_search(&search, alloc);
+  }
+
+  allocator_free(alloc, args);
+  allocator_free(alloc, searches);
+  allocator_free(alloc, list);
+  allocator_free(alloc, found);
 
-int vertex_array_find_vertex(const VertexArray * const varray, Coord (* const coords)[3])
+  if (!success) {
+    return -1;
+  }
+
+  /* If threads couldn't be started or there were too many vertices near
+     slab boundaries then search with one thread instead */
+  return spawned ? n : vertex_array_hash_duplicates(varray, false);
+}
+
+VertexIndex vertex_array_find_vertex(const VertexArray * const varray,
+                                     Coord (* const coords)[3])
 {
-  int found = -1;
+  VertexIndex found = -1;
   assert(varray != NULL);
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
 
-  const int nvertices = varray->nvertices;
-  for (int v = 0; v < nvertices; ++v) {
-    if (vector_equal(vertex_array_get_coords(varray, v), coords)) {
-      found = v;
-      break;
+  /* Vertices in the base array have lower numbers than any in the overlay
+     so there is no need to search the overlay if one is found. */
+  if (varray->base != NULL) {
+    found = vertex_array_find_vertex(varray->base, coords);
+    if (found >= 0) {
+      return found;
+    }
+  }
+
+  if (varray->nbuckets > 0) {
+    /* Search every cell that could contain coordinates equal to those
+       given. Like the linear search, this finds the lowest-numbered
+       matching vertex. The search range is slightly wider than necessary
+       to allow for rounding errors. */
+    long long low[3], high[3];
+    for (size_t dim = 0; dim < ARRAY_SIZE(low); ++dim) {
+      const double c = (*coords)[dim], margin = MAX_FLT_ERR * 1.0625;
+      low[dim] = index_cell(c - margin);
+      high[dim] = index_cell(c + margin);
+    }
+
+    long long cell[3];
+    for (cell[0] = low[0]; cell[0] <= high[0]; ++cell[0]) {
+      for (cell[1] = low[1]; cell[1] <= high[1]; ++cell[1]) {
+        for (cell[2] = low[2]; cell[2] <= high[2]; ++cell[2]) {
+          const int b = index_hash(varray, &cell);
+          for (VertexIndex v = varray->buckets[b]; v >= 0;
+               v = varray->next[v]) {
+            if (((found < 0) || (v < found)) &&
+                vector_equal(&varray->vertices[v].coords, coords)) {
+              found = v;
+            }
+          }
+        }
+      }
+    }
+  } else {
+    const VertexIndex nvertices = varray->nvertices;
+    for (VertexIndex v = 0; v < nvertices; ++v) {
+      if (vector_equal(&varray->vertices[v].coords, coords)) {
+        found = v;
+        break;
+      }
     }
   }
 
+  if (found >= 0) {
+    found += varray->nbase;
+  }
+
   if (found < 0) {
     DEBUGF("No vertex has coordinates {%"PCOORD",%"PCOORD",%"PCOORD"}\n",
            (*coords)[0], (*coords)[1], (*coords)[2]);
   } else {
-    DEBUGF("Found coordinates {%"PCOORD",%"PCOORD",%"PCOORD"} as vertex %d\n",
+    DEBUGF("Found coordinates {%"PCOORD",%"PCOORD",%"PCOORD"} "
+           "as vertex %"PVERTEXINDEX"\n",
            (*coords)[0], (*coords)[1], (*coords)[2], found);
   }
 
   return found;
 }
 
-int vertex_array_renumber(VertexArray * const varray, const bool verbose)
+bool vertex_array_enable_index(VertexArray * const varray)
+{
+  assert(varray != NULL);
+  assert(varray->nvertices >= 0);
+  assert(varray->nvertices <= varray->nalloc);
+
+  if (varray->nalloc > 0) {
+    const size_t nbytes = sizeof(*varray->next) * (size_t)varray->nalloc;
+    VertexIndex * const new_next = allocator_realloc(varray->alloc,
+                                                     varray->next, nbytes);
+    if (new_next == NULL) {
+      DEBUGF("Failed to allocate %zu bytes for vertex links\n", nbytes);
+      return false;
+    }
+    varray->next = new_next;
+  }
+
+  int nbuckets = INDEX_MIN_BUCKETS;
+  while ((nbuckets < varray->nvertices) && (nbuckets <= INT_MAX / 2)) {
+    nbuckets *= 2;
+  }
+
+  return index_make(varray, nbuckets);
+}
+
+void vertex_array_disable_index(VertexArray * const varray)
 {
   assert(varray != NULL);
+  allocator_free(varray->alloc, varray->buckets);
+  varray->buckets = NULL;
+  allocator_free(varray->alloc, varray->next);
+  varray->next = NULL;
+  varray->nbuckets = 0;
+}
+
+bool vertex_array_is_indexed(const VertexArray * const varray)
+{
+  assert(varray != NULL);
+  return varray->nbuckets > 0;
+}
+
+/* Flattens the links from duplicates to their originals into a table of
+   output IDs. It isn't an error if the table can't be allocated because
+   vertex_array_get_id can still follow links instead. */
+static void build_remap(VertexArray * const varray)
+{
+  assert(varray != NULL);
+  assert(varray->base == NULL);
+
+  const VertexIndex nvertices = varray->nvertices;
+  varray->nremap = 0;
+  if (nvertices == 0) {
+    return;
+  }
+
+  const size_t nbytes = sizeof(*varray->remap) * (size_t)nvertices;
+  VertexIndex * const remap = allocator_realloc(varray->alloc, varray->remap,
+                                                nbytes);
+  if (remap == NULL) {
+    DEBUGF("Failed to allocate %zu bytes for vertex IDs\n", nbytes);
+    return;
+  }
+  varray->remap = remap;
+
+  const Vertex * const vertices = varray->vertices;
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    remap[v] = (vertices[v].dup < 0) ? vertices[v].id : -1;
+  }
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    if (remap[v] >= 0) {
+      continue;
+    }
+    /* Find the nearest vertex with a known ID (at worst, the original) */
+    VertexIndex u = v;
+    while (remap[u] < 0) {
+      assert(vertices[u].dup >= 0);
+      assert(vertices[u].dup < nvertices);
+      u = vertices[u].dup;
+    }
+    /* Compress the path so that later searches are shorter */
+    const VertexIndex id = remap[u];
+    for (u = v; remap[u] < 0; u = vertices[u].dup) {
+      remap[u] = id;
+    }
+  }
+  varray->nremap = nvertices;
+}
+
+VertexIndex vertex_array_renumber(VertexArray * const varray,
+                                  const bool verbose)
+{
+  assert(varray != NULL);
+  assert(varray->base == NULL);
   assert(varray->nvertices >= 0);
   assert(varray->nvertices <= varray->nalloc);
 
   /* Renumber marked vertices */
-  int next_id = 0;
-  const int nvertices = varray->nvertices;
-  for (int v = 0; v < nvertices; ++v) {
+  VertexIndex next_id = 0;
+  const VertexIndex nvertices = varray->nvertices;
+  for (VertexIndex v = 0; v < nvertices; ++v) {
     Vertex * const vertex = vertex_array_get_vertex(varray, v);
     assert(vertex != NULL);
     if (vertex->marked) {
       /* Keep this vertex */
       if (next_id != v) {
         if (verbose) {
-          printf("Renumbering vertex %d as %d "
+          printf("Renumbering vertex %"PVERTEXINDEX" as %"PVERTEXINDEX" "
                  "{%"PCOORD",%"PCOORD",%"PCOORD"}\n",
                  vertex->id, next_id,
                  vertex->coords[0], vertex->coords[1], vertex->coords[2]);
@@ -383,21 +1303,193 @@ int vertex_array_renumber(VertexArray * const varray, const bool verbose)
     }
   }
   if (verbose) {
-    printf("%d/%d vertices survived\n", next_id, varray->nvertices);
+    printf("%"PVERTEXINDEX"/%"PVERTEXINDEX" vertices survived\n",
+           next_id, varray->nvertices);
   }
+
+  build_remap(varray);
   return next_id;
 }
 
+bool vertex_array_reorder(VertexArray * const varray,
+                          const VertexIndex * const order)
+{
+  assert(varray != NULL);
+  assert(varray->base == NULL);
+  assert(varray->nvertices >= 0);
+  assert(varray->nvertices <= varray->nalloc);
+  assert(order != NULL);
+
+  const VertexIndex nvertices = varray->nvertices;
+  if (nvertices == 0) {
+    return true;
+  }
+
+  const size_t nbytes = sizeof(Vertex) * (size_t)nvertices;
+  Vertex * const old = allocator_alloc(varray->alloc, nbytes);
+  const size_t where_bytes = sizeof(VertexIndex) * (size_t)nvertices;
+  VertexIndex * const where = allocator_alloc(varray->alloc, where_bytes);
+  if ((old == NULL) || (where == NULL)) {
+    DEBUGF("Failed to allocate %zu bytes to reorder vertices\n",
+           nbytes + where_bytes);
+    allocator_free(varray->alloc, where);
+    allocator_free(varray->alloc, old);
+    return false;
+  }
+
+  memcpy(old, varray->vertices, nbytes);
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    assert(order[v] >= 0);
+    assert(order[v] < nvertices);
+    where[order[v]] = v;
+  }
+
+  for (VertexIndex v = 0; v < nvertices; ++v) {
+    Vertex * const vertex = &varray->vertices[v];
+    *vertex = old[order[v]];
+    vertex->id = v;
+    if (vertex->dup >= 0) {
+      vertex->dup = where[vertex->dup];
+    }
+  }
+
+  allocator_free(varray->alloc, where);
+  allocator_free(varray->alloc, old);
+  discard_remap(varray);
+
+  if (varray->nbuckets > 0) {
+    for (int b = 0; b < varray->nbuckets; ++b) {
+      varray->buckets[b] = -1;
+    }
+    for (VertexIndex v = 0; v < nvertices; ++v) {
+      index_add_vertex(varray, v);
+    }
+  }
+
+  DEBUGF("Reordered %"PVERTEXINDEX" vertices\n", nvertices);
+  return true;
+}
+
+#if COORD_SNAP
+static bool same_side(const CoordSnap a, const CoordSnap b)
+{
+  return ((a > 0) && (b > 0)) || ((a < 0) && (b < 0));
+}
+
+/* Finds the point at which a line crosses edge AB, given cross products
+   (in the same sense) for A and B which have different signs. */
+static void snap_intersect(Coord (* const va)[3], Coord (* const vb)[3],
+                           const CoordSnap cross_a, const CoordSnap cross_b,
+                           Coord (* const intersect)[3])
+{
+  assert(cross_a != cross_b);
+  Coord diff[3], offset[3];
+  vector_sub(vb, va, &diff);
+  vector_mul(&diff, (Coord)((double)cross_a / ((double)cross_a - cross_b)),
+             &offset);
+  vector_add(va, &offset, intersect);
+}
+
+static bool snap_edge_intersects_line(Coord (* const va)[3],
+                                      Coord (* const vb)[3],
+                                      const SnapPoint * const sa,
+                                      const SnapPoint * const sb,
+                                      const SnapPoint * const sc,
+                                      const SnapPoint * const sd,
+                                      Coord (* const intersect)[3])
+{
+  const CoordSnap cross_a = vector_snap_cross(sc, sd, sa),
+                  cross_b = vector_snap_cross(sc, sd, sb);
+
+  /* Treat the endpoint as exclusive to avoid detecting the same
+     intersection twice at each vertex of a primitive. This also excludes
+     edges along the line. */
+  if (cross_b == 0) {
+    DEBUGF("Ignoring intersection at B\n");
+    return false;
+  }
+
+  if (same_side(cross_a, cross_b)) {
+    DEBUGF("Edge is on one side of line\n");
+    return false;
+  }
+
+  if (cross_a == 0) {
+    DEBUGF("Intersection is at A\n");
+    for (size_t dim = 0; dim < ARRAY_SIZE(*intersect); ++dim) {
+      (*intersect)[dim] = (*va)[dim];
+    }
+  } else {
+    snap_intersect(va, vb, cross_a, cross_b, intersect);
+  }
+  return true;
+}
+
+static bool snap_edges_intersect(Coord (* const va)[3],
+                                 Coord (* const vb)[3],
+                                 Coord (* const vc)[3],
+                                 Coord (* const vd)[3],
+                                 const SnapPoint * const sa,
+                                 const SnapPoint * const sb,
+                                 const SnapPoint * const sc,
+                                 const SnapPoint * const sd,
+                                 Coord (* const intersect)[3])
+{
+  const CoordSnap cross_a = vector_snap_cross(sc, sd, sa),
+                  cross_b = vector_snap_cross(sc, sd, sb),
+                  cross_c = vector_snap_cross(sa, sb, sc),
+                  cross_d = vector_snap_cross(sa, sb, sd);
+
+  /* Like vector_intersect, treat parallel edges as not intersecting */
+  if (((cross_a == 0) && (cross_b == 0)) ||
+      ((cross_c == 0) && (cross_d == 0))) {
+    DEBUGF("Edges are parallel\n");
+    return false;
+  }
+
+  if (same_side(cross_a, cross_b) || same_side(cross_c, cross_d)) {
+    DEBUGF("Edges do not cross\n");
+    return false;
+  }
+
+  /* If an endpoint of either edge is on the other edge then that is
+     where they intersect (which callers may need to recognise) */
+  Coord (*endpoint)[3] = NULL;
+  if (cross_a == 0) {
+    endpoint = va;
+  } else if (cross_b == 0) {
+    endpoint = vb;
+  } else if (cross_c == 0) {
+    endpoint = vc;
+  } else if (cross_d == 0) {
+    endpoint = vd;
+  }
+
+  if (endpoint != NULL) {
+    DEBUGF("Intersection is at an endpoint\n");
+    for (size_t dim = 0; dim < ARRAY_SIZE(*intersect); ++dim) {
+      (*intersect)[dim] = (*endpoint)[dim];
+    }
+  } else {
+    snap_intersect(va, vb, cross_a, cross_b, intersect);
+  }
+  return true;
+}
+#endif /* COORD_SNAP */
+
 /* This function treats the line CD as infinite in extent.
    with A inclusive start and B as exclusive end. */
 bool vertex_array_edge_intersects_line(const VertexArray * const varray,
-                                       const int a, const int b,
-                                       const int c, const int d,
+                                       const VertexIndex a,
+                                       const VertexIndex b,
+                                       const VertexIndex c,
+                                       const VertexIndex d,
                                        const Plane p,
                                        Coord (* const intersect)[3])
 {
-  DEBUGF("Testing edge A(%d) .. B(%d) against line C(%d) .. D(%d)\n",
-          a, b, c, d);
+  DEBUGF("Testing edge A(%"PVERTEXINDEX") .. B(%"PVERTEXINDEX") "
+         "against line C(%"PVERTEXINDEX") .. D(%"PVERTEXINDEX")\n",
+         a, b, c, d);
   assert(a != b);
   assert(c != d);
   assert(intersect != NULL);
@@ -407,6 +1499,14 @@ bool vertex_array_edge_intersects_line(const VertexArray * const varray,
   Coord (* const vc)[3] = vertex_array_get_coords(varray, c);
   Coord (* const vd)[3] = vertex_array_get_coords(varray, d);
 
+#if COORD_SNAP
+  SnapPoint sa, sb, sc, sd;
+  if (vector_snap(va, p, &sa) && vector_snap(vb, p, &sb) &&
+      vector_snap(vc, p, &sc) && vector_snap(vd, p, &sd)) {
+    return snap_edge_intersects_line(va, vb, &sa, &sb, &sc, &sd, intersect);
+  }
+#endif /* COORD_SNAP */
+
   if (!vector_intersect(va, vb, vc, vd, p, intersect)) {
     return false;
   }
@@ -460,13 +1560,16 @@ bool vertex_array_edge_intersects_line(const VertexArray * const varray,
 /* This function treats AB and CD as edges of finite extent
    with inclusive starts and ends. */
 bool vertex_array_edges_intersect(const VertexArray * const varray,
-                                  const int a, const int b,
-                                  const int c, const int d,
+                                  const VertexIndex a,
+                                  const VertexIndex b,
+                                  const VertexIndex c,
+                                  const VertexIndex d,
                                   const Plane p,
                                   Coord (* const intersect)[3])
 {
-  DEBUGF("Testing edge A(%d) .. B(%d) against edge C(%d) .. D(%d)\n",
-          a, b, c, d);
+  DEBUGF("Testing edge A(%"PVERTEXINDEX") .. B(%"PVERTEXINDEX") "
+         "against edge C(%"PVERTEXINDEX") .. D(%"PVERTEXINDEX")\n",
+         a, b, c, d);
   assert(a != b);
   assert(c != d);
   assert(intersect != NULL);
@@ -476,6 +1579,15 @@ bool vertex_array_edges_intersect(const VertexArray * const varray,
   Coord (* const vc)[3] = vertex_array_get_coords(varray, c);
   Coord (* const vd)[3] = vertex_array_get_coords(varray, d);
 
+#if COORD_SNAP
+  SnapPoint sa, sb, sc, sd;
+  if (vector_snap(va, p, &sa) && vector_snap(vb, p, &sb) &&
+      vector_snap(vc, p, &sc) && vector_snap(vd, p, &sd)) {
+    return snap_edges_intersect(va, vb, vc, vd, &sa, &sb, &sc, &sd,
+                                intersect);
+  }
+#endif /* COORD_SNAP */
+
   const Coord ax = *vector_x(va, p), bx = *vector_x(vb, p),
               cx = *vector_x(vc, p), dx = *vector_x(vd, p);
 
@@ -561,9 +1673,10 @@ bool vertex_array_edges_intersect(const VertexArray * const varray,
   return true;
 }
 
-void vertex_array_print_vertex(const VertexArray * const varray, const int v)
+void vertex_array_print_vertex(const VertexArray * const varray,
+                               const VertexIndex v)
 {
   Coord (* const coords)[3] = vertex_array_get_coords(varray, v);
-  printf("%d:{%"PCOORD",%"PCOORD",%"PCOORD"}", v,
+  printf("%"PVERTEXINDEX":{%"PCOORD",%"PCOORD",%"PCOORD"}", v,
          (*coords)[0], (*coords)[1], (*coords)[2]);
 }
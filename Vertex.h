@@ -23,70 +23,192 @@
                   duplicates or a failure indication.
   CJB: 30-Aug-18: Added a function to mark all vertices as used.
   CJB: 11-Dec-20: Removed redundant uses of the 'extern' keyword.
+  CJB: 14-Oct-26: Added an optional spatial index to speed up
+                  vertex_array_find_vertex.
+                  Added overlays, which allow vertices to be added without
+                  modifying the underlying array.
+                  Added vertex_array_reserve and vertex_array_add_vertices.
+                  Added vertex_array_hash_duplicates.
+                  Added vertex_array_init_allocator.
+                  vertex_array_renumber now builds a table of output IDs,
+                  which can be got using vertex_array_get_remap.
+                  Added vertex_array_reorder.
+                  Vertex numbers, IDs and counts now have type VertexIndex,
+                  which can be selected to be 64-bit.
+                  Added vertex_array_hash_duplicates_parallel.
+                  Its spawn parameter now has type ClipSpawnFn.
  */
 
 #ifndef VERTEX_H
 #define VERTEX_H
 
 #include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 
 #include "Vector.h"
 #include "Coord.h"
+#include "Allocator.h"
+#include "Spawn.h"
+
+/* Setting this switch to 1 makes vertex numbers, IDs and counts 64-bit,
+   which allows models with more than INT_MAX vertices at the cost of
+   making vertices and the sides of primitives bigger. Otherwise they are
+   ints, which is more compact. */
+#ifndef VERTEX_INDEX_64
+#define VERTEX_INDEX_64 0
+#endif
+
+#if VERTEX_INDEX_64
+
+typedef int64_t VertexIndex;
+#define VERTEX_INDEX_MAX INT64_MAX
+#define PVERTEXINDEX PRId64
+
+#else
+
+typedef int VertexIndex;
+#define VERTEX_INDEX_MAX INT_MAX
+#define PVERTEXINDEX "d"
+
+#endif
 
 typedef struct {
   Coord coords[3];
-  int id;
-  int dup;
+  VertexIndex id;
+  VertexIndex dup;
   bool marked;
 } Vertex;
 
-typedef struct {
-  int nalloc;
-  int nvertices;
-  int nsorted;
+typedef struct VertexArray {
+  VertexIndex nalloc;
+  VertexIndex nvertices;
+  VertexIndex nsorted;
   Vertex *vertices;
   Vertex **sorted;
+  int nbuckets; /* 0 unless the spatial index is enabled */
+  VertexIndex *buckets; /* first vertex in each bucket, or -1 */
+  VertexIndex *next; /* next vertex in the same bucket, or -1 */
+  const struct VertexArray *base; /* NULL unless this is an overlay */
+  VertexIndex nbase; /* number of vertices in the base array */
+  const Allocator *alloc; /* NULL to use malloc, realloc and free */
+  VertexIndex *remap; /* output ID of each vertex, or NULL */
+  VertexIndex nremap; /* number of vertices in remap, or 0 if out of date */
 } VertexArray;
 
 void vertex_array_init(VertexArray *varray);
 
+/* Like vertex_array_init, except that all memory for the array is allocated
+   using alloc (if not NULL), which must remain valid until the array is
+   freed. */
+void vertex_array_init_allocator(VertexArray *varray, const Allocator *alloc);
+
+/* An overlay begins with the vertices of a base array (which must not be
+   modified or freed while the overlay is in use). Vertices added to it are
+   numbered after those of the base array. Overlays allow vertices to be
+   found and added concurrently by different threads without locking,
+   if each thread has its own overlay. Only the functions that get, add or
+   find vertices (and the spatial index) can be used with an overlay, and
+   vertex_array_clear only removes vertices added to the overlay. Memory for
+   an overlay is allocated using malloc, even if the base array has an
+   allocator, because allocators need not be thread-safe. */
+void vertex_array_init_overlay(VertexArray *varray, const VertexArray *base);
+
 void vertex_array_clear(VertexArray *varray);
 
 void vertex_array_free(VertexArray *varray);
 
-Vertex *vertex_array_get_vertex(const VertexArray *varray, int n);
+Vertex *vertex_array_get_vertex(const VertexArray *varray, VertexIndex n);
 
-int vertex_array_get_num_vertices(const VertexArray *varray);
+VertexIndex vertex_array_get_num_vertices(const VertexArray *varray);
 
 void vertex_array_set_all_used(const VertexArray *varray);
 
-void vertex_array_set_used(const VertexArray *varray, int n);
+void vertex_array_set_used(const VertexArray *varray, VertexIndex n);
+
+bool vertex_array_is_used(const VertexArray *varray, VertexIndex n);
+
+VertexIndex vertex_array_get_id(const VertexArray *varray, VertexIndex n);
+
+/* Gets a table of the IDs that vertex_array_get_id would return for every
+   vertex, or NULL if it is out of date because duplicates were found or
+   vertices were added after the last call to vertex_array_renumber. */
+const VertexIndex *vertex_array_get_remap(const VertexArray *varray);
+
+Coord (*vertex_array_get_coords(const VertexArray *varray,
+                                 VertexIndex n))[3];
+
+VertexIndex vertex_array_alloc_vertices(VertexArray *varray, VertexIndex n);
+
+/* Unlike vertex_array_alloc_vertices, which grows the array geometrically,
+   this allocates space for exactly n vertices (including those of any base
+   array) if they don't fit already. */
+bool vertex_array_reserve(VertexArray *varray, VertexIndex n);
+
+VertexIndex vertex_array_add_vertex(VertexArray *varray, Coord (*coords)[3]);
+
+/* Appends count vertices without checking for duplicates, as if by calling
+   vertex_array_add_vertex for each. Returns the index of the first vertex
+   added, or -1 if there was not enough memory (in which case none are). */
+VertexIndex vertex_array_add_vertices(VertexArray *varray,
+                                      Coord (*coords)[3], VertexIndex count);
+
+VertexIndex vertex_array_find_vertex(const VertexArray *varray,
+                                     Coord (*coords)[3]);
 
-bool vertex_array_is_used(const VertexArray *varray, int n);
+/* The spatial index is a hash table of vertices keyed on coordinates
+   quantised to a grid with cells comparable in size to MAX_FLT_ERR.
+   It is updated by vertex_array_add_vertex but must be rebuilt (by calling
+   vertex_array_enable_index again) after modifying any vertex coordinates
+   in place. It doesn't change the result of vertex_array_find_vertex. */
+bool vertex_array_enable_index(VertexArray *varray);
 
-int vertex_array_get_id(const VertexArray *varray, int n);
+void vertex_array_disable_index(VertexArray *varray);
 
-Coord (*vertex_array_get_coords(const VertexArray *varray, int n))[3];
+bool vertex_array_is_indexed(const VertexArray *varray);
 
-int vertex_array_alloc_vertices(VertexArray *varray, int n);
+VertexIndex vertex_array_find_duplicates(VertexArray *varray, bool verbose);
 
-int vertex_array_add_vertex(VertexArray *varray, Coord (*coords)[3]);
+/* An alternative to vertex_array_find_duplicates which uses a hash table
+   instead of sorting, so it takes linear time. Each vertex is linked to the
+   lowest-numbered earlier vertex with equal coordinates (that isn't itself
+   a duplicate). Duplicates that sorting would separate are also found. */
+VertexIndex vertex_array_hash_duplicates(VertexArray *varray, bool verbose);
 
-int vertex_array_find_vertex(const VertexArray *varray, Coord (*coords)[3]);
+/* Same as vertex_array_hash_duplicates except that the vertices are
+   divided into slabs along the x axis and slabs are searched concurrently,
+   using up to nthreads threads started by calling spawn (with the given
+   context), which must behave as described for ClipSpawnFn. Vertices whose
+   originals may be in another slab are then searched by one thread. The
+   duplicates and their originals are the same as those found by
+   vertex_array_hash_duplicates, whatever the number of threads. If verbose
+   output is requested then the vertices are searched by one thread
+   instead. */
+VertexIndex vertex_array_hash_duplicates_parallel(
+        VertexArray *varray, bool verbose, int nthreads,
+        ClipSpawnFn *spawn, void *context);
 
-int vertex_array_find_duplicates(VertexArray *varray, bool verbose);
+VertexIndex vertex_array_renumber(VertexArray *varray, bool verbose);
 
-int vertex_array_renumber(VertexArray *varray, bool verbose);
+/* Moves vertex order[v] to position v, for every vertex. Links from
+   duplicates to their originals are updated, as is any spatial index, but
+   vertex numbers held elsewhere (e.g. by primitives) are not. Each
+   vertex's ID is reset to its new number, so vertex_array_renumber must be
+   called (again) before output. Returns false if there is not enough
+   memory, in which case the array is unchanged. */
+bool vertex_array_reorder(VertexArray *varray, const VertexIndex *order);
 
 bool vertex_array_edge_intersects_line(const VertexArray *varray,
-                                       int a, int b, int c, int d,
+                                       VertexIndex a, VertexIndex b,
+                                       VertexIndex c, VertexIndex d,
                                        Plane p, Coord (*intersect)[3]);
 
-bool vertex_array_edges_intersect(const VertexArray *varray, int a, int b,
-                                  int c, int d, Plane p,
+bool vertex_array_edges_intersect(const VertexArray *varray,
+                                  VertexIndex a, VertexIndex b,
+                                  VertexIndex c, VertexIndex d, Plane p,
                                   Coord (*intersect)[3]);
 
-void vertex_array_print_vertex(const VertexArray *varray, int v);
+void vertex_array_print_vertex(const VertexArray *varray, VertexIndex v);
 
 #endif /* VERTEX_H */
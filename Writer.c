@@ -0,0 +1,266 @@
+/*
+ * 3dObjLib: Buffered text output
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this source file.
+                  Added a growable memory buffer as a destination.
+                  writer_put_int now takes a long long.
+ */
+
+/* ISO library header files */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+/* Local header files */
+#include "Internal/3dObjMisc.h"
+#include "Writer.h"
+#include "Coord.h"
+
+enum {
+  WRITER_BUF_SIZE = 64 * 1024,
+  FIXED_DIGITS = 6, /* number of decimal places output by "%f" */
+  FIXED_SCALE = 1000000 /* 10 to the power of FIXED_DIGITS */
+};
+
+/* Coordinates scaled by FIXED_SCALE are formatted without printf if they
+   are less than this (2 to the power of 52) so that the fractional part is
+   representable. */
+#define FIXED_LIMIT 4503599627370496.0
+
+static bool write_file(void * const context, const char * const data,
+                       const size_t n)
+{
+  FILE * const out = context;
+  assert(out != NULL);
+  assert(!ferror(out));
+  return fwrite(data, 1, n, out) == n;
+}
+
+void writer_init(Writer * const writer, WriterFn * const fn,
+                 void * const context)
+{
+  assert(writer != NULL);
+  assert(fn != NULL);
+
+  *writer = (Writer){
+    .fn = fn,
+    .context = context,
+    .buf = malloc(WRITER_BUF_SIZE),
+    .size = WRITER_BUF_SIZE,
+    .len = 0,
+    .failed = false,
+  };
+
+  if (writer->buf == NULL) {
+    DEBUGF("Failed to allocate %d bytes for output\n", WRITER_BUF_SIZE);
+    writer->buf = writer->small;
+    writer->size = sizeof(writer->small);
+  }
+}
+
+void writer_init_file(Writer * const writer, FILE * const out)
+{
+  assert(out != NULL);
+  writer_init(writer, write_file, out);
+}
+
+void writer_memory_init(WriterMemory * const mem)
+{
+  assert(mem != NULL);
+  *mem = (WriterMemory){
+    .data = NULL,
+    .len = 0,
+    .size = 0,
+  };
+}
+
+void writer_memory_free(WriterMemory * const mem)
+{
+  assert(mem != NULL);
+  free(mem->data);
+  writer_memory_init(mem);
+}
+
+static bool write_memory(void * const context, const char * const data,
+                         const size_t n)
+{
+  WriterMemory * const mem = context;
+  assert(mem != NULL);
+  assert(mem->len <= mem->size);
+
+  if (n > mem->size - mem->len) {
+    if (n > ((size_t)-1 / 2) - mem->len) {
+      DEBUGF("Too much output to store in memory\n");
+      return false;
+    }
+    size_t new_size = mem->size ? mem->size * 2 : WRITER_BUF_SIZE;
+    if (new_size < mem->len + n) {
+      new_size = mem->len + n;
+    }
+    char * const new_data = realloc(mem->data, new_size);
+    if (new_data == NULL) {
+      DEBUGF("Failed to allocate %zu bytes for output\n", new_size);
+      return false;
+    }
+    mem->data = new_data;
+    mem->size = new_size;
+  }
+
+  memcpy(mem->data + mem->len, data, n);
+  mem->len += n;
+  return true;
+}
+
+void writer_init_memory(Writer * const writer, WriterMemory * const mem)
+{
+  assert(mem != NULL);
+  writer_init(writer, write_memory, mem);
+}
+
+void writer_free(Writer * const writer)
+{
+  assert(writer != NULL);
+  if (writer->buf != writer->small) {
+    free(writer->buf);
+  }
+  writer->buf = NULL;
+}
+
+bool writer_flush(Writer * const writer)
+{
+  assert(writer != NULL);
+  assert(writer->buf != NULL);
+  assert(writer->len <= writer->size);
+
+  if (!writer->failed && (writer->len > 0)) {
+    DEBUGF("Writing %zu bytes of output\n", writer->len);
+    writer->failed = !writer->fn(writer->context, writer->buf, writer->len);
+  }
+  writer->len = 0;
+  return !writer->failed;
+}
+
+bool writer_write(Writer * const writer, const char * const data,
+                  const size_t n)
+{
+  assert(writer != NULL);
+  assert(writer->buf != NULL);
+  assert(data != NULL || n == 0);
+  assert(writer->len <= writer->size);
+
+  if (n > writer->size - writer->len) {
+    if (!writer_flush(writer)) {
+      return false;
+    }
+
+    /* Bypass the buffer for data that wouldn't fit in it */
+    if (n > writer->size) {
+      writer->failed = !writer->fn(writer->context, data, n);
+      return !writer->failed;
+    }
+  }
+
+  memcpy(writer->buf + writer->len, data, n);
+  writer->len += n;
+  return !writer->failed;
+}
+
+bool writer_puts(Writer * const writer, const char * const s)
+{
+  assert(s != NULL);
+  return writer_write(writer, s, strlen(s));
+}
+
+/* Writes the decimal digits of n without leading zeros, unless fewer than
+   min_digits would be written. */
+static size_t format_digits(char * const str, unsigned long long n,
+                            const size_t min_digits)
+{
+  char digits[32];
+  size_t len = 0;
+  do {
+    assert(len < sizeof(digits));
+    digits[len++] = (char)('0' + (n % 10));
+    n /= 10;
+  } while ((n > 0) || (len < min_digits));
+
+  for (size_t i = 0; i < len; ++i) {
+    str[i] = digits[len - 1 - i];
+  }
+  return len;
+}
+
+bool writer_put_int(Writer * const writer, const long long n)
+{
+  char str[32];
+  size_t len = 0;
+
+  /* Negate in unsigned arithmetic to avoid overflow for LLONG_MIN */
+  unsigned long long u = (unsigned long long)n;
+  if (n < 0) {
+    str[len++] = '-';
+    u = 0 - u;
+  }
+  len += format_digits(str + len, u, 1);
+
+  return writer_write(writer, str, len);
+}
+
+bool writer_put_coord(Writer * const writer, const Coord c)
+{
+  const double x = c;
+
+  /* The product may differ from the exact result by up to half a unit in
+     the last place, so only values far enough from halfway between two
+     integers are certain to round the same way as printf would.
+     Halfway cases and huge or non-finite values are left to printf. */
+  const double r = fabs(x) * FIXED_SCALE;
+  if (r < FIXED_LIMIT) {
+    const double whole = floor(r), fraction = r - whole;
+    const double ulp = nextafter(r, HUGE_VAL) - r;
+    if (fabs(fraction - 0.5) > ulp) {
+      const unsigned long long n = (unsigned long long)whole +
+                                   (fraction > 0.5 ? 1 : 0);
+      char str[32];
+      size_t len = 0;
+
+      /* printf outputs the sign of negative values that round to zero */
+      if (signbit(x)) {
+        str[len++] = '-';
+      }
+      len += format_digits(str + len, n / FIXED_SCALE, 1);
+      str[len++] = '.';
+      len += format_digits(str + len, n % FIXED_SCALE, FIXED_DIGITS);
+
+      return writer_write(writer, str, len);
+    }
+  }
+
+  char str[DBL_MAX_10_EXP + FIXED_DIGITS + 8];
+  const int len = snprintf(str, sizeof(str), "%f", x);
+  if ((len < 0) || ((size_t)len >= sizeof(str))) {
+    writer->failed = true;
+    return false;
+  }
+  return writer_write(writer, str, (size_t)len);
+}
@@ -0,0 +1,85 @@
+/*
+ * 3dObjLib: Buffered text output
+ * Copyright (C) 2026 Christopher Bazley
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* History:
+  CJB: 14-Oct-26: Created this header file.
+                  Added a growable memory buffer as a destination.
+                  writer_put_int now takes a long long.
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Coord.h"
+
+/* Type of function called to write a chunk of buffered output.
+   It must return false if the data could not be written. */
+typedef bool WriterFn(void *context, const char *data, size_t n);
+
+/* Text is formatted into a buffer which is only written when full or
+   flushed. Once any write fails, all subsequent writes fail too. */
+typedef struct {
+  WriterFn *fn;
+  void *context;
+  char *buf;
+  size_t size;
+  size_t len;
+  bool failed;
+  char small[64]; /* used if a bigger buffer cannot be allocated */
+} Writer;
+
+void writer_init(Writer *writer, WriterFn *fn, void *context);
+
+void writer_init_file(Writer *writer, FILE *out);
+
+/* A destination for output which stores it in memory. */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} WriterMemory;
+
+void writer_memory_init(WriterMemory *mem);
+
+void writer_memory_free(WriterMemory *mem);
+
+/* Output is appended to mem when flushed. It fails if more memory
+   cannot be allocated. */
+void writer_init_memory(Writer *writer, WriterMemory *mem);
+
+/* Discards any output that has not been flushed. */
+void writer_free(Writer *writer);
+
+bool writer_flush(Writer *writer);
+
+bool writer_write(Writer *writer, const char *data, size_t n);
+
+bool writer_puts(Writer *writer, const char *s);
+
+/* Same output as printf ("%lld", n). */
+bool writer_put_int(Writer *writer, long long n);
+
+/* Same output as printf ("%f", c). */
+bool writer_put_coord(Writer *writer, Coord c);
+
+#endif /* WRITER_H */